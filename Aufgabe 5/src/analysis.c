@@ -0,0 +1,194 @@
+#include "analysis.h"
+#include "decoder.h"
+#include <string.h>
+
+static const int step_x[4] = { 0, 0, -1, 1 };
+static const int step_y[4] = { -1, 1, 0, 0 };
+static const enum direction right_of[4] = { RIGHT, LEFT, UP, DOWN };
+static const enum direction left_of[4] = { LEFT, RIGHT, DOWN, UP };
+static const char* const direction_names[4] = { "UP", "DOWN", "LEFT", "RIGHT" };
+
+static int inside(int x, int y) {
+    return x >= 0 && x < GRID_WIDTH && y >= 0 && y < GRID_HEIGHT;
+}
+
+static int writes_below(enum opcode op) {
+    return op == OP_FETCH_BELOW || op == OP_INPUT_BELOW;
+}
+
+static int writes_above(enum opcode op) {
+    return op == OP_FETCH_ABOVE || op == OP_INPUT_ABOVE;
+}
+
+static void mark(struct program_analysis *a, int x, int y, enum direction dir) {
+    if (inside(x, y) && !a->reachable[y][x][dir]) {
+        a->reachable[y][x][dir] = 1;
+        a->queue[a->queue_length++] = (y * GRID_WIDTH + x) * 4 + dir;
+    }
+}
+
+static void mark_move(struct program_analysis *a, int x, int y, enum direction dir) {
+    mark(a, x + step_x[dir], y + step_y[dir], dir);
+}
+
+static void mark_jump_targets(struct program_analysis *a, int x, int y, enum direction dir) {
+    for (int tx = x + step_x[dir], ty = y + step_y[dir]; inside(tx, ty); tx += step_x[dir], ty += step_y[dir]) {
+        mark(a, tx, ty, dir);
+    }
+}
+
+// Directions the IP may leave a cell in; 0 for jumps, e and invalid cells
+static int next_directions(enum opcode op, enum direction dir, enum direction next[2]) {
+    switch (op) {
+        case OP_LEFT: next[0] = LEFT; return 1;
+        case OP_DOWN: next[0] = DOWN; return 1;
+        case OP_UP: next[0] = UP; return 1;
+        case OP_RIGHT: next[0] = RIGHT; return 1;
+        case OP_TURN_RIGHT: next[0] = dir; next[1] = right_of[dir]; return 2;
+        case OP_TURN_LEFT: next[0] = dir; next[1] = left_of[dir]; return 2;
+        case OP_JUMP_LEFT: case OP_JUMP_DOWN: case OP_JUMP_UP: case OP_JUMP_RIGHT:
+        case OP_END: case OP_INVALID:
+            return 0;
+        default:
+            next[0] = dir;
+            return 1;
+    }
+}
+
+// Find every (cell, direction) state reachable from the start, assuming
+// the program is not modified, and every cell an f/F/i/I may write to
+void analyze_program(struct program_analysis *a) {
+    memset(a, 0, sizeof(*a));
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            a->opcodes[y][x] = get_instruction_opcode((char)grid[y][x]);
+        }
+    }
+
+    mark(a, 0, 0, RIGHT);
+    for (int head = 0; head < a->queue_length; head++) {
+        int state = a->queue[head];
+        enum direction dir = (enum direction)(state % 4);
+        int x = (state / 4) % GRID_WIDTH;
+        int y = (state / 4) / GRID_WIDTH;
+        enum opcode op = a->opcodes[y][x];
+
+        a->code_cell[y][x] = 1;
+        if (writes_below(op) && inside(x, y + 1)) a->writable[y + 1][x] = 1;
+        if (writes_above(op) && inside(x, y - 1)) a->writable[y - 1][x] = 1;
+
+        switch (op) {
+            case OP_JUMP_LEFT: mark_jump_targets(a, x, y, LEFT); break;
+            case OP_JUMP_DOWN: mark_jump_targets(a, x, y, DOWN); break;
+            case OP_JUMP_UP: mark_jump_targets(a, x, y, UP); break;
+            case OP_JUMP_RIGHT: mark_jump_targets(a, x, y, RIGHT); break;
+            default: {
+                enum direction next[2];
+                int count = next_directions(op, dir, next);
+                for (int i = 0; i < count; i++) {
+                    mark_move(a, x, y, next[i]);
+                }
+                break;
+            }
+        }
+    }
+}
+
+// Flag the cells no reachable instruction writes to; trace ops reading one
+// take its value as an immediate (see build_trace)
+void mark_fixed_cells(const struct program_analysis *a) {
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            program_image[y][x].fixed = !a->writable[y][x];
+        }
+    }
+}
+
+// Errors a reachable cell raises every time it runs
+static void report_cell_errors(const struct program_analysis *a, int x, int y, FILE *out) {
+    enum opcode op = a->opcodes[y][x];
+    int row = y + operand_row(op);
+
+    if (op == OP_INVALID) {
+        fprintf(out, "Warning: Invalid instruction at (%d, %d): ASCII %d\n", x, y, (unsigned char)grid[y][x]);
+        return;
+    }
+    if (row != y && !inside(x, row)) {
+        fprintf(out, "Warning: %s cell outside bounds (%d, %d) at (%d, %d)\n",
+                writes_below(op) || writes_above(op) ? "Setting" : "Accessing", x, row, x, y);
+        return;
+    }
+    if (row != y && !a->writable[row][x]) {
+        int value = grid[row][x];
+        if ((op == OP_DIVIDE_BELOW || op == OP_DIVIDE_ABOVE || op == OP_MODULO_BELOW ||
+             op == OP_MODULO_ABOVE) && value == 0) {
+            fprintf(out, "Warning: Division by zero at (%d, %d)\n", x, y);
+        }
+        if ((op == OP_OUTPUT_BELOW || op == OP_OUTPUT_ABOVE) && (value < 0 || value > 127)) {
+            fprintf(out, "Warning: Invalid ASCII value for output at (%d, %d): %d (must be 0-127)\n",
+                    x, y, value);
+        }
+    }
+    for (int dir = 0; dir < 4; dir++) {
+        enum direction next[2];
+        int count = a->reachable[y][x][dir] ? next_directions(op, (enum direction)dir, next) : 0;
+        int leaving = 0;
+        for (int i = 0; i < count; i++) {
+            leaving += !inside(x + step_x[next[i]], y + step_y[next[i]]);
+        }
+        if (count > 0 && leaving == count) {
+            fprintf(out, "Warning: Instruction pointer moves outside bounds at (%d, %d) (%s)\n",
+                    x, y, direction_names[next[count - 1]]);
+        }
+    }
+}
+
+// Print what the analysis found: errors reachable cells raise whenever they
+// run, and instructions that can never run
+void report_analysis(const struct program_analysis *a, FILE *out) {
+    unsigned char data[GRID_HEIGHT][GRID_WIDTH] = { { 0 } };
+    int code_cells = 0;
+    int writable_cells = 0;
+    int fixed_operands = 0;
+
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            writable_cells += a->writable[y][x];
+            if (!a->code_cell[y][x]) {
+                continue;
+            }
+            code_cells++;
+            int row = y + operand_row(a->opcodes[y][x]);
+            if (row != y && inside(x, row)) {
+                data[row][x] = 1;
+                fixed_operands += !a->writable[row][x];
+            }
+        }
+    }
+    fprintf(out, "Analysis: %d reachable states in %d cells, %d writable cells, %d constant operands\n",
+            a->queue_length, code_cells, writable_cells, fixed_operands);
+
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            if (a->code_cell[y][x]) {
+                report_cell_errors(a, x, y, out);
+            }
+        }
+    }
+
+    // Instructions that are neither reached nor read or written as data
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            int first = x;
+            while (x < GRID_WIDTH && a->opcodes[y][x] != OP_NOP && !a->code_cell[y][x] &&
+                   !a->writable[y][x] && !data[y][x]) {
+                x++;
+            }
+            if (x - first == 1) {
+                fprintf(out, "Warning: Unreachable instruction at (%d, %d)\n", first, y);
+            } else if (x > first) {
+                fprintf(out, "Warning: Unreachable instructions at (%d, %d) to (%d, %d)\n", first, y, x - 1, y);
+            }
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "interpreter.h"
+#include "hashTable.h"
+#include <stdio.h>
+
+// Load-time analysis of the program in the grid: every (cell, direction)
+// state the IP can reach from the start, assuming the program does not
+// overwrite its own instructions, and every cell a reachable f/F/i/I may
+// write to. The fast engine trusts the cells no one writes to as constants;
+// should a write hit one after all, set_cell_value drops that trust (see
+// release_fixed_cells).
+struct program_analysis {
+    enum opcode opcodes[GRID_HEIGHT][GRID_WIDTH];
+    unsigned char reachable[GRID_HEIGHT][GRID_WIDTH][4];
+    unsigned char writable[GRID_HEIGHT][GRID_WIDTH];
+    unsigned char code_cell[GRID_HEIGHT][GRID_WIDTH];   // reachable in any direction
+    int queue[GRID_HEIGHT * GRID_WIDTH * 4];            // reachable states in search order,
+    int queue_length;                                   // (y * GRID_WIDTH + x) * 4 + direction
+};
+
+// Function declarations
+void analyze_program(struct program_analysis *analysis);
+void mark_fixed_cells(const struct program_analysis *analysis);
+void report_analysis(const struct program_analysis *analysis, FILE *out);
+
+#endif // ANALYSIS_H
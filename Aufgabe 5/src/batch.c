@@ -0,0 +1,306 @@
+#include "batch.h"
+#include "pfusch.h"
+#include "input.h"
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// One input file; filled in by a worker, reported in order by the main thread
+struct job {
+    char *name;
+    char *path;
+    char *output;
+    size_t output_length;
+    size_t output_capacity;
+    enum pfusch_status status;
+    char error[256];
+    int failed;                 // the input or output file could not be used
+    int done;
+};
+
+// Worker with its own interpreter instance; the I/O callbacks work on the
+// job it is running
+struct worker {
+    pthread_t thread;
+    pfusch *instance;
+    struct job *job;
+    const char *input;
+    size_t input_length;
+    size_t input_position;
+};
+
+static struct job *jobs;
+static int job_count;
+static atomic_int next_job;
+static const char *output_directory;
+static long job_max_steps;
+static int reported_jobs;       // jobs printed so far, in order
+static int job_window;          // jobs a worker may start ahead of reported_jobs
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_signal = PTHREAD_COND_INITIALIZER;
+
+static int read_job_input(void *user) {
+    struct worker *worker = user;
+    if (worker->input_position >= worker->input_length) {
+        return EOF;
+    }
+    return (unsigned char)worker->input[worker->input_position++];
+}
+
+static void write_job_output(void *user, const char *bytes, int count) {
+    struct job *job = ((struct worker *)user)->job;
+    if (job->output_length + count > job->output_capacity) {
+        size_t capacity = job->output_capacity ? job->output_capacity : 256;
+        while (capacity < job->output_length + count) {
+            capacity *= 2;
+        }
+        char *output = realloc(job->output, capacity);
+        if (!output) {
+            fprintf(stderr, "Error: Out of memory while collecting output\n");
+            exit(1);
+        }
+        job->output = output;
+        job->output_capacity = capacity;
+    }
+    memcpy(job->output + job->output_length, bytes, count);
+    job->output_length += count;
+}
+
+// Whole file in memory, NULL if it cannot be read
+static char *read_file(const char *path, size_t *length) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    char *data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    for (;;) {
+        if (size == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            char *grown = realloc(data, capacity);
+            if (!grown) {
+                free(data);
+                fclose(fp);
+                return NULL;
+            }
+            data = grown;
+        }
+        size_t count = fread(data + size, 1, capacity - size, fp);
+        if (count == 0) {
+            break;
+        }
+        size += count;
+    }
+    fclose(fp);
+    *length = size;
+    return data;
+}
+
+static void run_job(struct worker *worker, struct job *job) {
+    size_t length = 0;
+    // Inputs are mapped; read_file is left for files that cannot be
+    char *copy = NULL;
+    const char *input = map_file(job->path, &length);
+    if (!input) {
+        input = copy = read_file(job->path, &length);
+    }
+    if (!input) {
+        snprintf(job->error, sizeof(job->error), "Error: Could not read input file");
+        job->failed = 1;
+        return;
+    }
+    worker->job = job;
+    worker->input = input;
+    worker->input_length = length;
+    worker->input_position = 0;
+
+    pfusch_reset(worker->instance);
+    job->status = pfusch_run(worker->instance, job_max_steps);
+    snprintf(job->error, sizeof(job->error), "%s", pfusch_error(worker->instance));
+    if (copy) {
+        free(copy);
+    } else {
+        unmap_file(input, length);
+    }
+
+    if (output_directory) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.out", output_directory, job->name);
+        FILE *fp = fopen(path, "wb");
+        if (!fp || fwrite(job->output, 1, job->output_length, fp) != job->output_length) {
+            snprintf(job->error, sizeof(job->error), "Error: Could not write output file");
+            job->failed = 1;
+        }
+        if (fp) {
+            fclose(fp);
+        }
+        free(job->output);
+        job->output = NULL;
+    }
+}
+
+static void *worker_loop(void *arg) {
+    struct worker *worker = arg;
+    for (;;) {
+        int index = atomic_fetch_add(&next_job, 1);
+        if (index >= job_count) {
+            break;
+        }
+        if (!output_directory) {
+            pthread_mutex_lock(&done_lock);
+            while (index >= reported_jobs + job_window) {
+                pthread_cond_wait(&done_signal, &done_lock);
+            }
+            pthread_mutex_unlock(&done_lock);
+        }
+        run_job(worker, &jobs[index]);
+
+        pthread_mutex_lock(&done_lock);
+        jobs[index].done = 1;
+        pthread_cond_broadcast(&done_signal);
+        pthread_mutex_unlock(&done_lock);
+    }
+    return NULL;
+}
+
+static int compare_jobs(const void *a, const void *b) {
+    return strcmp(((const struct job *)a)->name, ((const struct job *)b)->name);
+}
+
+// Collect the regular files of the input directory, sorted by name
+static int list_inputs(const char *input_dir) {
+    DIR *dir = opendir(input_dir);
+    if (!dir) {
+        return -1;
+    }
+    int capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char path[4096];
+        struct stat info;
+        snprintf(path, sizeof(path), "%s/%s", input_dir, entry->d_name);
+        if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+        if (job_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            struct job *grown = realloc(jobs, capacity * sizeof(struct job));
+            if (!grown) {
+                fprintf(stderr, "Error: Out of memory while listing inputs\n");
+                exit(1);
+            }
+            jobs = grown;
+        }
+        memset(&jobs[job_count], 0, sizeof(struct job));
+        jobs[job_count].name = strdup(entry->d_name);
+        jobs[job_count].path = strdup(path);
+        job_count++;
+    }
+    closedir(dir);
+    qsort(jobs, job_count, sizeof(struct job), compare_jobs);
+    return 0;
+}
+
+// Print the result of a finished job and free it
+static void report_job(struct job *job) {
+    if (!output_directory && !job->failed) {
+        printf("=== %s %s %zu\n", job->name, pfusch_status_name(job->status), job->output_length);
+        fwrite(job->output, 1, job->output_length, stdout);
+        printf("\n");
+    }
+    if (job->failed) {
+        fprintf(stderr, "%s: %s\n", job->name, job->error);
+    } else if (job->error[0]) {
+        fprintf(stderr, "%s: %s - %s\n", job->name, pfusch_status_name(job->status), job->error);
+    } else {
+        fprintf(stderr, "%s: %s\n", job->name, pfusch_status_name(job->status));
+    }
+    free(job->output);
+    free(job->name);
+    free(job->path);
+}
+
+int run_batch(const char *program, const char *input_dir, const char *output_dir, int jobs_wanted,
+              long max_steps, double time_limit, int loop_check, int stack_size) {
+    // Load and check the program once; the workers clone it
+    pfusch *program_instance = pfusch_create(NULL);
+    FILE *fp = fopen(program, "r");
+    if (!program_instance || !fp) {
+        perror("Error opening file");
+        return 1;
+    }
+    int loaded = pfusch_load(program_instance, fp);
+    fclose(fp);
+    if (loaded != 0 || pfusch_run(program_instance, 0) == PFUSCH_INVALID_START) {
+        fprintf(stderr, "%s\n", pfusch_error(program_instance));
+        pfusch_destroy(program_instance);
+        return 1;
+    }
+
+    if (list_inputs(input_dir) != 0) {
+        perror("Error opening input directory");
+        return 1;
+    }
+    output_directory = output_dir;
+    job_max_steps = max_steps > 0 ? max_steps : LONG_MAX;
+    if (jobs_wanted <= 0) {
+        jobs_wanted = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (jobs_wanted > job_count) {
+        jobs_wanted = job_count > 0 ? job_count : 1;
+    }
+
+    struct worker *workers = calloc(jobs_wanted, sizeof(struct worker));
+    if (!workers) {
+        fprintf(stderr, "Error: Out of memory while starting workers\n");
+        return 1;
+    }
+    atomic_store(&next_job, 0);
+    reported_jobs = 0;
+    job_window = jobs_wanted * BATCH_WINDOW_PER_WORKER;
+    for (int i = 0; i < jobs_wanted; i++) {
+        struct pfusch_io io = { read_job_input, write_job_output, &workers[i] };
+        workers[i].instance = pfusch_clone(program_instance, &io);
+        if (workers[i].instance) {
+            pfusch_set_limits(workers[i].instance, time_limit, loop_check);
+            pfusch_set_stack_size(workers[i].instance, stack_size);
+        }
+        if (!workers[i].instance || pthread_create(&workers[i].thread, NULL, worker_loop, &workers[i]) != 0) {
+            fprintf(stderr, "Error: Could not start batch worker\n");
+            exit(1);
+        }
+    }
+
+    // Report in input order while the workers run ahead
+    int failures = 0;
+    for (int i = 0; i < job_count; i++) {
+        pthread_mutex_lock(&done_lock);
+        while (!jobs[i].done) {
+            pthread_cond_wait(&done_signal, &done_lock);
+        }
+        pthread_mutex_unlock(&done_lock);
+        failures += jobs[i].failed;
+        report_job(&jobs[i]);
+
+        pthread_mutex_lock(&done_lock);
+        reported_jobs = i + 1;
+        pthread_cond_broadcast(&done_signal);
+        pthread_mutex_unlock(&done_lock);
+    }
+
+    for (int i = 0; i < jobs_wanted; i++) {
+        pthread_join(workers[i].thread, NULL);
+        pfusch_destroy(workers[i].instance);
+    }
+    free(workers);
+    free(jobs);
+    pfusch_destroy(program_instance);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Without output_dir, workers run at most this many jobs per worker ahead of
+// the one reported next, so finished outputs waiting for their turn stay
+// bounded
+#define BATCH_WINDOW_PER_WORKER 4
+
+// Run the program once per file in input_dir, with the file as its input.
+// Outputs go to output_dir/<name>.out, or without output_dir to stdout as
+// frames "=== <name> <status> <length>\n<output>\n" in file name order.
+// Every run has the limits of a headless run: max_steps (0 for none),
+// time_limit seconds (0 for none), the loop check and a stack of stack_size
+// entries. Returns the exit code for main.
+int run_batch(const char *program, const char *input_dir, const char *output_dir, int jobs,
+              long max_steps, double time_limit, int loop_check, int stack_size);
+
+#endif // BATCH_H
@@ -0,0 +1,149 @@
+#include "benchPrograms.h"
+#include "interpreter.h"
+#include <string.h>
+
+static const char* const kind_names[BENCH_KIND_COUNT] = { "count", "jump", "selfmod", "output" };
+static const int default_sizes[BENCH_KIND_COUNT] = { 1, 4, 8, 64 };
+static const int max_sizes[BENCH_KIND_COUNT] = { 30, 36, 62, 67 };
+
+// Program being generated; rows are printed without trailing spaces
+static char canvas[GRID_HEIGHT][GRID_WIDTH];
+
+static void put(int x, int y, char c) {
+    canvas[y][x] = c;
+}
+
+static void put_text(int x, int y, const char *text) {
+    memcpy(&canvas[y][x], text, strlen(text));
+}
+
+// Counter of 100 * 100 * 100 counted down by 33 per pass; x turns into the
+// loop while it is positive, otherwise it is dropped and pushed again
+static void draw_count(int pairs) {
+    int reduce = 5 + 2 * pairs;
+    int turn = reduce + 1;
+
+    put_text(0, 0, "lsppj");
+    put_text(1, 1, "ddd");
+    put(4, 2, 'l');
+    for (int i = 0; i < pairs; i++) {
+        put_text(5 + 2 * i, 2, "dD");
+    }
+    put_text(reduce, 2, "rxDj");
+    put(reduce, 3, '!');
+    put(4, 4, 'k');
+    put(turn, 4, 'h');
+    put(0, 5, 'k');
+    put(turn + 2, 5, 'h');
+}
+
+// A rectangle walked clockwise; every H/J/K/L jumps over gap cells to the
+// next '*', which matches the '*' kept on the stack
+static void draw_jump(int gap) {
+    int segment = gap + 2;
+    int across = (GRID_WIDTH - 1 - 3) / segment;
+    int down = (GRID_HEIGHT - 1 - 3) / segment;
+    int right = 3 + across * segment;
+    int bottom = 3 + down * segment;
+
+    put_text(0, 0, "lsj");
+    put(1, 1, '*');
+    put(2, 2, 'l');
+    put(right, 2, 'j');
+    put(right, bottom, 'h');
+    put(2, bottom, 'k');
+    for (int i = 0; i < across; i++) {
+        put(3 + i * segment, 2, 'L');
+        put(3 + i * segment + gap + 1, 2, '*');
+        put(right - 1 - i * segment, bottom, 'H');
+        put(right - 1 - i * segment - gap - 1, bottom, '*');
+    }
+    for (int i = 0; i < down; i++) {
+        put(right, 3 + i * segment, 'J');
+        put(right, 3 + i * segment + gap + 1, '*');
+        put(2, bottom - 1 - i * segment, 'K');
+        put(2, bottom - 1 - i * segment - gap - 1, '*');
+    }
+}
+
+// Each pass f writes the cell below it, which the IP executes next; S reads
+// it back and a, m, a turn '#' into '3' and '3' into '#' for the next pass
+static void draw_selfmod(int width) {
+    int back = 6 + width;
+
+    put_text(0, 0, "lsj");
+    put(1, 1, '#');
+    put(2, 1, 'j');
+    put(back, 1, 'h');
+    put(2, 2, 'f');
+    put(2, 3, '#');
+    put(2, 4, 'S');
+    put_text(2, 5, "lama");
+    put(back, 5, 'k');
+    put_text(3, 6, "- #");
+}
+
+// A row of o printing the text below it, walked round and round
+static void draw_output(int count) {
+    static const char text[] = "Pfusch benchmark ";
+
+    put(0, 0, 'j');
+    put(0, 2, 'l');
+    for (int i = 0; i < count; i++) {
+        put(1 + i, 2, 'o');
+        put(1 + i, 3, text[i % (sizeof(text) - 1)]);
+    }
+    put(count + 1, 2, 'j');
+    put(count + 1, 4, 'h');
+    put(0, 4, 'k');
+}
+
+int bench_kind_from_name(const char *name) {
+    for (int kind = 0; kind < BENCH_KIND_COUNT; kind++) {
+        if (strcmp(name, kind_names[kind]) == 0) {
+            return kind;
+        }
+    }
+    return -1;
+}
+
+const char *bench_kind_name(enum bench_kind kind) {
+    return kind_names[kind];
+}
+
+int bench_default_size(enum bench_kind kind) {
+    return default_sizes[kind];
+}
+
+int bench_max_size(enum bench_kind kind) {
+    return max_sizes[kind];
+}
+
+// Write a program of the given kind; returns -1 if size is out of range
+int write_bench_program(FILE *fp, enum bench_kind kind, int size) {
+    if (size < 0 || size > max_sizes[kind]) {
+        return -1;
+    }
+    memset(canvas, ' ', sizeof(canvas));
+    switch (kind) {
+        case BENCH_COUNT: draw_count(size); break;
+        case BENCH_JUMP: draw_jump(size); break;
+        case BENCH_SELFMOD: draw_selfmod(size); break;
+        case BENCH_OUTPUT: draw_output(size); break;
+        default: return -1;
+    }
+
+    int lengths[GRID_HEIGHT];
+    int rows = 0;
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        lengths[y] = GRID_WIDTH;
+        while (lengths[y] > 0 && canvas[y][lengths[y] - 1] == ' ') {
+            lengths[y]--;
+        }
+        rows = lengths[y] > 0 ? y + 1 : rows;
+    }
+    for (int y = 0; y < rows; y++) {
+        fprintf(fp, "%.*s\n", lengths[y], canvas[y]);
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef BENCHPROGRAMS_H
+#define BENCHPROGRAMS_H
+
+#include <stdio.h>
+
+// Synthetic benchmark programs (see pfuschgen and pfuschbench). All of
+// them loop forever, so a run with --max-steps n executes exactly n steps.
+enum bench_kind {
+    BENCH_COUNT,        // tight counting loop with r/x, body of size dD pairs
+    BENCH_JUMP,         // ring of H/J/K/L jumps over size empty cells each
+    BENCH_SELFMOD,      // f/S toggle a cell on the path, return path of size cells
+    BENCH_OUTPUT,       // row of size o cells printing the row below
+    BENCH_KIND_COUNT
+};
+
+// Function declarations
+int bench_kind_from_name(const char *name);
+const char *bench_kind_name(enum bench_kind kind);
+int bench_default_size(enum bench_kind kind);
+int bench_max_size(enum bench_kind kind);
+int write_bench_program(FILE *fp, enum bench_kind kind, int size);
+
+#endif // BENCHPROGRAMS_H
@@ -0,0 +1,256 @@
+#include "checkpoint.h"
+#include "loopDetector.h"
+#include "visualizer.h"
+#include "output.h"
+#include "input.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECKPOINT_MAGIC "PFCKPT01"
+#define PROGRAM_CELLS (GRID_WIDTH * GRID_HEIGHT)
+
+// Largest possible checkpoint with a stack of depth entries: header, the
+// stack, every cell changed and a full scrollback
+#define CHECKPOINT_MAX_SIZE(depth) \
+    (8 + 8 * 4 + 4 * 3 + 4 + 4 * (size_t)(depth) + 4 + 6 * PROGRAM_CELLS + 4 + OUTPUT_SCROLLBACK + 4)
+
+// The program as loaded, to store only the cells changed since
+static int original_cells[GRID_HEIGHT][GRID_WIDTH];
+static uint64_t original_hash;
+
+static unsigned char *buffer = NULL;
+static size_t buffer_size = 0;
+static size_t length;
+static size_t position;
+
+// Make the buffer hold size bytes; returns 0 or -1
+static int reserve_buffer(size_t size) {
+    if (size <= buffer_size) {
+        return 0;
+    }
+    unsigned char *bytes = realloc(buffer, size);
+    if (!bytes) {
+        return -1;
+    }
+    buffer = bytes;
+    buffer_size = size;
+    return 0;
+}
+
+static uint32_t checksum(const unsigned char *bytes, size_t count) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < count; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void put(uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        buffer[length++] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+// Next field of the checkpoint being loaded; reading past the end fails
+static int get(uint64_t *value, int bytes) {
+    if (position + bytes > length) {
+        return -1;
+    }
+    *value = 0;
+    for (int i = 0; i < bytes; i++) {
+        *value |= (uint64_t)buffer[position++] << (8 * i);
+    }
+    return 0;
+}
+
+static int get_int(int *value) {
+    uint64_t field;
+    if (get(&field, 4) != 0) {
+        return -1;
+    }
+    *value = (int32_t)(uint32_t)field;
+    return 0;
+}
+
+static int get_long(long *value) {
+    uint64_t field;
+    if (get(&field, 8) != 0) {
+        return -1;
+    }
+    *value = (long)(int64_t)field;
+    return 0;
+}
+
+// Remember the program as loaded; call after init_grid_hash
+void checkpoint_program_loaded(void) {
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        memcpy(original_cells[y], grid[y], sizeof(original_cells[y]));
+    }
+    original_hash = grid_hash;
+}
+
+// Write a checkpoint next to path and rename it into place, so an earlier
+// checkpoint survives a crash while writing. Returns 0 or -1.
+int save_checkpoint(const char *path, const struct state *state, long steps) {
+    if (reserve_buffer(CHECKPOINT_MAX_SIZE(state->stack.top + 1)) != 0) {
+        return -1;
+    }
+    length = 0;
+    memcpy(buffer, CHECKPOINT_MAGIC, 8);
+    length = 8;
+
+    char history[OUTPUT_SCROLLBACK];
+    long output_total;
+    int history_length = output_history(history, &output_total);
+
+    put(original_hash, 8);
+    put((uint64_t)steps, 8);
+    put((uint64_t)input_bytes_read, 8);
+    put((uint64_t)output_total, 8);
+    put((uint32_t)state->ip.x, 4);
+    put((uint32_t)state->ip.y, 4);
+    put((uint32_t)state->ip.direction, 4);
+    put((uint32_t)(state->stack.top + 1), 4);
+    for (int i = 0; i <= state->stack.top; i++) {
+        put((uint32_t)state->stack.data[i], 4);
+    }
+
+    size_t count_position = length;
+    int changed = 0;
+    put(0, 4);
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            if (grid[y][x] != original_cells[y][x]) {
+                put((uint16_t)(y * GRID_WIDTH + x), 2);
+                put((uint32_t)grid[y][x], 4);
+                changed++;
+            }
+        }
+    }
+    size_t end = length;
+    length = count_position;
+    put((uint32_t)changed, 4);
+    length = end;
+
+    put((uint32_t)history_length, 4);
+    memcpy(buffer + length, history, history_length);
+    length += history_length;
+    put(checksum(buffer, length), 4);
+
+    // Output up to here is on stdout before the checkpoint claims it
+    output_flush();
+
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE *fp = fopen(temporary, "wb");
+    if (!fp) {
+        return -1;
+    }
+    int failed = fwrite(buffer, 1, length, fp) != length;
+    failed |= fclose(fp) != 0;
+    if (failed || rename(temporary, path) != 0) {
+        remove(temporary);
+        return -1;
+    }
+    return 0;
+}
+
+// Skip the input the program had read
+static void skip_input(long offset) {
+    input_skip(offset);
+    input_bytes_read = offset;
+}
+
+static int parse_checkpoint(struct state *state, long *steps) {
+    uint64_t hash;
+    long input_offset, output_total;
+    int x, y, direction, depth, changed, history_length;
+
+    if (length < 12 || memcmp(buffer, CHECKPOINT_MAGIC, 8) != 0) {
+        return -1;
+    }
+    uint64_t stored_checksum;
+    position = length - 4;
+    get(&stored_checksum, 4);
+    length -= 4;
+    if (stored_checksum != checksum(buffer, length)) {
+        return -1;
+    }
+    position = 8;
+
+    if (get(&hash, 8) != 0 || get_long(steps) != 0 || get_long(&input_offset) != 0 ||
+        get_long(&output_total) != 0 || get_int(&x) != 0 || get_int(&y) != 0 ||
+        get_int(&direction) != 0 || get_int(&depth) != 0) {
+        return -1;
+    }
+    if (hash != original_hash) {
+        return -2;
+    }
+    if (*steps < 0 || input_offset < 0 || output_total < 0 || x < 0 || x >= GRID_WIDTH ||
+        y < 0 || y >= GRID_HEIGHT || direction < UP || direction > RIGHT || depth < 0 ||
+        (size_t)depth > (length - position) / 4) {
+        return -1;
+    }
+    if (stack_grow(&state->stack, depth) != 0) {
+        return -3;
+    }
+    state->ip.x = x;
+    state->ip.y = y;
+    state->ip.direction = (enum direction)direction;
+    state->stack.top = depth - 1;
+    for (int i = 0; i < depth; i++) {
+        if (get_int(&state->stack.data[i]) != 0) {
+            return -1;
+        }
+    }
+
+    if (get_int(&changed) != 0 || changed < 0 || changed > PROGRAM_CELLS) {
+        return -1;
+    }
+    for (int i = 0; i < changed; i++) {
+        uint64_t index;
+        int value;
+        if (get(&index, 2) != 0 || get_int(&value) != 0 || index >= PROGRAM_CELLS) {
+            return -1;
+        }
+        // Keeps the decoded image, jump index and grid hash in step
+        set_cell_value((int)(index % GRID_WIDTH), (int)(index / GRID_WIDTH), value);
+    }
+
+    if (get_int(&history_length) != 0 || history_length < 0 || history_length > OUTPUT_SCROLLBACK ||
+        history_length > output_total || position + history_length != length) {
+        return -1;
+    }
+    restore_output_history((const char *)buffer + position, history_length, output_total);
+    skip_input(input_offset);
+    return 0;
+}
+
+// Continue the loaded program from a checkpoint; returns 0, or -1 after
+// printing why it cannot be used
+int load_checkpoint(const char *path, struct state *state, long *steps) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror("Error opening checkpoint");
+        return -1;
+    }
+    // The stack depth is checked against the limit once it is parsed
+    long size = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+    length = 0;
+    if (size > 0 && fseek(fp, 0, SEEK_SET) == 0 && reserve_buffer((size_t)size) == 0) {
+        length = fread(buffer, 1, (size_t)size, fp);
+    }
+    fclose(fp);
+
+    int result = parse_checkpoint(state, steps);
+    if (result == -2) {
+        fprintf(stderr, "Error: Checkpoint %s was written for a different program\n", path);
+    } else if (result == -3) {
+        fprintf(stderr, "Error: Checkpoint %s holds a deeper stack than --stack-size allows\n", path);
+    } else if (result != 0) {
+        fprintf(stderr, "Error: %s is not a valid checkpoint\n", path);
+    }
+    return result == 0 ? 0 : -1;
+}
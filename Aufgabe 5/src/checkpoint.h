@@ -0,0 +1,21 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "interpreter.h"
+
+// Binary snapshot of a running program (--checkpoint-every, --resume).
+// Little-endian fields after the magic "PFCKPT01":
+//   u64 hash of the original program, i64 steps, i64 input bytes read,
+//   i64 output bytes written, i32 x, y, direction,
+//   i32 stack depth and the stack from the bottom,
+//   i32 changed cells and (u16 cell index, i32 value) for each,
+//   i32 length and the latest output bytes (the visualizer's scrollback),
+//   u32 FNV-1a checksum of everything before it.
+// Cells are stored only where they differ from the program as loaded.
+
+// Function declarations
+void checkpoint_program_loaded(void);
+int save_checkpoint(const char *path, const struct state *state, long steps);
+int load_checkpoint(const char *path, struct state *state, long *steps);
+
+#endif // CHECKPOINT_H
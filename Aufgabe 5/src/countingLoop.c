@@ -0,0 +1,264 @@
+#include "countingLoop.h"
+#include "profile.h"
+#include <limits.h>
+#include <stdlib.h>
+
+// Turn tables, indexed by enum direction
+static const enum direction right_of[4] = { RIGHT, LEFT, UP, DOWN };
+static const enum direction left_of[4] = { LEFT, RIGHT, DOWN, UP };
+
+// Stack entry during a symbolic pass: a constant, T + value with T the
+// stack top at the loop entry, or some other function of T. The last kind
+// is only allowed for temporaries that are dropped again.
+enum symbol_kind { SYMBOL_CONSTANT, SYMBOL_COUNTER, SYMBOL_UNKNOWN };
+
+struct symbol {
+    enum symbol_kind kind;
+    long long value;
+};
+
+// NULL when out of memory; the trace then runs without the fast-forward
+struct counting_loop *new_counting_loop(void) {
+    return calloc(1, sizeof(struct counting_loop));
+}
+
+// Ops a counting loop may contain: no grid writes, no I/O
+static int is_loop_op(int opcode) {
+    switch (opcode) {
+        case OP_STORE_BELOW: case OP_STORE_ABOVE: case OP_PUSH_CONSTANT:
+        case OP_DUPLICATE: case OP_DELETE:
+        case OP_ADD_BELOW: case OP_ADD_ABOVE: case OP_ADD_CONSTANT:
+        case OP_REDUCE_BELOW: case OP_REDUCE_ABOVE: case OP_REDUCE_CONSTANT:
+        case OP_MULTIPLY_BELOW: case OP_MULTIPLY_ABOVE: case OP_MULTIPLY_CONSTANT:
+        case OP_DIVIDE_BELOW: case OP_DIVIDE_ABOVE: case OP_DIVIDE_CONSTANT:
+        case OP_MODULO_BELOW: case OP_MODULO_ABOVE: case OP_MODULO_CONSTANT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int arrow_direction(int opcode, enum direction *dir) {
+    switch (opcode) {
+        case OP_LEFT: *dir = LEFT; return 1;
+        case OP_DOWN: *dir = DOWN; return 1;
+        case OP_UP: *dir = UP; return 1;
+        case OP_RIGHT: *dir = RIGHT; return 1;
+        default: return 0;
+    }
+}
+
+// Follow the traces from first through arrows back to the turn cell behind
+// its entry. Every trace walked is watched, so a write to any of them
+// (including the cells ending them) makes the record stale.
+static void analyse_loop(struct counting_loop *loop, struct trace *first) {
+    struct decoded_cell *turn_cell = first->entry - cell_offset[first->direction];
+    struct trace *trace = first;
+    int length = 0;
+
+    loop->analysed = 1;
+    loop->epoch = trace_cache->loop_epoch;
+    loop->trace_count = 0;
+    loop->backoff = 0;
+    loop->wait = 0;
+    for (int count = 0; count < MAX_LOOP_TRACES; count++) {
+        trace->watched = 1;
+        for (int i = 0; i < trace->op_count; i++) {
+            if (!is_loop_op(trace->ops[i].opcode)) {
+                return;
+            }
+        }
+        loop->traces[count] = trace;
+        length += trace->length + 1;    // the run and the cell ending it
+
+        struct decoded_cell *cell = trace->exit;
+        enum direction dir = trace->direction;
+        if (cell == turn_cell) {
+            if (cell->opcode != OP_TURN_RIGHT && cell->opcode != OP_TURN_LEFT) {
+                return;
+            }
+            enum direction turned = cell->opcode == OP_TURN_RIGHT ? right_of[dir] : left_of[dir];
+            if (dir != first->direction && turned != first->direction) {
+                return;     // neither way leads back into the loop
+            }
+            loop->turn = (enum opcode)cell->opcode;
+            loop->continue_turned = dir != first->direction;
+            loop->length = length;
+            loop->trace_count = count + 1;
+            return;
+        }
+        if (!arrow_direction(cell->opcode, &dir)) {
+            return;         // another decision, or the end of the program
+        }
+        cell += cell_offset[dir];
+        trace = *trace_slot(cell, dir);
+        if (!trace && !(trace = build_trace(cell, dir))) {
+            return;         // out of memory
+        }
+    }
+}
+
+// Constant arithmetic wraps like the engine's int arithmetic
+static long long wrap(long long value) {
+    return (int)(unsigned)value;
+}
+
+// Apply an arithmetic op with the given operand to a symbol; 0 if the op
+// may fail (a zero divisor is left to the engine, INT_MIN / -1 traps)
+static int apply_op(struct symbol *top, int opcode, long long operand) {
+    switch (opcode) {
+        case OP_ADD_BELOW: case OP_ADD_ABOVE: case OP_ADD_CONSTANT:
+            top->value = top->kind == SYMBOL_COUNTER ? top->value + operand : wrap(top->value + operand);
+            return 1;
+        case OP_REDUCE_BELOW: case OP_REDUCE_ABOVE: case OP_REDUCE_CONSTANT:
+            top->value = top->kind == SYMBOL_COUNTER ? top->value - operand : wrap(top->value - operand);
+            return 1;
+        case OP_MULTIPLY_BELOW: case OP_MULTIPLY_ABOVE: case OP_MULTIPLY_CONSTANT:
+            if (operand == 0) {
+                top->kind = SYMBOL_CONSTANT;
+                top->value = 0;
+            } else if (top->kind == SYMBOL_COUNTER && operand != 1) {
+                top->kind = SYMBOL_UNKNOWN;
+            } else if (top->kind == SYMBOL_CONSTANT) {
+                top->value = wrap((long long)((unsigned long long)top->value * (unsigned long long)operand));
+            }
+            return 1;
+        default:
+            if (operand == 0 || (operand == -1 && (top->kind != SYMBOL_CONSTANT || top->value == INT_MIN))) {
+                return 0;
+            }
+            if (top->kind != SYMBOL_CONSTANT) {
+                top->kind = SYMBOL_UNKNOWN;
+            } else if (opcode == OP_DIVIDE_BELOW || opcode == OP_DIVIDE_ABOVE || opcode == OP_DIVIDE_CONSTANT) {
+                top->value /= operand;
+            } else {
+                top->value %= operand;
+            }
+            return 1;
+    }
+}
+
+// Run one pass over symbols. Gives the change of the top in *change, the
+// range of all values T + k in *low and *high and the highest stack growth
+// in *rise; 0 if the pass is not a constant step of the top.
+static int symbolic_pass(const struct counting_loop *loop, long long *change,
+                         long long *low, long long *high, int *rise) {
+    static _Thread_local struct symbol stack[STACK_SIZE];
+    int depth = 1;
+    stack[0].kind = SYMBOL_COUNTER;
+    stack[0].value = 0;
+    *low = 0;
+    *high = 0;
+    *rise = 0;
+
+    for (int t = 0; t < loop->trace_count; t++) {
+        const struct trace *trace = loop->traces[t];
+        for (int i = 0; i < trace->op_count; i++) {
+            const struct trace_op *op = &trace->ops[i];
+            int opcode = op->opcode;
+            int row = operand_row((enum opcode)opcode);
+            long long operand = row != 0 ? op->cell->value[row * GRID_STRIDE] : op->immediate;
+
+            if (opcode == OP_STORE_BELOW || opcode == OP_STORE_ABOVE || opcode == OP_PUSH_CONSTANT ||
+                opcode == OP_DUPLICATE) {
+                if (depth == STACK_SIZE || (opcode == OP_DUPLICATE && depth == 0)) {
+                    return 0;
+                }
+                stack[depth].kind = opcode == OP_DUPLICATE ? stack[depth - 1].kind : SYMBOL_CONSTANT;
+                stack[depth].value = opcode == OP_DUPLICATE ? stack[depth - 1].value : operand;
+                depth++;
+                *rise = depth - 1 > *rise ? depth - 1 : *rise;
+            } else if (depth == 0) {
+                return 0;   // the pass would reach below the counter
+            } else if (opcode == OP_DELETE) {
+                depth--;
+            } else if (!apply_op(&stack[depth - 1], opcode, operand)) {
+                return 0;
+            }
+            if (depth > 0 && stack[depth - 1].kind == SYMBOL_COUNTER) {
+                long long value = stack[depth - 1].value;
+                *low = value < *low ? value : *low;
+                *high = value > *high ? value : *high;
+            }
+        }
+    }
+    if (depth != 1 || stack[0].kind != SYMBOL_COUNTER || stack[0].value == 0) {
+        return 0;
+    }
+    *change = stack[0].value;
+    return 1;
+}
+
+// Number of whole passes the engine would do from here with at most
+// budget steps, leaving it the last one; 0 if the loop does not apply now
+static long long count_passes(const struct counting_loop *loop, const struct stack *s, int budget,
+                              long long *change, int *rise) {
+    long long low;
+    long long high;
+    if (s->top < 0 || !symbolic_pass(loop, change, &low, &high, rise) || s->top + *rise >= s->capacity) {
+        return 0;
+    }
+
+    // The loop goes on while the value at the turn cell is >= bound, or
+    // <= bound for the negated values (sign -1)
+    int above = (loop->turn == OP_TURN_RIGHT) == loop->continue_turned;
+    long long bound = loop->turn == OP_TURN_RIGHT ? (loop->continue_turned ? 1 : 0)
+                                                  : (loop->continue_turned ? -1 : 0);
+    long long sign = above ? 1 : -1;
+    long long first = s->data[s->top];
+    long long next = sign * (first + *change) - sign * bound;
+    long long step = sign * *change;
+    if (next < 0) {
+        return 0;
+    }
+    long long passes = step < 0 ? next / -step + 1 : LLONG_MAX;
+    if (passes > budget / loop->length - 1) {
+        passes = budget / loop->length - 1;     // the engine does the rest up to the limit
+    }
+
+    // Every value of the form T + k must stay an int, or the engine would wrap
+    if (first + low < INT_MIN || first + high > INT_MAX) {
+        return 0;
+    }
+    long long room = *change > 0 ? (INT_MAX - high - first) / *change : (first + low - INT_MIN) / -*change;
+    return passes < room + 1 ? passes : room + 1;
+}
+
+// Called when the engine enters a trace carrying a counting loop record,
+// with at most budget steps left: does as many whole passes of the loop as
+// it would do itself, ending at the same entry with the same stack top, and
+// returns the steps taken (0 if the loop does not apply right now). The
+// last pass and the exit are left to the engine.
+int fast_forward_loop(struct trace *trace, struct stack *s, int budget) {
+    struct counting_loop *loop = trace->loop;
+    if (!loop->analysed || loop->epoch != trace_cache->loop_epoch) {
+        analyse_loop(loop, trace);
+    }
+    if (loop->trace_count == 0 || budget < (MIN_LOOP_PASSES + 1) * loop->length) {
+        return 0;
+    }
+    // A loop that did not pay off is tried again after a growing number of entries
+    if (loop->wait > 0) {
+        loop->wait--;
+        return 0;
+    }
+    long long change;
+    int rise;
+    long long passes = count_passes(loop, s, budget, &change, &rise);
+    if (passes < MIN_LOOP_PASSES) {
+        loop->backoff = loop->backoff > 0 ? (loop->backoff < MAX_LOOP_BACKOFF ? loop->backoff * 2 : MAX_LOOP_BACKOFF) : 1;
+        loop->wait = loop->backoff;
+        return 0;
+    }
+    loop->backoff = 0;
+
+    s->data[s->top] = (int)(s->data[s->top] + passes * change);
+    if (active_profile) {
+        for (int t = 0; t < loop->trace_count; t++) {
+            loop->traces[t]->runs += passes;
+            active_profile->hits[loop->traces[t]->exit - program_cells] += passes;
+        }
+        profile_stack(active_profile, s->top + rise);
+    }
+    return (int)(passes * loop->length);
+}
@@ -0,0 +1,36 @@
+#ifndef COUNTINGLOOP_H
+#define COUNTINGLOOP_H
+
+#include "trace.h"
+
+// Longest cycle of traces recognised as a counting loop
+#define MAX_LOOP_TRACES 32
+// Fewest passes worth skipping, and the most entries to wait after a loop
+// could not be skipped
+#define MIN_LOOP_PASSES 8
+#define MAX_LOOP_BACKOFF 64
+
+// Counting loop: a cycle of traces from the cell after an x or X back to
+// that x or X, which then turns into the first trace again. If the ops only
+// add a constant to the stack top (and push and drop temporaries above it)
+// and the turn cell is the only decision on the way, the number of passes
+// follows from the top and the constant, and fast_forward_loop does them
+// all at once. Every trace entered from an x or X carries such a record;
+// it is analysed again after one of the traces it walked died.
+struct counting_loop {
+    int analysed;
+    unsigned long epoch;            // trace_cache->loop_epoch of the analysis
+    int trace_count;                // 0 if the cycle is no counting loop
+    int length;                     // steps of one pass
+    enum opcode turn;               // OP_TURN_RIGHT or OP_TURN_LEFT
+    int continue_turned;            // the loop goes on when the turn cell turns
+    int backoff;                    // entries to wait after the next failed try
+    int wait;                       // entries left before the next try
+    struct trace *traces[MAX_LOOP_TRACES];
+};
+
+// Function declarations
+struct counting_loop *new_counting_loop(void);
+int fast_forward_loop(struct trace *trace, struct stack *s, int budget);
+
+#endif // COUNTINGLOOP_H
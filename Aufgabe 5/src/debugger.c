@@ -0,0 +1,150 @@
+#include "debugger.h"
+#include "history.h"
+#include "visualizer.h"
+#include "output.h"
+#include "terminal.h"
+#include "input.h"
+#include <stdio.h>
+
+// Delay between two steps while running, as in visual mode
+#define RUN_DELAY_MS 100
+
+static struct run_context context;
+
+// Program input: bytes given back by stepping backward first, then stdin
+static int debug_read(void *user) {
+    (void)user;
+    int value;
+    if (!history_replay_input(&value)) {
+        value = input_byte();
+    }
+    if (value != EOF) {
+        history_note_input(value);
+    }
+    return value;
+}
+
+// Program output only goes to the output panel
+static void debug_write(void *user, const char *bytes, int count) {
+    (void)user;
+    output_block(bytes, count);
+}
+
+// One step; returns 0, or the status + 1 when the step stopped the program.
+// A stopping step is recorded too, as it may have changed the state.
+static int debug_step(struct state *state) {
+    int stopped = setjmp(context.stop);
+    if (stopped == 0) {
+        history_before_step(state);
+        execute_step(state);
+    }
+    history_after_step(state);
+    return stopped;
+}
+
+int run_debugger(struct state *state, long first_step, long max_steps, size_t history_bytes) {
+    if (history_init(history_bytes) != 0) {
+        fprintf(stderr, "Error: Could not allocate %zu bytes of history\n", history_bytes);
+        return 1;
+    }
+    if (open_terminal() != 0) {
+        fprintf(stderr, "Error: The debugger needs a terminal\n");
+        return 1;
+    }
+    static const struct pfusch_io io = { debug_read, debug_write, NULL };
+    context.io = &io;
+    run_context = &context;
+
+    long steps = first_step;
+    int stopped = 0;            // status + 1 of the step that stopped the program
+    int running = 0;
+    long target = -1;           // step to go to
+    struct number_entry number = { "", -1 };
+    char notice[128] = "";
+
+    for (;;) {
+        char mode[sizeof(context.message)];
+        if (number.length >= 0) {
+            snprintf(mode, sizeof(mode), "go to step: %.*s_", number.length, number.digits);
+        } else if (stopped) {
+            snprintf(mode, sizeof(mode), "%s", stopped == PFUSCH_ENDED + 1 ? "Program ended normally." : context.message);
+        } else if (notice[0]) {
+            snprintf(mode, sizeof(mode), "%s", notice);
+        } else {
+            snprintf(mode, sizeof(mode), "%s", running ? "running" : "paused");
+        }
+        char status[512];
+        snprintf(status, sizeof(status), "Step %ld (%ld back) | %s | space run/pause, n/Right step, "
+                 "b/Left back, g<step>Enter go to, q quit", steps, history_length(), mode);
+        set_status_line(status);
+        print_visual_grid(state);
+
+        int keys[16];
+        int count = read_keys(keys, sizeof(keys) / sizeof(keys[0]), running ? RUN_DELAY_MS : -1);
+        int forward = running;
+        int backward = 0;
+        for (int i = 0; i < count; i++) {
+            int key = keys[i];
+            if (number.length >= 0) {
+                number_entry_key(&number, key, &target);
+                continue;
+            }
+            notice[0] = '\0';
+            switch (key) {
+                case ' ': running = !running; forward = 0; break;
+                case 'n': case KEY_RIGHT: running = 0; forward = 1; break;
+                case 'b': case KEY_LEFT: running = 0; forward = 0; backward = 1; break;
+                case 'g': running = 0; forward = 0; number.length = 0; break;
+                case 'q':
+                    restore_terminal();
+                    if (stopped == PFUSCH_ENDED + 1) {
+                        printf("\nProgram ended normally.\n");
+                    } else if (stopped) {
+                        output_flush();
+                        fprintf(stderr, "%s\n", context.message);
+                    } else {
+                        printf("\nDebugger quit at step %ld.\n", steps);
+                    }
+                    run_context = NULL;
+                    return stopped && stopped != PFUSCH_ENDED + 1 ? 1 : 0;
+            }
+        }
+
+        if (target >= 0) {
+            running = 0;
+            while (steps > target && history_undo(state)) {
+                steps--;
+                stopped = 0;
+            }
+            forward = 0;
+            while (steps < target && !stopped && (max_steps == 0 || steps < max_steps)) {
+                stopped = debug_step(state);
+                steps++;
+            }
+            if (steps > target) {
+                snprintf(notice, sizeof(notice), "history only goes back to step %ld", steps);
+            }
+            target = -1;
+        }
+        if (backward) {
+            if (history_undo(state)) {
+                steps--;
+                stopped = 0;
+            } else {
+                snprintf(notice, sizeof(notice), "no earlier step in the history");
+            }
+        }
+        if (forward && !stopped) {
+            if (max_steps > 0 && steps >= max_steps) {
+                snprintf(notice, sizeof(notice), "step limit of %ld reached (--max-steps)", max_steps);
+                running = 0;
+            } else {
+                stopped = debug_step(state);
+                steps++;
+            }
+        }
+        if (stopped) {
+            running = 0;
+        }
+    }
+}
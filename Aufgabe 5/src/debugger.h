@@ -0,0 +1,13 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "interpreter.h"
+#include <stddef.h>
+
+// Step the program forward and backward in the visualizer (--debug), with
+// the keys read from the terminal while the program reads stdin. Every step
+// is recorded in the undo log (see history.h) of history_bytes; max_steps
+// of 0 means no step limit. Returns the exit code for main.
+int run_debugger(struct state *state, long first_step, long max_steps, size_t history_bytes);
+
+#endif // DEBUGGER_H
@@ -0,0 +1,97 @@
+#include "decoder.h"
+#include "trace.h"
+
+// Decoded program image of the command line tools
+static struct decoded_cell default_program_cells[GRID_CELLS];
+_Thread_local struct decoded_cell *program_cells = default_program_cells;
+
+const int cell_offset[4] = { -GRID_STRIDE, GRID_STRIDE, -1, 1 };
+
+// Dense opcode table for all 7-bit ASCII characters
+static unsigned char opcode_table[128];
+
+// Build the opcode table from the instructions registered in the hash table
+void init_decode_table(void) {
+    for (int ch = 0; ch < 128; ch++) {
+        opcode_table[ch] = (unsigned char)get_instruction_opcode((char)ch);
+    }
+}
+
+// Row offset of the cell an instruction reads or writes, 0 if it has none
+int operand_row(enum opcode opcode) {
+    switch (opcode) {
+        case OP_STORE_BELOW: case OP_ADD_BELOW: case OP_REDUCE_BELOW:
+        case OP_MULTIPLY_BELOW: case OP_DIVIDE_BELOW: case OP_MODULO_BELOW:
+        case OP_FETCH_BELOW: case OP_OUTPUT_BELOW: case OP_INPUT_BELOW:
+            return 1;
+        case OP_STORE_ABOVE: case OP_ADD_ABOVE: case OP_REDUCE_ABOVE:
+        case OP_MULTIPLY_ABOVE: case OP_DIVIDE_ABOVE: case OP_MODULO_ABOVE:
+        case OP_FETCH_ABOVE: case OP_OUTPUT_ABOVE: case OP_INPUT_ABOVE:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+// Opcode of value in row y. Instructions whose operand lies on the border
+// become OP_EDGE and are left to the reference handler, which reports the
+// access.
+enum opcode cell_opcode(int y, int value) {
+    unsigned char ch = (unsigned char)value;
+    enum opcode opcode = ch < 128 ? (enum opcode)opcode_table[ch] : OP_INVALID;
+    int row = y + operand_row(opcode);
+    if (row < 0 || row >= GRID_HEIGHT) {
+        opcode = OP_EDGE;
+    }
+    return opcode;
+}
+
+// Re-decode the opcode of a single cell (called after every grid write)
+void decode_cell(int x, int y) {
+    program_image[y][x].opcode = (unsigned char)cell_opcode(y, grid[y][x]);
+}
+
+// Positions and value pointers of all cells; the border traps
+static void lay_out_program(void) {
+    for (int i = 0; i < GRID_CELLS; i++) {
+        struct decoded_cell *cell = &program_cells[i];
+        cell->x = (short)(i % GRID_STRIDE - 1);
+        cell->y = (short)(i / GRID_STRIDE - 1);
+        cell->value = &grid_cells[i];
+        cell->fixed = 0;
+        cell->opcode = OP_TRAP;
+    }
+}
+
+// Decode the whole grid, including the border
+void decode_program(void) {
+    lay_out_program();
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            decode_cell(x, y);
+        }
+    }
+}
+
+// Take the opcodes and fixed flags a previous run decoded for the grid
+// (see programCache.c) instead of decoding it
+void restore_program(const unsigned char opcodes[GRID_HEIGHT][GRID_WIDTH],
+                     const unsigned char fixed[GRID_HEIGHT][GRID_WIDTH]) {
+    lay_out_program();
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            program_image[y][x].opcode = opcodes[y][x];
+            program_image[y][x].fixed = fixed[y][x];
+        }
+    }
+}
+
+// A cell the analysis took for constant is written after all: forget all
+// fixed cells and drop the traces that used their values as immediates.
+// The write may come from the running trace, so they are not freed yet.
+void release_fixed_cells(void) {
+    for (int i = 0; i < GRID_CELLS; i++) {
+        program_cells[i].fixed = 0;
+    }
+    kill_traces();
+}
@@ -0,0 +1,36 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include "interpreter.h"
+#include "hashTable.h"
+
+// Pre-decoded grid cell, built once at load time and refreshed on writes.
+// Border cells decode to OP_TRAP, so moving off the grid needs no check.
+struct decoded_cell {
+    unsigned char opcode;               // enum opcode
+    unsigned char fixed;                // the value never changes (see analysis.h)
+    short x;
+    short y;
+    int *value;                         // cell in grid_cells, operands at +-GRID_STRIDE
+};
+
+// Decoded image of the running program, laid out like grid_cells; like
+// grid, program_image[y][x] is for cells on the board, border cells are
+// program_cells[GRID_INDEX(x, y)]
+extern _Thread_local struct decoded_cell *program_cells;
+#define program_image ((struct decoded_cell (*)[GRID_STRIDE])(program_cells + GRID_STRIDE + 1))
+
+// Offset to the next cell in each direction, indexed by enum direction
+extern const int cell_offset[4];
+
+// Function declarations
+void init_decode_table(void);
+void decode_program(void);
+enum opcode cell_opcode(int y, int value);
+void restore_program(const unsigned char opcodes[GRID_HEIGHT][GRID_WIDTH],
+                     const unsigned char fixed[GRID_HEIGHT][GRID_WIDTH]);
+void decode_cell(int x, int y);
+int operand_row(enum opcode opcode);
+void release_fixed_cells(void);
+
+#endif // DECODER_H
@@ -0,0 +1,584 @@
+#include "engine.h"
+#include "hashTable.h"
+#include "decoder.h"
+#include "trace.h"
+#include "jit.h"
+#include "profile.h"
+#include "countingLoop.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Use computed goto where the compiler supports it, a plain switch otherwise.
+// Build with -DPFUSCH_NO_COMPUTED_GOTO to force the portable version.
+#if defined(__GNUC__) && !defined(PFUSCH_NO_COMPUTED_GOTO)
+#define USE_COMPUTED_GOTO 1
+#else
+#define USE_COMPUTED_GOTO 0
+#endif
+
+// Turn tables, indexed by enum direction
+static const enum direction right_of[4] = { RIGHT, LEFT, UP, DOWN };
+static const enum direction left_of[4] = { LEFT, RIGHT, DOWN, UP };
+static const char* const direction_names[4] = { "UP", "DOWN", "LEFT", "RIGHT" };
+
+static void report_invalid_instruction(int x, int y) {
+    unsigned char ch = (unsigned char)grid[y][x];
+    if (ch > 127) {
+        report_error("Error: Invalid instruction at (%d, %d): ASCII %d (must be 7-bit ASCII)\n", x, y, ch);
+    } else {
+        report_error("Error: Invalid instruction at (%d, %d): ASCII %d (control character)\n", x, y, ch);
+    }
+    stop_execution(PFUSCH_INVALID_INSTRUCTION);
+}
+
+static void report_jump_target_not_found(void) {
+    report_error("Error: Jump target not found\n");
+    stop_execution(PFUSCH_JUMP_TARGET_NOT_FOUND);
+}
+
+static void report_division_by_zero(void) {
+    report_error("Error: Division by zero\n");
+    stop_execution(PFUSCH_DIVISION_BY_ZERO);
+}
+
+static void report_invalid_output(int value) {
+    report_error("Error: Invalid ASCII value for output: %d (must be 0-127)\n", value);
+    stop_execution(PFUSCH_INVALID_OUTPUT);
+}
+
+// Run up to max_steps steps without leaving this function. Straight runs
+// are executed as one cached trace (see trace.c); only the cells that may
+// change the direction go through the per-cell dispatch. A run that would
+// pass max_steps is cut short after the ops of its first cells, so chunked
+// runs (loop checks every LOOP_CHECK_INTERVAL steps) stay on the traces.
+// The error paths fall back to the shared helpers in interpreter.c so messages match the
+// reference engine.
+int run_program(struct state *state, int max_steps) {
+    struct stack *s = &state->stack;
+    struct decoded_cell *pc = &program_cells[GRID_INDEX(state->ip.x, state->ip.y)];
+    enum direction dir = state->ip.direction;
+    struct trace *trace;
+    struct trace_op *op = NULL;
+    struct trace_op *end;
+    struct decoded_cell *c = pc;    // cell being executed, for error stops
+    int result;
+    int steps = 0;
+    int value;
+    int cell;
+    int partial = 0;                // steps of a run cut short at max_steps
+    struct profile *profile = active_profile;
+    int entry_top = 0;
+
+// An error stops the run at cell at, done steps after the last counted
+// one; the state is left there, as in the reference engine, for the last
+// visual frame, and pfusch_steps gets the steps completed before it
+#define STOP_AT(at, done) do { \
+        state->ip.x = (at)->x; \
+        state->ip.y = (at)->y; \
+        state->ip.direction = dir; \
+        if (run_context) run_context->steps = steps + (done); \
+    } while (0)
+
+// Tell the profiler which op of the running trace failed
+#define PROFILE_FAULT(at) do { \
+        if (profile) profile->running_op = (at); \
+    } while (0)
+
+// Make room for depth entries; the run is recorded as stopped at cell at
+// first (see STOP_AT), as running out of memory stops it
+#define GROW(at, done, depth) ( \
+        state->ip.x = (at)->x, state->ip.y = (at)->y, state->ip.direction = dir, \
+        run_context ? (void)(run_context->steps = steps + (done)) : (void)0, \
+        stack_grow(s, (depth)))
+
+// Stack access; the slow paths print the reference error message
+#define PEEK(v) do { \
+        if (s->top < 0) { PROFILE_FAULT(op); STOP_AT(c, op->offset); stack_peek(s, &(v)); stop_execution(PFUSCH_STACK_UNDERFLOW); } \
+        (v) = s->data[s->top]; \
+    } while (0)
+#define POP(v) do { \
+        if (s->top < 0) { PROFILE_FAULT(op); STOP_AT(c, op->offset); stack_pop(s, &(v)); stop_execution(PFUSCH_STACK_UNDERFLOW); } \
+        (v) = s->data[s->top--]; \
+    } while (0)
+#define PUSH(v) do { \
+        if (s->top >= s->capacity - 1 && GROW(c, op->offset, s->top + 2) != 0) { \
+            PROFILE_FAULT(op); STOP_AT(c, op->offset); stack_push(s, (v)); stop_execution(PFUSCH_STACK_OVERFLOW); \
+        } \
+        s->data[++s->top] = (v); \
+    } while (0)
+
+// Neighbour cells; ops reading the border never reach a trace (OP_EDGE)
+#define BELOW(c) ((c)->value[GRID_STRIDE])
+#define ABOVE(c) ((c)->value[-GRID_STRIDE])
+
+// Byte written by an o, O or constant output op
+#define OUTPUT_VALUE(o) ((o)->opcode == OP_OUTPUT_CONSTANT ? (o)->immediate : \
+                         (o)->opcode == OP_OUTPUT_BELOW ? BELOW((o)->cell) : ABOVE((o)->cell))
+
+#if USE_COMPUTED_GOTO
+    static void* const labels[OP_COUNT] = {
+        [OP_NOP] = &&TARGET_OP_NOP,
+        [OP_LEFT] = &&TARGET_OP_LEFT,
+        [OP_DOWN] = &&TARGET_OP_DOWN,
+        [OP_UP] = &&TARGET_OP_UP,
+        [OP_RIGHT] = &&TARGET_OP_RIGHT,
+        [OP_JUMP_LEFT] = &&TARGET_OP_JUMP_LEFT,
+        [OP_JUMP_DOWN] = &&TARGET_OP_JUMP_DOWN,
+        [OP_JUMP_UP] = &&TARGET_OP_JUMP_UP,
+        [OP_JUMP_RIGHT] = &&TARGET_OP_JUMP_RIGHT,
+        [OP_TURN_RIGHT] = &&TARGET_OP_TURN_RIGHT,
+        [OP_TURN_LEFT] = &&TARGET_OP_TURN_LEFT,
+        [OP_END] = &&TARGET_OP_END,
+        [OP_STORE_BELOW] = &&TARGET_EFFECT,
+        [OP_STORE_ABOVE] = &&TARGET_EFFECT,
+        [OP_DUPLICATE] = &&TARGET_EFFECT,
+        [OP_DELETE] = &&TARGET_EFFECT,
+        [OP_ADD_BELOW] = &&TARGET_EFFECT,
+        [OP_ADD_ABOVE] = &&TARGET_EFFECT,
+        [OP_REDUCE_BELOW] = &&TARGET_EFFECT,
+        [OP_REDUCE_ABOVE] = &&TARGET_EFFECT,
+        [OP_MULTIPLY_BELOW] = &&TARGET_EFFECT,
+        [OP_MULTIPLY_ABOVE] = &&TARGET_EFFECT,
+        [OP_DIVIDE_BELOW] = &&TARGET_EFFECT,
+        [OP_DIVIDE_ABOVE] = &&TARGET_EFFECT,
+        [OP_MODULO_BELOW] = &&TARGET_EFFECT,
+        [OP_MODULO_ABOVE] = &&TARGET_EFFECT,
+        [OP_FETCH_BELOW] = &&TARGET_EFFECT,
+        [OP_FETCH_ABOVE] = &&TARGET_EFFECT,
+        [OP_OUTPUT_BELOW] = &&TARGET_EFFECT,
+        [OP_OUTPUT_ABOVE] = &&TARGET_EFFECT,
+        [OP_INPUT_BELOW] = &&TARGET_EFFECT,
+        [OP_INPUT_ABOVE] = &&TARGET_EFFECT,
+        [OP_INVALID] = &&TARGET_OP_INVALID,
+        [OP_EDGE] = &&TARGET_EFFECT,
+        [OP_TRAP] = &&TARGET_OP_TRAP,
+    };
+#define TARGET(op) TARGET_##op:
+#define DISPATCH() goto *labels[pc->opcode]
+#else
+#define TARGET(op) case op:
+#define DISPATCH() goto dispatch
+#endif
+
+// Move the instruction pointer in the current direction, count the finished
+// step and look up the trace starting at the new cell. Leaving the grid
+// lands on a border cell, which traps when it is dispatched.
+#define ADVANCE() do { \
+        pc += cell_offset[dir]; \
+        steps++; \
+        goto enter; \
+    } while (0)
+
+#define JUMP(d) do { \
+        struct instructionPointer target = { pc->x, pc->y, dir }; \
+        if (s->top < 0) { STOP_AT(pc, 0); stack_peek(s, &value); stop_execution(PFUSCH_STACK_UNDERFLOW); } \
+        value = s->data[s->top]; \
+        if (jump_in_direction(&target, (d), value) != 0) { \
+            STOP_AT(pc, 0); \
+            report_jump_target_not_found(); \
+        } \
+        if (profile) profile_jump(profile, target.x - pc->x + target.y - pc->y); \
+        pc = &program_image[target.y][target.x]; \
+        dir = (d); \
+        steps++; \
+        goto enter; \
+    } while (0)
+
+#define ARITHMETIC(operand, op) do { \
+        PEEK(value); \
+        s->data[s->top] = value op (operand); \
+    } while (0)
+
+#define DIVIDE(operand, operation) do { \
+        PEEK(value); \
+        cell = (operand); \
+        if (cell == 0) { \
+            PROFILE_FAULT(op); \
+            STOP_AT(c, op->offset); \
+            report_division_by_zero(); \
+        } \
+        s->data[s->top] = value operation cell; \
+    } while (0)
+
+// Writes a cell from inside a trace; the profiler is told where in case
+// the write ends the running pass
+#define WRITE_CELL(c, dy) do { \
+        PROFILE_FAULT(op); \
+        set_cell_value((c)->x, (c)->y + (dy), value); \
+    } while (0)
+
+// Reads a byte and writes it to a cell, then leaves the trace if the write
+// invalidated it
+#define INPUT(c, dy) do { \
+        value = read_input(); \
+        if (value == EOF) value = 0; \
+        WRITE_CELL(c, dy); \
+        if (!trace->valid) goto side_exit; \
+    } while (0)
+
+#define FETCH(c, dy) do { \
+        POP(value); \
+        WRITE_CELL(c, dy); \
+        if (!trace->valid) goto side_exit; \
+    } while (0)
+
+// A run of outputs becomes a single buffered write; a run cut short at the
+// step limit ends early, and the failing output is reported after the ones
+// before it
+#define OUTPUT_RUN() do { \
+        char buffer[256]; \
+        int run = op->run < end - op ? op->run : (int)(end - op); \
+        int count = 0; \
+        for (; count < run; count++) { \
+            cell = OUTPUT_VALUE(&op[count]); \
+            if (cell < 0 || cell > 127) break; \
+            buffer[count] = (char)cell; \
+        } \
+        write_output(buffer, count); \
+        if (count < run) { \
+            c = op[count].cell; \
+            cell = OUTPUT_VALUE(&op[count]); \
+            PROFILE_FAULT(op + count); \
+            STOP_AT(c, op[count].offset); \
+            report_invalid_output(cell); \
+        } \
+        op += run - 1; \
+    } while (0)
+
+// Ops of a run whose stack needs were checked at entry. top and tos live in
+// registers; tos mirrors data[top] (data[0] while the stack is empty) and
+// every change is written through, so s->top is all that must be stored
+// before an op that can leave the trace.
+#define TOP_CHANGED() (tos = s->data[top > 0 ? top : 0])
+#define SET_TOS(v) (s->data[top] = tos = (v))
+
+enter:
+    if (steps >= max_steps) goto done;
+    trace = *trace_slot(pc, dir);
+    if (!trace && !(trace = build_trace(pc, dir))) {
+        // Out of memory: the cell runs on its own
+        if (profile) profile->hits[pc - program_cells]++;
+        DISPATCH();
+    }
+    if (trace->loop) {
+        // Whole passes of a counting loop at once
+        steps += fast_forward_loop(trace, s, max_steps - steps);
+    }
+    if (trace->length >= max_steps - steps) {
+        if (profile) {
+            profile->hits[pc - program_cells]++;
+            DISPATCH();  // near the step limit, go cell by cell
+        }
+        // Near the step limit: the ops of the first cells of the run, and
+        // the next chunk goes on from the cell after them
+        partial = max_steps - steps;
+        op = trace->ops;
+        end = op;
+        while (end < trace->ops + trace->op_count && end->offset < partial) {
+            end++;
+        }
+        goto interpret;
+    }
+    if (!trace->native && jit_enabled && trace->hits < JIT_HOT_THRESHOLD &&
+        ++trace->hits == JIT_HOT_THRESHOLD) {
+        jit_compile_trace(trace);
+    }
+
+    // Superinstruction: all effects of the run, then one IP jump
+    if (profile) {
+        // The pass is counted when it ends, or by the profiler if it fails
+        entry_top = s->top;
+        profile->running = trace;
+        profile->running_top = entry_top;
+    }
+    op = trace->ops;
+    end = op + trace->op_count;
+    if (trace->native) goto run_native;
+    if (s->top + 1 >= trace->min_depth &&
+        (s->top + trace->max_rise < s->capacity || GROW(pc, 0, s->top + 1 + trace->max_rise) == 0)) goto unchecked;
+interpret:
+    for (; op < end; op++) {
+        c = op->cell;
+        switch ((enum opcode)op->opcode) {
+            case OP_STORE_BELOW:
+                cell = BELOW(c);
+                PUSH(cell);
+                break;
+            case OP_STORE_ABOVE:
+                cell = ABOVE(c);
+                PUSH(cell);
+                break;
+            case OP_DUPLICATE:
+                PEEK(value);
+                PUSH(value);
+                break;
+            case OP_DELETE:
+                POP(value);
+                break;
+            case OP_ADD_BELOW: ARITHMETIC(BELOW(c), +); break;
+            case OP_ADD_ABOVE: ARITHMETIC(ABOVE(c), +); break;
+            case OP_REDUCE_BELOW: ARITHMETIC(BELOW(c), -); break;
+            case OP_REDUCE_ABOVE: ARITHMETIC(ABOVE(c), -); break;
+            case OP_MULTIPLY_BELOW: ARITHMETIC(BELOW(c), *); break;
+            case OP_MULTIPLY_ABOVE: ARITHMETIC(ABOVE(c), *); break;
+            case OP_DIVIDE_BELOW: DIVIDE(BELOW(c), /); break;
+            case OP_DIVIDE_ABOVE: DIVIDE(ABOVE(c), /); break;
+            case OP_MODULO_BELOW: DIVIDE(BELOW(c), %); break;
+            case OP_MODULO_ABOVE: DIVIDE(ABOVE(c), %); break;
+            case OP_PUSH_CONSTANT: PUSH(op->immediate); break;
+            case OP_ADD_CONSTANT: ARITHMETIC(op->immediate, +); break;
+            case OP_REDUCE_CONSTANT: ARITHMETIC(op->immediate, -); break;
+            case OP_MULTIPLY_CONSTANT: ARITHMETIC(op->immediate, *); break;
+            case OP_DIVIDE_CONSTANT: ARITHMETIC(op->immediate, /); break;
+            case OP_MODULO_CONSTANT: ARITHMETIC(op->immediate, %); break;
+            case OP_FETCH_BELOW: FETCH(c, 1); break;
+            case OP_FETCH_ABOVE: FETCH(c, -1); break;
+            case OP_INPUT_BELOW: INPUT(c, 1); break;
+            case OP_INPUT_ABOVE: INPUT(c, -1); break;
+            case OP_OUTPUT_BELOW:
+            case OP_OUTPUT_ABOVE:
+            case OP_OUTPUT_CONSTANT:
+                OUTPUT_RUN();
+                break;
+            default:
+                break;
+        }
+        if (trace->native && !partial) {
+            // The native code sent this op to the interpreter; resume it
+            op++;
+            goto run_native;
+        }
+    }
+    if (partial) {
+        steps += partial;
+        pc += partial * cell_offset[dir];
+        partial = 0;
+        goto done;
+    }
+finish:
+    steps += trace->length;
+    pc = trace->exit;
+    if (profile) {
+        profile_trace_run(profile, trace, entry_top);
+        profile->running = NULL;
+    }
+    if (steps >= max_steps) goto done;
+    if (profile) profile->hits[pc - program_cells]++;
+    DISPATCH();  // the cell ending the run
+
+unchecked: {
+        int top = s->top;
+        int tos;
+        TOP_CHANGED();
+        for (; op < end; op++) {
+            c = op->cell;
+            switch ((enum opcode)op->opcode) {
+                case OP_STORE_BELOW: top++; SET_TOS(BELOW(c)); break;
+                case OP_STORE_ABOVE: top++; SET_TOS(ABOVE(c)); break;
+                case OP_PUSH_CONSTANT: top++; SET_TOS(op->immediate); break;
+                case OP_DUPLICATE: top++; SET_TOS(tos); break;
+                case OP_DELETE: top--; TOP_CHANGED(); break;
+                case OP_ADD_BELOW: SET_TOS(tos + BELOW(c)); break;
+                case OP_ADD_ABOVE: SET_TOS(tos + ABOVE(c)); break;
+                case OP_REDUCE_BELOW: SET_TOS(tos - BELOW(c)); break;
+                case OP_REDUCE_ABOVE: SET_TOS(tos - ABOVE(c)); break;
+                case OP_MULTIPLY_BELOW: SET_TOS(tos * BELOW(c)); break;
+                case OP_MULTIPLY_ABOVE: SET_TOS(tos * ABOVE(c)); break;
+                case OP_ADD_CONSTANT: SET_TOS(tos + op->immediate); break;
+                case OP_REDUCE_CONSTANT: SET_TOS(tos - op->immediate); break;
+                case OP_MULTIPLY_CONSTANT: SET_TOS(tos * op->immediate); break;
+                case OP_DIVIDE_CONSTANT: SET_TOS(tos / op->immediate); break;
+                case OP_MODULO_CONSTANT: SET_TOS(tos % op->immediate); break;
+                case OP_DIVIDE_BELOW:
+                case OP_DIVIDE_ABOVE:
+                case OP_MODULO_BELOW:
+                case OP_MODULO_ABOVE:
+                    cell = op->opcode == OP_DIVIDE_BELOW || op->opcode == OP_MODULO_BELOW ? BELOW(c) : ABOVE(c);
+                    if (cell == 0) {
+                        s->top = top;
+                        PROFILE_FAULT(op);
+                        STOP_AT(c, op->offset);
+                        report_division_by_zero();
+                    }
+                    SET_TOS(op->opcode == OP_DIVIDE_BELOW || op->opcode == OP_DIVIDE_ABOVE ? tos / cell : tos % cell);
+                    break;
+                case OP_FETCH_BELOW:
+                case OP_FETCH_ABOVE:
+                    value = tos;
+                    top--;
+                    TOP_CHANGED();
+                    s->top = top;
+                    WRITE_CELL(c, op->opcode == OP_FETCH_BELOW ? 1 : -1);
+                    if (!trace->valid) goto side_exit;
+                    break;
+                case OP_INPUT_BELOW:
+                case OP_INPUT_ABOVE:
+                    s->top = top;
+                    INPUT(c, op->opcode == OP_INPUT_BELOW ? 1 : -1);
+                    break;
+                case OP_OUTPUT_BELOW:
+                case OP_OUTPUT_ABOVE:
+                case OP_OUTPUT_CONSTANT:
+                    s->top = top;
+                    OUTPUT_RUN();
+                    break;
+                default:
+                    break;
+            }
+        }
+        s->top = top;
+        goto finish;
+    }
+
+run_native:
+    result = trace->native(s, (int)(op - trace->ops));
+    if (result & NATIVE_TURNED) {
+        // The native code also executed the direction change ending the run
+        steps += trace->length;
+        pc = trace->exit;
+        dir = NATIVE_DIRECTION(result);
+        if (profile) {
+            profile_trace_run(profile, trace, entry_top);
+            profile->running = NULL;
+            profile->hits[pc - program_cells]++;
+        }
+        ADVANCE();
+    }
+    op = trace->ops + NATIVE_OPS_DONE(result);
+    if (op < end) goto interpret;
+    goto finish;
+
+side_exit:
+    // A write hit the running trace; resume cell by cell after the writer
+    steps += op->offset;
+    pc = op->cell;
+    partial = 0;
+    ADVANCE();
+
+#if !USE_COMPUTED_GOTO
+dispatch:
+    switch ((enum opcode)pc->opcode) {
+#endif
+
+    TARGET(OP_NOP)
+        ADVANCE();
+
+    TARGET(OP_LEFT)
+        dir = LEFT;
+        ADVANCE();
+
+    TARGET(OP_DOWN)
+        dir = DOWN;
+        ADVANCE();
+
+    TARGET(OP_UP)
+        dir = UP;
+        ADVANCE();
+
+    TARGET(OP_RIGHT)
+        dir = RIGHT;
+        ADVANCE();
+
+    TARGET(OP_JUMP_LEFT)
+        JUMP(LEFT);
+
+    TARGET(OP_JUMP_DOWN)
+        JUMP(DOWN);
+
+    TARGET(OP_JUMP_UP)
+        JUMP(UP);
+
+    TARGET(OP_JUMP_RIGHT)
+        JUMP(RIGHT);
+
+    TARGET(OP_TURN_RIGHT)
+        if (s->top < 0) {
+            stack_peek(s, &value);  // reports the empty stack, execution goes on
+        } else if (s->data[s->top] > 0) {
+            dir = right_of[dir];
+        }
+        ADVANCE();
+
+    TARGET(OP_TURN_LEFT)
+        if (s->top < 0) {
+            stack_peek(s, &value);
+        } else if (s->data[s->top] < 0) {
+            dir = left_of[dir];
+        }
+        ADVANCE();
+
+    TARGET(OP_END)
+        STOP_AT(pc, 0);
+        handle_end(state);
+        goto done;
+
+#if USE_COMPUTED_GOTO
+    TARGET_EFFECT:
+#else
+    case OP_STORE_BELOW: case OP_STORE_ABOVE: case OP_DUPLICATE: case OP_DELETE:
+    case OP_ADD_BELOW: case OP_ADD_ABOVE: case OP_REDUCE_BELOW: case OP_REDUCE_ABOVE:
+    case OP_MULTIPLY_BELOW: case OP_MULTIPLY_ABOVE: case OP_DIVIDE_BELOW: case OP_DIVIDE_ABOVE:
+    case OP_MODULO_BELOW: case OP_MODULO_ABOVE: case OP_FETCH_BELOW: case OP_FETCH_ABOVE:
+    case OP_OUTPUT_BELOW: case OP_OUTPUT_ABOVE: case OP_INPUT_BELOW: case OP_INPUT_ABOVE:
+    case OP_EDGE:
+#endif
+        // Single effect op outside a trace (near the step limit, without
+        // memory for a trace, or an operand on the border that the handler
+        // reports)
+        STOP_AT(pc, 0);     // in case the handler stops the run
+        get_instruction_handler((char)grid[pc->y][pc->x])(state);
+        if (profile) profile_stack(profile, s->top);
+        ADVANCE();
+
+    TARGET(OP_INVALID)
+#if !USE_COMPUTED_GOTO
+    default:
+#endif
+        STOP_AT(pc, 0);
+        report_invalid_instruction(pc->x, pc->y);
+        goto done;
+
+    TARGET(OP_TRAP)
+        goto out_of_bounds;
+
+#if !USE_COMPUTED_GOTO
+    }
+#endif
+
+out_of_bounds:
+    // The move off the grid from the last cell on it was counted as a step
+    STOP_AT(pc - cell_offset[dir], -1);
+    report_error("Error: Instruction pointer moved outside bounds (%s)\n", direction_names[dir]);
+    stop_execution(PFUSCH_OUT_OF_BOUNDS);
+
+done:
+    if (pc->opcode == OP_TRAP) {
+        goto out_of_bounds;     // the last step moved off the grid
+    }
+    state->ip.x = pc->x;
+    state->ip.y = pc->y;
+    state->ip.direction = dir;
+    return steps;
+
+#undef STOP_AT
+#undef PEEK
+#undef POP
+#undef PUSH
+#undef GROW
+#undef BELOW
+#undef ABOVE
+#undef OUTPUT_VALUE
+#undef OUTPUT_RUN
+#undef TOP_CHANGED
+#undef SET_TOS
+#undef TARGET
+#undef DISPATCH
+#undef ADVANCE
+#undef JUMP
+#undef ARITHMETIC
+#undef DIVIDE
+#undef PROFILE_FAULT
+#undef WRITE_CELL
+#undef INPUT
+#undef FETCH
+}
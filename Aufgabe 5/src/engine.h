@@ -0,0 +1,22 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "interpreter.h"
+
+// Available execution engines
+enum engine {
+    ENGINE_REFERENCE,   // execute_step through the instruction hash table
+    ENGINE_FAST         // direct-threaded dispatch over the decoded program image
+};
+
+// Build with -DPFUSCH_REFERENCE_ENGINE to make the reference engine the default
+#ifdef PFUSCH_REFERENCE_ENGINE
+#define DEFAULT_ENGINE ENGINE_REFERENCE
+#else
+#define DEFAULT_ENGINE ENGINE_FAST
+#endif
+
+// Function declarations
+int run_program(struct state *state, int max_steps);
+
+#endif // ENGINE_H
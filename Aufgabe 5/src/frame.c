@@ -0,0 +1,51 @@
+#include "frame.h"
+#include <errno.h>
+#include <unistd.h>
+
+uint64_t get_fixed(const unsigned char *bytes, int count) {
+    uint64_t value = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+void put_fixed(unsigned char *bytes, uint64_t value, int count) {
+    for (int i = 0; i < count; i++) {
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+// 0 once all count bytes are read, -1 on EOF or error
+int read_full(int fd, void *data, size_t count) {
+    char *bytes = data;
+    while (count > 0) {
+        ssize_t done = read(fd, bytes, count);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return -1;
+        }
+        bytes += done;
+        count -= (size_t)done;
+    }
+    return 0;
+}
+
+// 0 once all count bytes are written, -1 on error
+int write_full(int fd, const void *data, size_t count) {
+    const char *bytes = data;
+    while (count > 0) {
+        ssize_t done = write(fd, bytes, count);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return -1;
+        }
+        bytes += done;
+        count -= (size_t)done;
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Little-endian fields and whole reads and writes for the frames of the
+// worker mode (see server.h), shared by the server and pfuschclient
+
+// Function declarations
+uint64_t get_fixed(const unsigned char *bytes, int count);
+void put_fixed(unsigned char *bytes, uint64_t value, int count);
+int read_full(int fd, void *data, size_t count);
+int write_full(int fd, const void *data, size_t count);
+
+#endif // FRAME_H
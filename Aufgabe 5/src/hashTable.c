@@ -13,7 +13,7 @@ static int hash_function(char key) {
 }
 
 // Insert instruction into hash table
-static void insert_instruction(char instruction, instruction_func_t handler, const char* description) {
+static void insert_instruction(char instruction, enum opcode opcode, instruction_func_t handler, const char* description) {
     int index = hash_function(instruction);
     int original_index = index;
     
@@ -27,6 +27,7 @@ static void insert_instruction(char instruction, instruction_func_t handler, con
     }
     
     instruction_table.entries[index].instruction = instruction;
+    instruction_table.entries[index].opcode = opcode;
     instruction_table.entries[index].handler = handler;
     instruction_table.entries[index].description = description;
     instruction_table.entries[index].is_occupied = 1;
@@ -59,38 +60,38 @@ void init_hash_table(void) {
     }
     
     // Insert all instructions
-    insert_instruction('#', handle_nop, "no operation (NOP)");
-    insert_instruction('h', handle_left, "set execution direction to left");
-    insert_instruction('j', handle_down, "set execution direction to down");
-    insert_instruction('k', handle_up, "set execution direction to up");
-    insert_instruction('l', handle_right, "set execution direction to right");
-    insert_instruction('H', handle_jump_left, "jump left to next cell matching top of stack; set direction to left");
-    insert_instruction('J', handle_jump_down, "jump down to next cell matching top of stack; set direction to down");
-    insert_instruction('K', handle_jump_up, "jump up to next cell matching top of stack; set direction to up");
-    insert_instruction('L', handle_jump_right, "jump right to next cell matching top of stack; set direction to right");
-    insert_instruction('x', handle_turn_right, "if top of stack > 0, turn direction 90 degrees right");
-    insert_instruction('X', handle_turn_left, "if top of stack < 0, turn direction 90 degrees left");
-    insert_instruction('e', handle_end, "end program execution");
-    insert_instruction('s', handle_store_below, "push value of cell below current to stack");
-    insert_instruction('S', handle_store_above, "push value of cell above current to stack");
-    insert_instruction('d', handle_duplicate, "duplicate top value on stack");
-    insert_instruction('D', handle_delete, "delete top value off stack");
-    insert_instruction('a', handle_add_below, "add value of cell below to top of stack");
-    insert_instruction('A', handle_add_above, "add value of cell above to top of stack");
-    insert_instruction('r', handle_reduce_below, "reduce top of stack by value of cell below");
-    insert_instruction('R', handle_reduce_above, "reduce top of stack by value of cell above");
-    insert_instruction('p', handle_multiply_below, "multiply top of stack by value of cell below");
-    insert_instruction('P', handle_multiply_above, "multiply top of stack by value of cell above");
-    insert_instruction('q', handle_divide_below, "divide top of stack by value of cell below (quotient)");
-    insert_instruction('Q', handle_divide_above, "divide top of stack by value of cell above (quotient)");
-    insert_instruction('m', handle_modulo_below, "divide top of stack by value of cell below (remainder)");
-    insert_instruction('M', handle_modulo_above, "divide top of stack by value of cell above (remainder)");
-    insert_instruction('f', handle_fetch_below, "pop top of stack and store to cell below");
-    insert_instruction('F', handle_fetch_above, "pop top of stack and store to cell above");
-    insert_instruction('o', handle_output_below, "send value of cell below to stdout");
-    insert_instruction('O', handle_output_above, "send value of cell above to stdout");
-    insert_instruction('i', handle_input_below, "read one byte from stdin and store in cell below");
-    insert_instruction('I', handle_input_above, "read one byte from stdin and store in cell above");
+    insert_instruction('#', OP_NOP, handle_nop, "no operation (NOP)");
+    insert_instruction('h', OP_LEFT, handle_left, "set execution direction to left");
+    insert_instruction('j', OP_DOWN, handle_down, "set execution direction to down");
+    insert_instruction('k', OP_UP, handle_up, "set execution direction to up");
+    insert_instruction('l', OP_RIGHT, handle_right, "set execution direction to right");
+    insert_instruction('H', OP_JUMP_LEFT, handle_jump_left, "jump left to next cell matching top of stack; set direction to left");
+    insert_instruction('J', OP_JUMP_DOWN, handle_jump_down, "jump down to next cell matching top of stack; set direction to down");
+    insert_instruction('K', OP_JUMP_UP, handle_jump_up, "jump up to next cell matching top of stack; set direction to up");
+    insert_instruction('L', OP_JUMP_RIGHT, handle_jump_right, "jump right to next cell matching top of stack; set direction to right");
+    insert_instruction('x', OP_TURN_RIGHT, handle_turn_right, "if top of stack > 0, turn direction 90 degrees right");
+    insert_instruction('X', OP_TURN_LEFT, handle_turn_left, "if top of stack < 0, turn direction 90 degrees left");
+    insert_instruction('e', OP_END, handle_end, "end program execution");
+    insert_instruction('s', OP_STORE_BELOW, handle_store_below, "push value of cell below current to stack");
+    insert_instruction('S', OP_STORE_ABOVE, handle_store_above, "push value of cell above current to stack");
+    insert_instruction('d', OP_DUPLICATE, handle_duplicate, "duplicate top value on stack");
+    insert_instruction('D', OP_DELETE, handle_delete, "delete top value off stack");
+    insert_instruction('a', OP_ADD_BELOW, handle_add_below, "add value of cell below to top of stack");
+    insert_instruction('A', OP_ADD_ABOVE, handle_add_above, "add value of cell above to top of stack");
+    insert_instruction('r', OP_REDUCE_BELOW, handle_reduce_below, "reduce top of stack by value of cell below");
+    insert_instruction('R', OP_REDUCE_ABOVE, handle_reduce_above, "reduce top of stack by value of cell above");
+    insert_instruction('p', OP_MULTIPLY_BELOW, handle_multiply_below, "multiply top of stack by value of cell below");
+    insert_instruction('P', OP_MULTIPLY_ABOVE, handle_multiply_above, "multiply top of stack by value of cell above");
+    insert_instruction('q', OP_DIVIDE_BELOW, handle_divide_below, "divide top of stack by value of cell below (quotient)");
+    insert_instruction('Q', OP_DIVIDE_ABOVE, handle_divide_above, "divide top of stack by value of cell above (quotient)");
+    insert_instruction('m', OP_MODULO_BELOW, handle_modulo_below, "divide top of stack by value of cell below (remainder)");
+    insert_instruction('M', OP_MODULO_ABOVE, handle_modulo_above, "divide top of stack by value of cell above (remainder)");
+    insert_instruction('f', OP_FETCH_BELOW, handle_fetch_below, "pop top of stack and store to cell below");
+    insert_instruction('F', OP_FETCH_ABOVE, handle_fetch_above, "pop top of stack and store to cell above");
+    insert_instruction('o', OP_OUTPUT_BELOW, handle_output_below, "send value of cell below to stdout");
+    insert_instruction('O', OP_OUTPUT_ABOVE, handle_output_above, "send value of cell above to stdout");
+    insert_instruction('i', OP_INPUT_BELOW, handle_input_below, "read one byte from stdin and store in cell below");
+    insert_instruction('I', OP_INPUT_ABOVE, handle_input_above, "read one byte from stdin and store in cell above");
 }
 
 // Get instruction handler function pointer
@@ -99,6 +100,17 @@ instruction_func_t get_instruction_handler(char instruction) {
     return entry ? entry->handler : NULL;
 }
 
+// Get dense opcode for an instruction; characters outside the instruction
+// set are no-ops unless they are control characters or not 7-bit ASCII
+enum opcode get_instruction_opcode(char instruction) {
+    struct hash_entry* entry = lookup_instruction(instruction);
+    if (entry) {
+        return entry->opcode;
+    }
+    unsigned char ch = (unsigned char)instruction;
+    return (ch < 32 || ch > 127) ? OP_INVALID : OP_NOP;
+}
+
 // Get instruction description
 const char* get_instruction_description(char instruction) {
     struct hash_entry* entry = lookup_instruction(instruction);
@@ -137,16 +149,6 @@ void cleanup_hash_table(void) {
     }
 }
 
-// Helper functions (from interpreter.c)
-extern void turnLeft(struct instructionPointer *ip);
-extern void turnRight(struct instructionPointer *ip);
-extern int stack_push(struct stack *s, int value);
-extern int stack_pop(struct stack *s, int *value);
-extern int stack_peek(struct stack *s, int *value);
-extern int get_cell_value(int x, int y);
-extern void set_cell_value(int x, int y, int value);
-extern int jump_in_direction(struct instructionPointer *ip, enum direction dir, int target_value);
-
 void handle_nop(struct state *state) {
     (void)state; // Suppress unused parameter warning
     // No operation
@@ -170,37 +172,37 @@ void handle_right(struct state *state) {
 
 void handle_jump_left(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     if (jump_in_direction(&state->ip, LEFT, value) != 0) {
-        fprintf(stderr, "Error: Jump target not found\n");
-        exit(1);
+        report_error("Error: Jump target not found\n");
+        stop_execution(PFUSCH_JUMP_TARGET_NOT_FOUND);
     }
 }
 
 void handle_jump_down(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     if (jump_in_direction(&state->ip, DOWN, value) != 0) {
-        fprintf(stderr, "Error: Jump target not found\n");
-        exit(1);
+        report_error("Error: Jump target not found\n");
+        stop_execution(PFUSCH_JUMP_TARGET_NOT_FOUND);
     }
 }
 
 void handle_jump_up(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     if (jump_in_direction(&state->ip, UP, value) != 0) {
-        fprintf(stderr, "Error: Jump target not found\n");
-        exit(1);
+        report_error("Error: Jump target not found\n");
+        stop_execution(PFUSCH_JUMP_TARGET_NOT_FOUND);
     }
 }
 
 void handle_jump_right(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     if (jump_in_direction(&state->ip, RIGHT, value) != 0) {
-        fprintf(stderr, "Error: Jump target not found\n");
-        exit(1);
+        report_error("Error: Jump target not found\n");
+        stop_execution(PFUSCH_JUMP_TARGET_NOT_FOUND);
     }
 }
 
@@ -220,126 +222,128 @@ void handle_turn_left(struct state *state) {
 
 void handle_end(struct state *state) {
     (void)state; // Suppress unused parameter warning
-    printf("\nProgram ended normally.\n");
-    exit(0);
+    if (!run_context) {
+        printf("\nProgram ended normally.\n");
+    }
+    stop_execution(PFUSCH_ENDED);
 }
 
 void handle_store_below(struct state *state) {
     int below_value = get_cell_value(state->ip.x, state->ip.y + 1);
-    if (stack_push(&state->stack, below_value) != 0) exit(1);
+    if (stack_push(&state->stack, below_value) != 0) stop_execution(PFUSCH_STACK_OVERFLOW);
 }
 
 void handle_store_above(struct state *state) {
     int above_value = get_cell_value(state->ip.x, state->ip.y - 1);
-    if (stack_push(&state->stack, above_value) != 0) exit(1);
+    if (stack_push(&state->stack, above_value) != 0) stop_execution(PFUSCH_STACK_OVERFLOW);
 }
 
 void handle_duplicate(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
-    if (stack_push(&state->stack, value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
+    if (stack_push(&state->stack, value) != 0) stop_execution(PFUSCH_STACK_OVERFLOW);
 }
 
 void handle_delete(struct state *state) {
     int value;
-    if (stack_pop(&state->stack, &value) != 0) exit(1);
+    if (stack_pop(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
 }
 
 void handle_add_below(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     int below_value = get_cell_value(state->ip.x, state->ip.y + 1);
     state->stack.data[state->stack.top] = value + below_value;
 }
 
 void handle_add_above(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     int above_value = get_cell_value(state->ip.x, state->ip.y - 1);
     state->stack.data[state->stack.top] = value + above_value;
 }
 
 void handle_reduce_below(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     int below_value = get_cell_value(state->ip.x, state->ip.y + 1);
     state->stack.data[state->stack.top] = value - below_value;
 }
 
 void handle_reduce_above(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     int above_value = get_cell_value(state->ip.x, state->ip.y - 1);
     state->stack.data[state->stack.top] = value - above_value;
 }
 
 void handle_multiply_below(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     int below_value = get_cell_value(state->ip.x, state->ip.y + 1);
     state->stack.data[state->stack.top] = value * below_value;
 }
 
 void handle_multiply_above(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     int above_value = get_cell_value(state->ip.x, state->ip.y - 1);
     state->stack.data[state->stack.top] = value * above_value;
 }
 
 void handle_divide_below(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     int below_value = get_cell_value(state->ip.x, state->ip.y + 1);
     if (below_value == 0) {
-        fprintf(stderr, "Error: Division by zero\n");
-        exit(1);
+        report_error("Error: Division by zero\n");
+        stop_execution(PFUSCH_DIVISION_BY_ZERO);
     }
     state->stack.data[state->stack.top] = value / below_value;
 }
 
 void handle_divide_above(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     int above_value = get_cell_value(state->ip.x, state->ip.y - 1);
     if (above_value == 0) {
-        fprintf(stderr, "Error: Division by zero\n");
-        exit(1);
+        report_error("Error: Division by zero\n");
+        stop_execution(PFUSCH_DIVISION_BY_ZERO);
     }
     state->stack.data[state->stack.top] = value / above_value;
 }
 
 void handle_modulo_below(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     int below_value = get_cell_value(state->ip.x, state->ip.y + 1);
     if (below_value == 0) {
-        fprintf(stderr, "Error: Division by zero\n");
-        exit(1);
+        report_error("Error: Division by zero\n");
+        stop_execution(PFUSCH_DIVISION_BY_ZERO);
     }
     state->stack.data[state->stack.top] = value % below_value;
 }
 
 void handle_modulo_above(struct state *state) {
     int value;
-    if (stack_peek(&state->stack, &value) != 0) exit(1);
+    if (stack_peek(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     int above_value = get_cell_value(state->ip.x, state->ip.y - 1);
     if (above_value == 0) {
-        fprintf(stderr, "Error: Division by zero\n");
-        exit(1);
+        report_error("Error: Division by zero\n");
+        stop_execution(PFUSCH_DIVISION_BY_ZERO);
     }
     state->stack.data[state->stack.top] = value % above_value;
 }
 
 void handle_fetch_below(struct state *state) {
     int value;
-    if (stack_pop(&state->stack, &value) != 0) exit(1);
+    if (stack_pop(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     set_cell_value(state->ip.x, state->ip.y + 1, value);
 }
 
 void handle_fetch_above(struct state *state) {
     int value;
-    if (stack_pop(&state->stack, &value) != 0) exit(1);
+    if (stack_pop(&state->stack, &value) != 0) stop_execution(PFUSCH_STACK_UNDERFLOW);
     set_cell_value(state->ip.x, state->ip.y - 1, value);
 }
 
@@ -347,34 +351,32 @@ void handle_output_below(struct state *state) {
     int below_value = get_cell_value(state->ip.x, state->ip.y + 1);
     // Check for valid 7-bit ASCII (0-127)
     if (below_value < 0 || below_value > 127) {
-        fprintf(stderr, "Error: Invalid ASCII value for output: %d (must be 0-127)\n", below_value);
-        exit(1);
+        report_error("Error: Invalid ASCII value for output: %d (must be 0-127)\n", below_value);
+        stop_execution(PFUSCH_INVALID_OUTPUT);
     }
-    putchar(below_value);
-    add_to_output(below_value);
-    fflush(stdout);
+    char ch = (char)below_value;
+    write_output(&ch, 1);
 }
 
 void handle_output_above(struct state *state) {
     int above_value = get_cell_value(state->ip.x, state->ip.y - 1);
     // Check for valid 7-bit ASCII (0-127)
     if (above_value < 0 || above_value > 127) {
-        fprintf(stderr, "Error: Invalid ASCII value for output: %d (must be 0-127)\n", above_value);
-        exit(1);
+        report_error("Error: Invalid ASCII value for output: %d (must be 0-127)\n", above_value);
+        stop_execution(PFUSCH_INVALID_OUTPUT);
     }
-    putchar(above_value);
-    add_to_output(above_value);
-    fflush(stdout);
+    char ch = (char)above_value;
+    write_output(&ch, 1);
 }
 
 void handle_input_below(struct state *state) {
-    int value = getchar();
+    int value = read_input();
     if (value == EOF) value = 0;
     set_cell_value(state->ip.x, state->ip.y + 1, value);
 }
 
 void handle_input_above(struct state *state) {
-    int value = getchar();
+    int value = read_input();
     if (value == EOF) value = 0;
     set_cell_value(state->ip.x, state->ip.y - 1, value);
 }
\ No newline at end of file
@@ -6,9 +6,59 @@
 // Function pointer type for instruction handlers
 typedef void (*instruction_func_t)(struct state *state);
 
+// Dense opcode numbers used by the dispatch engine (one per handler)
+enum opcode {
+    OP_NOP,
+    OP_LEFT,
+    OP_DOWN,
+    OP_UP,
+    OP_RIGHT,
+    OP_JUMP_LEFT,
+    OP_JUMP_DOWN,
+    OP_JUMP_UP,
+    OP_JUMP_RIGHT,
+    OP_TURN_RIGHT,
+    OP_TURN_LEFT,
+    OP_END,
+    OP_STORE_BELOW,
+    OP_STORE_ABOVE,
+    OP_DUPLICATE,
+    OP_DELETE,
+    OP_ADD_BELOW,
+    OP_ADD_ABOVE,
+    OP_REDUCE_BELOW,
+    OP_REDUCE_ABOVE,
+    OP_MULTIPLY_BELOW,
+    OP_MULTIPLY_ABOVE,
+    OP_DIVIDE_BELOW,
+    OP_DIVIDE_ABOVE,
+    OP_MODULO_BELOW,
+    OP_MODULO_ABOVE,
+    OP_FETCH_BELOW,
+    OP_FETCH_ABOVE,
+    OP_OUTPUT_BELOW,
+    OP_OUTPUT_ABOVE,
+    OP_INPUT_BELOW,
+    OP_INPUT_ABOVE,
+    OP_INVALID,     // control character or outside 7-bit ASCII
+    OP_EDGE,        // operand cell outside the grid (decoder only)
+    OP_TRAP,        // sentinel border cell (decoder only)
+    // Trace ops whose operand cell is fixed (see analysis.h); the value is
+    // the op's immediate, and the divisor of q/Q and m/M is not zero
+    OP_PUSH_CONSTANT,
+    OP_ADD_CONSTANT,
+    OP_REDUCE_CONSTANT,
+    OP_MULTIPLY_CONSTANT,
+    OP_DIVIDE_CONSTANT,
+    OP_MODULO_CONSTANT,
+    OP_OUTPUT_CONSTANT,
+    OP_COUNT
+};
+
 // Hash table entry structure
 struct hash_entry {
     char instruction;
+    enum opcode opcode;
     instruction_func_t handler;
     const char* description;
     int is_occupied;
@@ -25,6 +75,7 @@ struct hash_table {
 // Function declarations
 void init_hash_table(void);
 instruction_func_t get_instruction_handler(char instruction);
+enum opcode get_instruction_opcode(char instruction);
 const char* get_instruction_description(char instruction);
 void cleanup_hash_table(void);
 
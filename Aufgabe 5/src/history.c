@@ -0,0 +1,232 @@
+#include "history.h"
+#include "visualizer.h"
+#include "loopDetector.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// Record flags; the low two bits say how the stack changed
+#define STACK_PUSH 1
+#define STACK_POP 2
+#define STACK_REPLACE 3
+#define STACK_CHANGE 3
+#define CELL_WRITTEN 4
+#define OUTPUT_WRITTEN 8
+#define INPUT_READ 16
+
+// Flags, IP, old top value, cell, output byte, input byte and length
+#define MAX_RECORD (1 + 2 + 4 + 6 + 1 + 1 + 1)
+
+// Ring of records; the newest one ends just before head
+static unsigned char *ring = NULL;
+static size_t capacity = 0;
+static size_t head = 0;
+static size_t used = 0;
+static long records = 0;
+
+// State before the step being recorded
+static struct {
+    struct instructionPointer ip;
+    int top;
+    int top_value;
+    int cell;                   // y * GRID_WIDTH + x of the cell the step may write, or -1
+    int cell_value;
+    long output_total;
+    char overwritten;           // scrollback byte the next output byte replaces
+    long input_bytes;
+} before;
+static int input_value;
+
+// Input bytes given back by undo; they are read again before new input
+static unsigned char *replay = NULL;
+static long replay_count = 0;
+static long replay_capacity = 0;
+
+int history_init(size_t bytes) {
+    capacity = bytes > MAX_RECORD ? bytes : MAX_RECORD;
+    ring = malloc(capacity);
+    head = 0;
+    used = 0;
+    records = 0;
+    return ring ? 0 : -1;
+}
+
+static size_t record_size(int flags) {
+    size_t size = 1 + 2 + 1;
+    if ((flags & STACK_CHANGE) == STACK_POP || (flags & STACK_CHANGE) == STACK_REPLACE) {
+        size += 4;
+    }
+    if (flags & CELL_WRITTEN) {
+        size += 6;
+    }
+    if (flags & OUTPUT_WRITTEN) {
+        size += 1;
+    }
+    if (flags & INPUT_READ) {
+        size += 1;
+    }
+    return size;
+}
+
+static void put(unsigned char *record, int *length, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        record[(*length)++] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint32_t get(const unsigned char *record, int *position, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint32_t)record[(*position)++] << (8 * i);
+    }
+    return value;
+}
+
+void history_before_step(const struct state *state) {
+    before.ip = state->ip;
+    before.top = state->stack.top;
+    before.top_value = state->stack.top >= 0 ? state->stack.data[state->stack.top] : 0;
+
+    // f, F, i and I write the cell below or above; a cell executes as its
+    // low byte, as in execute_step
+    char instruction = (char)grid_cells[GRID_INDEX(state->ip.x, state->ip.y)];
+    int target = instruction == 'f' || instruction == 'i' ? state->ip.y + 1 :
+                 instruction == 'F' || instruction == 'I' ? state->ip.y - 1 : -1;
+    before.cell = -1;
+    if (target >= 0 && target < GRID_HEIGHT) {
+        before.cell = target * GRID_WIDTH + state->ip.x;
+        before.cell_value = grid[target][state->ip.x];
+    }
+    before.output_total = output_written();
+    before.overwritten = output_overwritten();
+    before.input_bytes = input_bytes_read;
+}
+
+// Byte consumed by the step being recorded
+void history_note_input(int value) {
+    input_value = value;
+}
+
+// Record what the step since history_before_step changed; also called for
+// a step that stopped the program, which may have changed part of it
+void history_after_step(const struct state *state) {
+    unsigned char record[MAX_RECORD];
+    int length = 1;
+    int flags = 0;
+    put(record, &length, (uint32_t)(before.ip.x + GRID_WIDTH * before.ip.y) | (uint32_t)before.ip.direction << 12, 2);
+
+    if (state->stack.top == before.top + 1) {
+        flags |= STACK_PUSH;
+    } else if (state->stack.top == before.top - 1) {
+        flags |= STACK_POP;
+        put(record, &length, (uint32_t)before.top_value, 4);
+    } else if (before.top >= 0 && state->stack.top == before.top &&
+               state->stack.data[before.top] != before.top_value) {
+        flags |= STACK_REPLACE;
+        put(record, &length, (uint32_t)before.top_value, 4);
+    }
+    if (before.cell >= 0 && grid[before.cell / GRID_WIDTH][before.cell % GRID_WIDTH] != before.cell_value) {
+        flags |= CELL_WRITTEN;
+        put(record, &length, (uint32_t)before.cell, 2);
+        put(record, &length, (uint32_t)before.cell_value, 4);
+    }
+    if (output_written() != before.output_total) {
+        flags |= OUTPUT_WRITTEN;
+        record[length++] = (unsigned char)before.overwritten;
+    }
+    if (input_bytes_read != before.input_bytes) {
+        flags |= INPUT_READ;
+        record[length++] = (unsigned char)input_value;
+    }
+    record[0] = (unsigned char)flags;
+    record[length] = (unsigned char)(length + 1);
+    length++;
+
+    // Drop the oldest records until this one fits
+    while (capacity - used < (size_t)length) {
+        size_t tail = (head + capacity - used) % capacity;
+        used -= record_size(ring[tail]);
+        records--;
+    }
+    for (int i = 0; i < length; i++) {
+        ring[(head + i) % capacity] = record[i];
+    }
+    head = (head + length) % capacity;
+    used += length;
+    records++;
+}
+
+static void push_replay(unsigned char value) {
+    if (replay_count == replay_capacity) {
+        long grown = replay_capacity ? replay_capacity * 2 : 256;
+        unsigned char *bytes = realloc(replay, grown);
+        if (!bytes) {
+            return;     // the byte is read from stdin again instead
+        }
+        replay = bytes;
+        replay_capacity = grown;
+    }
+    replay[replay_count++] = value;
+}
+
+// Take back the newest recorded step; returns 0 when there is none
+int history_undo(struct state *state) {
+    if (records == 0) {
+        return 0;
+    }
+    unsigned char record[MAX_RECORD];
+    int length = ring[(head + capacity - 1) % capacity];
+    size_t start = (head + capacity - length) % capacity;
+    for (int i = 0; i < length; i++) {
+        record[i] = ring[(start + i) % capacity];
+    }
+    head = start;
+    used -= length;
+    records--;
+
+    int position = 1;
+    int flags = record[0];
+    uint32_t ip = get(record, &position, 2);
+    state->ip.x = (int)(ip & 0xFFF) % GRID_WIDTH;
+    state->ip.y = (int)(ip & 0xFFF) / GRID_WIDTH;
+    state->ip.direction = (enum direction)(ip >> 12);
+
+    switch (flags & STACK_CHANGE) {
+        case STACK_PUSH:
+            state->stack.top--;
+            break;
+        case STACK_POP:
+            state->stack.data[++state->stack.top] = (int32_t)get(record, &position, 4);
+            break;
+        case STACK_REPLACE:
+            state->stack.data[state->stack.top] = (int32_t)get(record, &position, 4);
+            break;
+    }
+    if (flags & CELL_WRITTEN) {
+        int cell = (int)get(record, &position, 2);
+        int value = (int32_t)get(record, &position, 4);
+        // Keeps the decoded image, jump index and grid hash in step
+        set_cell_value(cell % GRID_WIDTH, cell / GRID_WIDTH, value);
+    }
+    if (flags & OUTPUT_WRITTEN) {
+        unwrite_output((char)record[position++]);
+    }
+    if (flags & INPUT_READ) {
+        push_replay(record[position++]);
+        input_bytes_read--;
+    }
+    return 1;
+}
+
+// Number of steps that can be taken back
+long history_length(void) {
+    return records;
+}
+
+// Next input byte given back by undo; returns 0 when there is none
+int history_replay_input(int *value) {
+    if (replay_count == 0) {
+        return 0;
+    }
+    *value = replay[--replay_count];
+    return 1;
+}
@@ -0,0 +1,29 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "interpreter.h"
+#include <stddef.h>
+
+// Undo log of the debugger (--debug): one small record per executed step
+// with what the step changed, kept in a ring of a fixed number of bytes.
+// When the ring is full the oldest steps are dropped. A record is
+//   u8 flags, u16 previous IP (x + 69 * y, direction << 12),
+//   i32 old top value (pop or replace), u16 cell index and i32 old value
+//   (cell written), u8 scrollback byte overwritten (output),
+//   u8 input byte consumed, u8 length of the record
+// where only the fields named by flags are present. The trailing length
+// lets undo walk the ring backward from the newest record.
+
+// Default size of the log (--history), in MB
+#define DEFAULT_HISTORY_MB 16
+
+// Function declarations
+int history_init(size_t bytes);
+void history_before_step(const struct state *state);
+void history_after_step(const struct state *state);
+void history_note_input(int value);
+int history_undo(struct state *state);
+long history_length(void);
+int history_replay_input(int *value);
+
+#endif // HISTORY_H
@@ -0,0 +1,124 @@
+#include "input.h"
+#include "output.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bytes not yet read: a block of stdin, or the whole mapped --input file
+static unsigned char block[INPUT_BUFFER_SIZE];
+static const unsigned char *input_data = block;
+static size_t input_length = 0;
+static size_t input_position = 0;
+static int input_fd = STDIN_FILENO;
+static int input_mapped = 0;
+static int input_ended = 0;      // EOF was read; it stays, as with stdio
+
+// Map the regular file open at fd read-only; NULL if it is not one or
+// cannot be mapped
+static const char *map_fd(int fd, size_t *length) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        return NULL;
+    }
+    *length = (size_t)info.st_size;
+    if (info.st_size == 0) {
+        return "";
+    }
+    void *mapping = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+    return mapping == MAP_FAILED ? NULL : mapping;
+}
+
+// Map a regular file read-only; NULL if it is not one or cannot be mapped
+const char *map_file(const char *path, size_t *length) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    const char *data = map_fd(fd, length);
+    close(fd);
+    return data;
+}
+
+void unmap_file(const char *data, size_t length) {
+    if (length > 0) {
+        munmap((void *)data, length);
+    }
+}
+
+// Read the program input from path instead of stdin; returns 0 or -1 after
+// printing why. Files that cannot be mapped (pipes, terminals) are read in
+// blocks like stdin; they are opened once, so a FIFO loses nothing.
+int input_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening input file");
+        return -1;
+    }
+    size_t length;
+    const char *data = map_fd(fd, &length);
+    if (!data) {
+        input_fd = fd;
+        return 0;
+    }
+    close(fd);
+    input_data = (const unsigned char *)data;
+    input_length = length;
+    input_mapped = 1;
+    return 0;
+}
+
+static int refill(void) {
+    output_flush();  // show pending output before waiting for input
+    ssize_t count;
+    do {
+        count = read(input_fd, block, sizeof(block));
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0) {
+        input_ended = 1;
+        return -1;
+    }
+    input_length = (size_t)count;
+    input_position = 0;
+    return 0;
+}
+
+// Next input byte or EOF
+int input_byte(void) {
+    if (input_position < input_length) {
+        return input_data[input_position++];
+    }
+    if (input_mapped || input_ended || refill() != 0) {
+        return EOF;
+    }
+    return input_data[input_position++];
+}
+
+// Check if input_byte would return without waiting
+int input_ready(void) {
+    if (input_position < input_length || input_mapped || input_ended) {
+        return 1;
+    }
+    struct pollfd fd = { input_fd, POLLIN, 0 };
+    return poll(&fd, 1, 0) > 0;
+}
+
+// Skip the first count bytes of the input; stdin is either the same file
+// or the same stream again
+void input_skip(long count) {
+    if (count <= 0) {
+        return;
+    }
+    if (input_mapped) {
+        input_position = (size_t)count < input_length ? (size_t)count : input_length;
+        return;
+    }
+    if (lseek(input_fd, count, SEEK_SET) == count) {
+        return;
+    }
+    for (long i = 0; i < count && input_byte() != EOF; i++) {
+    }
+}
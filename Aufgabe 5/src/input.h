@@ -0,0 +1,19 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+
+// Program input of the command line tools. stdin is read in blocks of this
+// size with read(2), an --input file is mapped; i/I take their bytes from
+// there without going through stdio.
+#define INPUT_BUFFER_SIZE (64 * 1024)
+
+// Function declarations
+int input_open(const char *path);
+int input_byte(void);
+int input_ready(void);
+void input_skip(long count);
+const char *map_file(const char *path, size_t *length);
+void unmap_file(const char *data, size_t length);
+
+#endif // INPUT_H
@@ -1,13 +1,93 @@
 #include "interpreter.h"
 #include "hashTable.h"
 #include "visualizer.h"
+#include "decoder.h"
+#include "trace.h"
+#include "jumpIndex.h"
+#include "renderThread.h"
+#include "output.h"
+#include "input.h"
+#include "loopDetector.h"
+#include "profile.h"
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-// Global grid definition
-int grid[GRID_HEIGHT][GRID_WIDTH];
+// Grid of the command line tools, including the border
+static int default_grid_cells[GRID_CELLS];
+_Thread_local int *grid_cells = default_grid_cells;
+
+_Thread_local struct run_context *run_context = NULL;
+
+// Set while errors are not printed (see mute_errors)
+static _Thread_local int errors_muted = 0;
+
+// Program output still in the stdout buffer is written first, so the error
+// shows up after it on a shared terminal
+void report_error(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    if (run_context) {
+        if (run_context->print_errors) {
+            va_list copy;
+            va_copy(copy, args);
+            vfprintf(stderr, format, copy);
+            va_end(copy);
+        }
+        vsnprintf(run_context->message, sizeof(run_context->message), format, args);
+        run_context->message[strcspn(run_context->message, "\n")] = '\0';
+    } else if (!errors_muted) {
+        output_flush();
+        vfprintf(stderr, format, args);
+    }
+    va_end(args);
+}
+
+// While muted, errors are not printed, like output while output_mute is
+// on; used to look ahead of the reported end of a run
+void mute_errors(int muted) {
+    errors_muted = muted;
+}
+
+// End the program; the exit code is 0 only for 'e'
+void stop_execution(enum pfusch_status status) {
+    if (run_context) {
+        longjmp(run_context->stop, (int)status + 1);
+    }
+    exit(status == PFUSCH_ENDED ? 0 : 1);
+}
+
+// Next input byte or EOF
+int read_input(void) {
+    int value;
+    if (run_context) {
+        const struct pfusch_io *io = run_context->io;
+        value = io->read ? io->read(io->user) : EOF;
+    } else {
+        value = input_byte();
+    }
+    if (value != EOF) {
+        input_bytes_read++;
+    }
+    return value;
+}
+
+void write_output(const char *bytes, int count) {
+    if (run_context) {
+        const struct pfusch_io *io = run_context->io;
+        if (io->write) {
+            io->write(io->user, bytes, count);
+        }
+        return;
+    }
+    output_block(bytes, count);
+}
 
 void init_grid(void) {
     for (int i = 0; i < GRID_HEIGHT; i++) {
@@ -17,11 +97,99 @@ void init_grid(void) {
     }
 }
 
-void load_program(FILE *fp) {
-    char line[GRID_WIDTH + 2];  // Extra space for newline and null terminator
+// Bytes a program row is read in; a longer line continues in the next row,
+// and its byte at column GRID_WIDTH is dropped, as with fgets
+#define ROW_CHUNK (GRID_WIDTH + 1)
+
+#define ONES 0x0101010101010101ULL
+#define HIGH_BITS 0x8080808080808080ULL
+
+// Mask with the high bit set in every zero, newline and 8-bit byte of word;
+// bits above the first such byte may be set wrongly, the first one is exact
+static inline uint64_t row_stops(uint64_t word) {
+    uint64_t newlines = word ^ (ONES * '\n');
+    return ((word - ONES) & ~word) | ((newlines - ONES) & ~newlines) | word;
+}
+
+// Text that does not fit the grid is not loaded: the byte at column
+// GRID_WIDTH + 1 of a full row, and everything after row GRID_HEIGHT. The
+// command line tools say so once, at the first such character.
+static void warn_outside_grid(int row, int col) {
+    if (run_context && !run_context->print_errors) {
+        return;
+    }
+    output_flush();
+    fprintf(stderr, "Warning: Program text outside the %dx%d grid is ignored (first at row %d, column %d)\n",
+            GRID_HEIGHT, GRID_WIDTH, row, col);
+}
+
+// Note the first full row whose byte at column GRID_WIDTH + 1 is not its
+// line end, unless an earlier one was noted
+static void check_row_end(const unsigned char *line, size_t length, int y, int *outside_row, int *outside_col) {
+    if (*outside_row == 0 && length > GRID_WIDTH && line[GRID_WIDTH] != '\n' && line[GRID_WIDTH] != '\0') {
+        *outside_row = y + 1;
+        *outside_col = GRID_WIDTH + 1;
+    }
+}
+
+// Load the rows of the program in data; returns the bytes consumed, or -1
+// with *row, *col and *ch set at an 8-bit character. *outside_row and
+// *outside_col are set at the first byte of a row that does not fit.
+static long scan_program(const unsigned char *data, size_t size, int *row, int *col, int *ch,
+                         int *outside_row, int *outside_col) {
+    size_t position = 0;
+    for (int y = 0; y < GRID_HEIGHT && position < size; y++) {
+        const unsigned char *line = data + position;
+        size_t chunk = size - position < ROW_CHUNK ? size - position : ROW_CHUNK;
+        size_t cells = chunk < GRID_WIDTH ? chunk : GRID_WIDTH;
+
+        // Find the first newline, zero or 8-bit byte eight bytes at a time
+        size_t x = 0;
+        for (; x + 8 <= cells; x += 8) {
+            uint64_t word;
+            memcpy(&word, line + x, 8);
+            uint64_t stops = row_stops(word) & HIGH_BITS;
+            if (stops) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                x += (size_t)__builtin_clzll(stops) / 8;
+#else
+                x += (size_t)__builtin_ctzll(stops) / 8;
+#endif
+                break;
+            }
+        }
+        while (x < cells && line[x] != '\n' && line[x] != '\0' && line[x] <= 127) {
+            x++;
+        }
+        if (x < cells && line[x] > 127) {
+            *row = y + 1;
+            *col = (int)x + 1;
+            *ch = line[x];
+            return -1;
+        }
+        for (size_t i = 0; i < x; i++) {
+            grid[y][i] = line[i];
+        }
+        if (x == cells) {
+            check_row_end(line, chunk, y, outside_row, outside_col);
+        }
+
+        // The row ends after its newline or ROW_CHUNK bytes
+        const unsigned char *newline = memchr(line + x, '\n', chunk - x);
+        position += newline ? (size_t)(newline - line) + 1 : chunk;
+    }
+    return (long)position;
+}
+
+// fgets reads streams that cannot be mapped, so no byte past the last row
+// is taken from them
+static void read_program(FILE *fp) {
+    char line[ROW_CHUNK + 1];  // Extra space for the null terminator
+    int outside_row = 0, outside_col = 0;
     for (int row = 0; row < GRID_HEIGHT; row++) {
         if (!fgets(line, sizeof(line), fp))
             break;
+        check_row_end((const unsigned char *)line, strlen(line), row, &outside_row, &outside_col);
 
         for (int col = 0; col < GRID_WIDTH && line[col] != '\n' && line[col] != '\0'; col++) {
             unsigned char ch = (unsigned char)line[col];
@@ -29,12 +197,77 @@ void load_program(FILE *fp) {
             if (ch <= 127) {
                 grid[row][col] = ch;
             } else {
-                fprintf(stderr, "Error: Invalid character at line %d, column %d: ASCII %d (must be 7-bit ASCII)\n", 
-                       row + 1, col + 1, ch);
-                exit(1);
+                report_error("Error: Invalid character at line %d, column %d: ASCII %d (must be 7-bit ASCII)\n",
+                             row + 1, col + 1, ch);
+                stop_execution(PFUSCH_LOAD_ERROR);
             }
         }
     }
+    if (outside_row) {
+        warn_outside_grid(outside_row, outside_col);
+    }
+}
+
+// Row and column of the first character after the loaded rows, 0 if only
+// blanks and line ends follow
+static void find_text_after(const unsigned char *rest, size_t length, int *outside_row, int *outside_col) {
+    int row = GRID_HEIGHT + 1;
+    int col = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (rest[i] == '\n') {
+            row++;
+            col = 1;
+        } else if (rest[i] == ' ' || rest[i] == '\r') {
+            col++;
+        } else {
+            *outside_row = row;
+            *outside_col = col;
+            return;
+        }
+    }
+}
+
+// Regular files are mapped and scanned in place; the stream is left after
+// the last row, as if it had been read
+void load_program(FILE *fp) {
+    struct stat info;
+    int fd = fileno(fp);
+    off_t start = fd >= 0 ? ftello(fp) : -1;
+    if (start < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= start) {
+        read_program(fp);
+        return;
+    }
+    // The whole file is mapped, but only the pages up to the first
+    // character after the grid are read
+    size_t total = (size_t)(info.st_size - start);
+    size_t size = total;
+    size_t limit = (size_t)GRID_HEIGHT * ROW_CHUNK;
+    if (size > limit) {
+        size = limit;
+    }
+    off_t page = start - start % sysconf(_SC_PAGESIZE);
+    void *mapping = mmap(NULL, total + (size_t)(start - page), PROT_READ, MAP_PRIVATE, fd, page);
+    if (mapping == MAP_FAILED) {
+        read_program(fp);
+        return;
+    }
+    const unsigned char *data = (const unsigned char *)mapping + (start - page);
+    int row = 0, col = 0, ch = 0;
+    int outside_row = 0, outside_col = 0;
+    long consumed = scan_program(data, size, &row, &col, &ch, &outside_row, &outside_col);
+    if (consumed >= 0 && outside_row == 0) {
+        find_text_after(data + consumed, total - (size_t)consumed, &outside_row, &outside_col);
+    }
+    munmap(mapping, total + (size_t)(start - page));
+    if (consumed < 0) {
+        report_error("Error: Invalid character at line %d, column %d: ASCII %d (must be 7-bit ASCII)\n",
+                     row, col, ch);
+        stop_execution(PFUSCH_LOAD_ERROR);
+    }
+    if (outside_row) {
+        warn_outside_grid(outside_row, outside_col);
+    }
+    fseeko(fp, start + consumed, SEEK_SET);
 }
 
 void turnLeft(struct instructionPointer *ip) {
@@ -55,10 +288,73 @@ void turnRight(struct instructionPointer *ip) {
     }
 }
 
+// Reallocate the entries of s; -1 when out of memory, s is unchanged then
+static int stack_resize(struct stack *s, int capacity) {
+    int *data = realloc(s->data, (size_t)capacity * sizeof(int));
+    if (!data) {
+        return -1;
+    }
+    s->data = data;
+    s->capacity = capacity;
+    return 0;
+}
+
+// A stack could not grow: ends the run like any other error
+static void stack_out_of_memory(void) {
+    report_error("Error: Out of memory while growing the stack\n");
+    stop_execution(PFUSCH_OUT_OF_MEMORY);
+}
+
+// Empty stack with room for STACK_SIZE entries, or limit if that is less;
+// -1 when out of memory
+int stack_init(struct stack *s, int limit) {
+    s->top = -1;
+    s->limit = limit > 0 ? limit : 1;
+    s->capacity = 0;
+    s->data = NULL;
+    return stack_resize(s, s->limit < STACK_SIZE ? s->limit : STACK_SIZE);
+}
+
+void stack_free(struct stack *s) {
+    free(s->data);
+    s->data = NULL;
+    s->capacity = 0;
+}
+
+// Make room for depth entries; the capacity doubles, so a run of pushes
+// reallocates only a logarithmic number of times. Returns -1 if depth
+// exceeds the limit; running out of memory stops the run.
+int stack_grow(struct stack *s, int depth) {
+    if (depth > s->limit) {
+        return -1;
+    }
+    if (depth > s->capacity) {
+        long capacity = (long)s->capacity * 2;
+        capacity = capacity < depth ? depth : capacity;
+        if (stack_resize(s, capacity < s->limit ? (int)capacity : s->limit) != 0) {
+            stack_out_of_memory();
+        }
+    }
+    return 0;
+}
+
+// Copy the top count entries of from (and its depth and limit) into to,
+// which grows to the depth of from regardless of its own limit
+void stack_copy(struct stack *to, const struct stack *from, int count) {
+    if (from->top + 1 > to->capacity && stack_resize(to, from->top + 1) != 0) {
+        stack_out_of_memory();
+    }
+    to->top = from->top;
+    to->limit = from->limit;
+    if (count > 0) {
+        memcpy(&to->data[from->top - count + 1], &from->data[from->top - count + 1], count * sizeof(int));
+    }
+}
+
 // Stack operations
 int stack_push(struct stack *s, int value) {
-    if (s->top >= STACK_SIZE - 1) {
-        fprintf(stderr, "Error: Stack overflow\n");
+    if (s->top >= s->capacity - 1 && stack_grow(s, s->top + 2) != 0) {
+        report_error("Error: Stack overflow\n");
         return -1;
     }
     s->data[++s->top] = value;
@@ -67,7 +363,7 @@ int stack_push(struct stack *s, int value) {
 
 int stack_pop(struct stack *s, int *value) {
     if (s->top < 0) {
-        fprintf(stderr, "Error: Stack underflow - cannot pop from empty stack\n");
+        report_error("Error: Stack underflow - cannot pop from empty stack\n");
         return -1;
     }
     *value = s->data[s->top--];
@@ -76,7 +372,7 @@ int stack_pop(struct stack *s, int *value) {
 
 int stack_peek(struct stack *s, int *value) {
     if (s->top < 0) {
-        fprintf(stderr, "Error: Stack is empty - cannot peek\n");
+        report_error("Error: Stack is empty - cannot peek\n");
         return -1;
     }
     *value = s->data[s->top];
@@ -86,8 +382,8 @@ int stack_peek(struct stack *s, int *value) {
 // Helper function to get cell value with bounds checking
 int get_cell_value(int x, int y) {
     if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT) {
-        fprintf(stderr, "Error: Accessing cell outside bounds (%d, %d)\n", x, y);
-        exit(1);
+        report_error("Error: Accessing cell outside bounds (%d, %d)\n", x, y);
+        stop_execution(PFUSCH_CELL_OUT_OF_BOUNDS);
     }
     return grid[y][x];
 }
@@ -95,48 +391,57 @@ int get_cell_value(int x, int y) {
 // Helper function to set cell value with bounds checking
 void set_cell_value(int x, int y, int value) {
     if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT) {
-        fprintf(stderr, "Error: Setting cell outside bounds (%d, %d)\n", x, y);
-        exit(1);
+        report_error("Error: Setting cell outside bounds (%d, %d)\n", x, y);
+        stop_execution(PFUSCH_CELL_OUT_OF_BOUNDS);
+    }
+    if (program_image[y][x].fixed) {
+        release_fixed_cells();      // the analysis missed this write
+    }
+    update_jump_index(x, y, grid[y][x], value);
+    grid_hash ^= cell_hash(x, y, grid[y][x]) ^ cell_hash(x, y, value);
+    // Traces read operand cells from the grid, so they only depend on the
+    // opcodes of their cells; the profiler counts runs per character and
+    // needs them folded first
+    if (active_profile || cell_opcode(y, value) != program_image[y][x].opcode) {
+        invalidate_traces_at(x, y);
+    }
+    if (active_profile) {
+        profile_cell_write(x, y);   // counts the old instruction's executions
     }
     grid[y][x] = value;
+    decode_cell(x, y);  // keep the decoded image in sync with self-modification
+    note_grid_write(x, y);
 }
 
 // Jump functions
 int jump_in_direction(struct instructionPointer *ip, enum direction dir, int target_value) {
-    int x = ip->x;
-    int y = ip->y;
-    
-    // Move in the specified direction until we find the target or hit boundary
-    while (1) {
-        switch (dir) {
-            case LEFT: x--; break;
-            case RIGHT: x++; break;
-            case UP: y--; break;
-            case DOWN: y++; break;
-        }
-        
-        // Check bounds
-        if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT) {
-            return -1; // Target not found
-        }
-        
-        if (grid[y][x] == target_value) {
-            ip->x = x;
-            ip->y = y;
-            ip->direction = dir;
-            return 0; // Found target
-        }
+    // Look up the nearest matching cell in the row or column index
+    int pos = find_jump_target(ip->x, ip->y, dir, target_value);
+    if (pos < 0) {
+        return -1; // Target not found
     }
+
+    if (dir == LEFT || dir == RIGHT) {
+        ip->x = pos;
+    } else {
+        ip->y = pos;
+    }
+    ip->direction = dir;
+    return 0; // Found target
 }
 
 void execute_step(struct state *state) {
-    char current_instruction = grid[state->ip.y][state->ip.x];
+    char current_instruction = grid_cells[GRID_INDEX(state->ip.x, state->ip.y)];
+    struct profile *profile = active_profile;
+    if (profile) {
+        profile->hits[GRID_INDEX(state->ip.x, state->ip.y)]++;
+    }
     
     // Check if character is valid 7-bit ASCII
     if ((unsigned char)current_instruction > 127) {
-        fprintf(stderr, "Error: Invalid instruction at (%d, %d): ASCII %d (must be 7-bit ASCII)\n", 
-               state->ip.x, state->ip.y, (unsigned char)current_instruction);
-        exit(1);
+        report_error("Error: Invalid instruction at (%d, %d): ASCII %d (must be 7-bit ASCII)\n",
+                     state->ip.x, state->ip.y, (unsigned char)current_instruction);
+        stop_execution(PFUSCH_INVALID_INSTRUCTION);
     }
     
     // Try to get instruction handler from hash table
@@ -144,20 +449,27 @@ void execute_step(struct state *state) {
     
     if (handler != NULL) {
         // Execute the instruction using the function pointer
+        struct instructionPointer before = state->ip;
         handler(state);
+        if (profile) {
+            profile_stack(profile, state->stack.top);
+        }
         
         // Special case: Jump instructions handle their own IP movement
         if (current_instruction == 'H' || current_instruction == 'J' || 
             current_instruction == 'K' || current_instruction == 'L') {
+            if (profile) {
+                profile_jump(profile, state->ip.x - before.x + state->ip.y - before.y);
+            }
             return; // Don't move IP again
         }
     } else {
         // Character is not a valid instruction - treat as no-op for valid ASCII
         // This handles digits, letters, and other printable characters
         if ((unsigned char)current_instruction < 32) {
-            fprintf(stderr, "Error: Invalid instruction at (%d, %d): ASCII %d (control character)\n", 
-                   state->ip.x, state->ip.y, (unsigned char)current_instruction);
-            exit(1);
+            report_error("Error: Invalid instruction at (%d, %d): ASCII %d (control character)\n",
+                         state->ip.x, state->ip.y, (unsigned char)current_instruction);
+            stop_execution(PFUSCH_INVALID_INSTRUCTION);
         }
         // Valid printable ASCII characters that aren't instructions are treated as no-ops
     }
@@ -166,29 +478,29 @@ void execute_step(struct state *state) {
     switch (state->ip.direction) {
         case UP:
             if (state->ip.y <= 0) {
-                fprintf(stderr, "Error: Instruction pointer moved outside bounds (UP)\n");
-                exit(1);
+                report_error("Error: Instruction pointer moved outside bounds (UP)\n");
+                stop_execution(PFUSCH_OUT_OF_BOUNDS);
             }
             state->ip.y--;
             break;
         case DOWN:
             if (state->ip.y >= GRID_HEIGHT - 1) {
-                fprintf(stderr, "Error: Instruction pointer moved outside bounds (DOWN)\n");
-                exit(1);
+                report_error("Error: Instruction pointer moved outside bounds (DOWN)\n");
+                stop_execution(PFUSCH_OUT_OF_BOUNDS);
             }
             state->ip.y++;
             break;
         case LEFT:
             if (state->ip.x <= 0) {
-                fprintf(stderr, "Error: Instruction pointer moved outside bounds (LEFT)\n");
-                exit(1);
+                report_error("Error: Instruction pointer moved outside bounds (LEFT)\n");
+                stop_execution(PFUSCH_OUT_OF_BOUNDS);
             }
             state->ip.x--;
             break;
         case RIGHT:
             if (state->ip.x >= GRID_WIDTH - 1) {
-                fprintf(stderr, "Error: Instruction pointer moved outside bounds (RIGHT)\n");
-                exit(1);
+                report_error("Error: Instruction pointer moved outside bounds (RIGHT)\n");
+                stop_execution(PFUSCH_OUT_OF_BOUNDS);
             }
             state->ip.x++;
             break;
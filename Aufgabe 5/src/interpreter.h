@@ -2,18 +2,35 @@
 #define INTERPRETER_H
 
 #include <stdio.h>
+#include <setjmp.h>
+#include "pfusch.h"
 
 #define GRID_HEIGHT 42
 #define GRID_WIDTH 69
 #define STACK_SIZE 1000
 
-// Global grid
-extern int grid[GRID_HEIGHT][GRID_WIDTH];
+// The grid is stored as one flat array of rows with a one-cell sentinel
+// border on every side, so neighbours are always at a fixed offset
+#define GRID_STRIDE (GRID_WIDTH + 2)
+#define GRID_CELLS ((GRID_HEIGHT + 2) * GRID_STRIDE)
+#define GRID_INDEX(x, y) (((y) + 1) * GRID_STRIDE + (x) + 1)
 
-// Stack structure
+// Grid of the running program; grid[y][x] is the cell at (x, y) on the
+// board. Border cells lie outside the rows of the macro and are reached
+// through the flat array, as grid_cells[GRID_INDEX(x, y)]. The command
+// line tools use one static grid, each libpfusch instance switches in its
+// own (see pfusch.c).
+extern _Thread_local int *grid_cells;
+#define grid ((int (*)[GRID_STRIDE])(grid_cells + GRID_STRIDE + 1))
+
+// Stack structure. data holds capacity entries and grows on demand (see
+// stack_grow) up to limit entries, the depth at which a push overflows:
+// STACK_SIZE unless --stack-size (or pfusch_set_stack_size) raises it.
 struct stack {
-    int top;
-    int data[STACK_SIZE];
+    int top;                            // first member, native traces read it at [rdi]
+    int capacity;
+    int limit;
+    int *data;
 };
 
 // Direction enumeration
@@ -37,9 +54,42 @@ struct state {
     struct instructionPointer ip;
 };
 
+// Set while a libpfusch instance runs on this thread: errors are recorded
+// here and stop the run instead of the process
+struct run_context {
+    jmp_buf stop;                       // target of stop_execution
+    const struct pfusch_io *io;
+    char message[256];                  // last error reported
+    int print_errors;                   // also print every error to stderr as without a context
+    long steps;                         // steps run_program completed before it was stopped
+};
+extern _Thread_local struct run_context *run_context;
+
 // Function declarations
 void init_grid(void);
 void load_program(FILE *fp);
 void execute_step(struct state *state);
 
+// Helper functions shared by the instruction handlers and the dispatch engine
+void turnLeft(struct instructionPointer *ip);
+void turnRight(struct instructionPointer *ip);
+int stack_init(struct stack *s, int limit);
+void stack_free(struct stack *s);
+int stack_grow(struct stack *s, int depth);
+void stack_copy(struct stack *to, const struct stack *from, int count);
+int stack_push(struct stack *s, int value);
+int stack_pop(struct stack *s, int *value);
+int stack_peek(struct stack *s, int *value);
+int get_cell_value(int x, int y);
+void set_cell_value(int x, int y, int value);
+int jump_in_direction(struct instructionPointer *ip, enum direction dir, int target_value);
+
+// Error reporting and program I/O; without a run context they print to
+// stderr and exit, read stdin and write to the output buffer
+void report_error(const char *format, ...);
+void mute_errors(int muted);
+_Noreturn void stop_execution(enum pfusch_status status);
+int read_input(void);
+void write_output(const char *bytes, int count);
+
 #endif
\ No newline at end of file
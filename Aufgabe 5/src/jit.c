@@ -0,0 +1,373 @@
+#include "jit.h"
+#include "hashTable.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Build with -DPFUSCH_JIT (make JIT=1) to compile hot traces to x86-64
+#if defined(PFUSCH_JIT) && defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+int jit_enabled = JIT_SUPPORTED;
+
+#if JIT_SUPPORTED
+
+#define CODE_CACHE_SIZE (1 << 20)
+
+// Executable code cache; native traces are bump-allocated and the whole
+// cache is flushed when it runs full
+static unsigned char *code_cache = NULL;
+static size_t code_used = 0;
+
+// Direction after x/X turns, indexed by enum direction
+static const enum direction right_of[4] = { RIGHT, LEFT, UP, DOWN };
+static const enum direction left_of[4] = { LEFT, RIGHT, DOWN, UP };
+
+// Short conditional jumps (rel8)
+#define JL 0x7C
+#define JGE 0x7D
+#define JLE 0x7E
+#define JNS 0x79
+#define JNZ 0x75
+
+struct emitter {
+    unsigned char *pos;
+    unsigned char *limit;
+};
+
+static void emit(struct emitter *e, const unsigned char *bytes, size_t count) {
+    if (e->pos + count <= e->limit) {
+        memcpy(e->pos, bytes, count);
+    }
+    e->pos += count;  // overflow is checked once the trace is emitted
+}
+
+#define EMIT(e, ...) do { \
+        static const unsigned char bytes_[] = { __VA_ARGS__ }; \
+        emit((e), bytes_, sizeof(bytes_)); \
+    } while (0)
+
+static void emit32(struct emitter *e, uint32_t value) {
+    emit(e, (const unsigned char *)&value, 4);
+}
+
+static void emit64(struct emitter *e, uint64_t value) {
+    emit(e, (const unsigned char *)&value, 8);
+}
+
+// Store top back into the stack and return result (8 bytes)
+static void emit_exit(struct emitter *e, int result) {
+    EMIT(e, 0x89, 0x0F);                    // mov [rdi], ecx
+    EMIT(e, 0xB8);                          // mov eax, result
+    emit32(e, (uint32_t)result);
+    EMIT(e, 0xC3);                          // ret
+}
+
+// Side exit to the interpreter at op k unless the skip condition holds
+static void emit_guard(struct emitter *e, unsigned char skip_jcc, int k) {
+    unsigned char jump[2] = { skip_jcc, 8 };
+    emit(e, jump, 2);
+    emit_exit(e, k);
+}
+
+static void emit_guard_not_empty(struct emitter *e, int k) {
+    EMIT(e, 0x85, 0xC9);                    // test ecx, ecx
+    emit_guard(e, JNS, k);
+}
+
+// A push that needs the stack to grow is left to the interpreter
+static void emit_guard_room(struct emitter *e, int k) {
+    EMIT(e, 0x8D, 0x41, 0x01);              // lea eax, [rcx + 1]
+    EMIT(e, 0x3B, 0x47, offsetof(struct stack, capacity));  // cmp eax, [rdi + capacity]
+    emit_guard(e, JL, k);
+}
+
+// Load the operand cell into eax (or r8d)
+static void emit_load_operand(struct emitter *e, int *operand, int to_r8) {
+    EMIT(e, 0x48, 0xB8);                    // mov rax, operand
+    emit64(e, (uint64_t)(uintptr_t)operand);
+    if (to_r8) {
+        EMIT(e, 0x44, 0x8B, 0x00);          // mov r8d, [rax]
+    } else {
+        EMIT(e, 0x8B, 0x00);                // mov eax, [rax]
+    }
+}
+
+static int *operand_of(const struct trace_op *op) {
+    switch ((enum opcode)op->opcode) {
+        case OP_STORE_BELOW: case OP_ADD_BELOW: case OP_REDUCE_BELOW:
+        case OP_MULTIPLY_BELOW: case OP_DIVIDE_BELOW: case OP_MODULO_BELOW:
+            return op->cell->value + GRID_STRIDE;
+        default:
+            return op->cell->value - GRID_STRIDE;
+    }
+}
+
+// Emit op k; ops touching the grid or stdio and ops that must fail are
+// left to the interpreter through a side exit
+static void emit_op(struct emitter *e, const struct trace_op *op, int k) {
+    enum opcode opcode = (enum opcode)op->opcode;
+    int *operand = operand_of(op);
+
+    switch (opcode) {
+        case OP_STORE_BELOW:
+        case OP_STORE_ABOVE:
+            emit_guard_room(e, k);
+            emit_load_operand(e, operand, 0);
+            EMIT(e, 0x48, 0xFF, 0xC1);          // inc rcx
+            EMIT(e, 0x41, 0x89, 0x04, 0x89);    // mov [r9 + rcx*4], eax
+            return;
+        case OP_DUPLICATE:
+            emit_guard_not_empty(e, k);
+            emit_guard_room(e, k);
+            EMIT(e, 0x41, 0x8B, 0x04, 0x89);    // mov eax, [r9 + rcx*4]
+            EMIT(e, 0x48, 0xFF, 0xC1);          // inc rcx
+            EMIT(e, 0x41, 0x89, 0x04, 0x89);    // mov [r9 + rcx*4], eax
+            return;
+        case OP_DELETE:
+            emit_guard_not_empty(e, k);
+            EMIT(e, 0x48, 0xFF, 0xC9);          // dec rcx
+            return;
+        case OP_ADD_BELOW:
+        case OP_ADD_ABOVE:
+        case OP_REDUCE_BELOW:
+        case OP_REDUCE_ABOVE:
+            emit_guard_not_empty(e, k);
+            emit_load_operand(e, operand, 0);
+            if (opcode == OP_ADD_BELOW || opcode == OP_ADD_ABOVE) {
+                EMIT(e, 0x41, 0x01, 0x04, 0x89);    // add [r9 + rcx*4], eax
+            } else {
+                EMIT(e, 0x41, 0x29, 0x04, 0x89);    // sub [r9 + rcx*4], eax
+            }
+            return;
+        case OP_MULTIPLY_BELOW:
+        case OP_MULTIPLY_ABOVE:
+            emit_guard_not_empty(e, k);
+            emit_load_operand(e, operand, 0);
+            EMIT(e, 0x41, 0x8B, 0x14, 0x89);    // mov edx, [r9 + rcx*4]
+            EMIT(e, 0x0F, 0xAF, 0xD0);          // imul edx, eax
+            EMIT(e, 0x41, 0x89, 0x14, 0x89);    // mov [r9 + rcx*4], edx
+            return;
+        case OP_DIVIDE_BELOW:
+        case OP_DIVIDE_ABOVE:
+        case OP_MODULO_BELOW:
+        case OP_MODULO_ABOVE:
+            emit_guard_not_empty(e, k);
+            emit_load_operand(e, operand, 1);
+            EMIT(e, 0x45, 0x85, 0xC0);          // test r8d, r8d
+            emit_guard(e, JNZ, k);
+            EMIT(e, 0x41, 0x8B, 0x04, 0x89);    // mov eax, [r9 + rcx*4]
+            EMIT(e, 0x99);                      // cdq
+            EMIT(e, 0x41, 0xF7, 0xF8);          // idiv r8d
+            if (opcode == OP_DIVIDE_BELOW || opcode == OP_DIVIDE_ABOVE) {
+                EMIT(e, 0x41, 0x89, 0x04, 0x89);    // mov [r9 + rcx*4], eax
+            } else {
+                EMIT(e, 0x41, 0x89, 0x14, 0x89);    // mov [r9 + rcx*4], edx
+            }
+            return;
+        case OP_PUSH_CONSTANT:
+            emit_guard_room(e, k);
+            EMIT(e, 0xB8);                      // mov eax, immediate
+            emit32(e, (uint32_t)op->immediate);
+            EMIT(e, 0x48, 0xFF, 0xC1);          // inc rcx
+            EMIT(e, 0x41, 0x89, 0x04, 0x89);    // mov [r9 + rcx*4], eax
+            return;
+        case OP_ADD_CONSTANT:
+            emit_guard_not_empty(e, k);
+            EMIT(e, 0x41, 0x81, 0x04, 0x89);    // add dword [r9 + rcx*4], immediate
+            emit32(e, (uint32_t)op->immediate);
+            return;
+        case OP_REDUCE_CONSTANT:
+            emit_guard_not_empty(e, k);
+            EMIT(e, 0x41, 0x81, 0x2C, 0x89);    // sub dword [r9 + rcx*4], immediate
+            emit32(e, (uint32_t)op->immediate);
+            return;
+        case OP_MULTIPLY_CONSTANT:
+            emit_guard_not_empty(e, k);
+            EMIT(e, 0x41, 0x69, 0x14, 0x89);    // imul edx, [r9 + rcx*4], immediate
+            emit32(e, (uint32_t)op->immediate);
+            EMIT(e, 0x41, 0x89, 0x14, 0x89);    // mov [r9 + rcx*4], edx
+            return;
+        case OP_DIVIDE_CONSTANT:
+        case OP_MODULO_CONSTANT:
+            // The divisor is known not to be zero
+            emit_guard_not_empty(e, k);
+            EMIT(e, 0x41, 0xB8);                // mov r8d, immediate
+            emit32(e, (uint32_t)op->immediate);
+            EMIT(e, 0x41, 0x8B, 0x04, 0x89);    // mov eax, [r9 + rcx*4]
+            EMIT(e, 0x99);                      // cdq
+            EMIT(e, 0x41, 0xF7, 0xF8);          // idiv r8d
+            if (opcode == OP_DIVIDE_CONSTANT) {
+                EMIT(e, 0x41, 0x89, 0x04, 0x89);    // mov [r9 + rcx*4], eax
+            } else {
+                EMIT(e, 0x41, 0x89, 0x14, 0x89);    // mov [r9 + rcx*4], edx
+            }
+            return;
+        default:
+            break;
+    }
+    emit_exit(e, k);
+}
+
+static int turned(int k, enum direction dir) {
+    return k | NATIVE_TURNED | ((int)dir << 17);
+}
+
+// Check if the cell ending the trace can be executed natively
+static int has_native_exit(const struct trace *trace) {
+    switch ((enum opcode)trace->exit->opcode) {
+        case OP_LEFT: case OP_DOWN: case OP_UP: case OP_RIGHT:
+        case OP_TURN_RIGHT: case OP_TURN_LEFT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Emit the cell ending the trace: direction setters and x/X turns
+static void emit_exit_cell(struct emitter *e, const struct trace *trace) {
+    int n = trace->op_count;
+    enum direction dir = trace->direction;
+
+    if (!has_native_exit(trace)) {
+        emit_exit(e, n);
+        return;
+    }
+    switch ((enum opcode)trace->exit->opcode) {
+        case OP_LEFT: emit_exit(e, turned(n, LEFT)); return;
+        case OP_DOWN: emit_exit(e, turned(n, DOWN)); return;
+        case OP_UP: emit_exit(e, turned(n, UP)); return;
+        case OP_RIGHT: emit_exit(e, turned(n, RIGHT)); return;
+        case OP_TURN_RIGHT:
+        case OP_TURN_LEFT:
+            // An empty stack is reported by the interpreter
+            emit_guard_not_empty(e, n);
+            EMIT(e, 0x41, 0x8B, 0x04, 0x89);    // mov eax, [r9 + rcx*4]
+            EMIT(e, 0x85, 0xC0);                // test eax, eax
+            if (trace->exit->opcode == OP_TURN_RIGHT) {
+                emit_guard(e, JLE, turned(n, right_of[dir]));
+            } else {
+                emit_guard(e, JGE, turned(n, left_of[dir]));
+            }
+            emit_exit(e, turned(n, dir));
+            return;
+        default:
+            return;
+    }
+}
+
+// Emit a whole trace at e->pos. The code starts with a jump through a table
+// so that the interpreter can resume it after any op it executed itself.
+// The code gets the stack in rdi (top at [rdi]) and keeps the top index in
+// rcx and the entries in r9; only the interpreter grows the stack.
+static void emit_trace(struct emitter *e, const struct trace *trace) {
+    int n = trace->op_count;
+    unsigned char *labels[n + 1];
+
+    EMIT(e, 0x48, 0x63, 0x0F);                  // movsxd rcx, dword [rdi]
+    EMIT(e, 0x4C, 0x8B, 0x4F, offsetof(struct stack, data));   // mov r9, [rdi + data]
+    EMIT(e, 0x48, 0x63, 0xF6);                  // movsxd rsi, esi
+    EMIT(e, 0x48, 0x8D, 0x05);                  // lea rax, [rip + table]
+    unsigned char *table_disp = e->pos;
+    emit32(e, 0);
+    unsigned char *after_lea = e->pos;
+    EMIT(e, 0xFF, 0x24, 0xF0);                  // jmp [rax + rsi*8]
+
+    for (int k = 0; k < n; k++) {
+        labels[k] = e->pos;
+        emit_op(e, &trace->ops[k], k);
+    }
+    labels[n] = e->pos;
+    emit_exit_cell(e, trace);
+
+    while ((uintptr_t)e->pos % 8 != 0) {
+        EMIT(e, 0xCC);                          // int3 padding
+    }
+    unsigned char *table = e->pos;
+    for (int k = 0; k <= n; k++) {
+        emit64(e, (uint64_t)(uintptr_t)labels[k]);
+    }
+    if (e->pos <= e->limit) {
+        int32_t disp = (int32_t)(table - after_lea);
+        memcpy(table_disp, &disp, 4);
+    }
+}
+
+static int open_code_cache(void) {
+    if (code_cache) {
+        return 0;
+    }
+    void *memory = mmap(NULL, CODE_CACHE_SIZE, PROT_READ | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        jit_enabled = 0;
+        return -1;
+    }
+    code_cache = memory;
+    return 0;
+}
+
+// Drop all native code; traces fall back to the interpreter until hot again
+static void flush_code_cache(void) {
+    for (int i = 0; i < GRID_CELLS * 4; i++) {
+        struct trace *trace = trace_cache->slots[i];
+        if (trace) {
+            trace->native = NULL;
+            trace->hits = 0;
+        }
+    }
+    code_used = 0;
+}
+
+// Compile a hot trace; the pages are only writable while emitting. The code
+// cache belongs to the command line tools, libpfusch instances stay interpreted.
+void jit_compile_trace(struct trace *trace) {
+    if (!jit_enabled || run_context || (trace->op_count == 0 && !has_native_exit(trace))) {
+        return;
+    }
+    if (open_code_cache() != 0) {
+        return;
+    }
+    if (mprotect(code_cache, CODE_CACHE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        jit_enabled = 0;
+        return;
+    }
+    for (int attempt = 0; attempt < 2; attempt++) {
+        struct emitter e = { code_cache + code_used, code_cache + CODE_CACHE_SIZE };
+        unsigned char *start = e.pos;
+        emit_trace(&e, trace);
+        if (e.pos <= e.limit) {
+            code_used = (size_t)(e.pos - code_cache);
+            trace->native = (native_trace_t)(void *)start;
+            break;
+        }
+        flush_code_cache();
+    }
+    if (mprotect(code_cache, CODE_CACHE_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        jit_enabled = 0;
+        trace->native = NULL;
+    }
+}
+
+void jit_shutdown(void) {
+    if (code_cache) {
+        flush_code_cache();
+        munmap(code_cache, CODE_CACHE_SIZE);
+        code_cache = NULL;
+    }
+}
+
+#else
+
+void jit_compile_trace(struct trace *trace) {
+    (void)trace;
+}
+
+void jit_shutdown(void) {
+}
+
+#endif
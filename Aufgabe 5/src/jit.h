@@ -0,0 +1,24 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "trace.h"
+
+// Result of a native trace: the number of trace ops it completed and, if it
+// also executed the cell ending the trace, the direction it left with
+#define NATIVE_TURNED 0x10000
+#define NATIVE_OPS_DONE(result) ((result) & 0xFFFF)
+#define NATIVE_DIRECTION(result) ((enum direction)(((result) >> 17) & 3))
+
+// Number of entries into a trace before it is compiled
+#ifndef JIT_HOT_THRESHOLD
+#define JIT_HOT_THRESHOLD 64
+#endif
+
+// Cleared by --no-jit; always 0 when the JIT is not built in
+extern int jit_enabled;
+
+// Function declarations
+void jit_compile_trace(struct trace *trace);
+void jit_shutdown(void);
+
+#endif // JIT_H
@@ -0,0 +1,92 @@
+#include "jumpIndex.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Jump index of the command line tools
+static struct jump_index default_jump_index;
+_Thread_local struct jump_index *jump_index = &default_jump_index;
+
+static int compare_entries(const void *a, const void *b) {
+    const struct jump_entry *ea = a;
+    const struct jump_entry *eb = b;
+    if (ea->value != eb->value) {
+        return ea->value < eb->value ? -1 : 1;
+    }
+    return ea->pos - eb->pos;
+}
+
+// Index of the first entry not less than (value, pos)
+static int lower_bound(const struct jump_entry *entries, int count, int value, int pos) {
+    int low = 0;
+    int high = count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (entries[mid].value < value || (entries[mid].value == value && entries[mid].pos < pos)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Move the entry for pos from old_value to new_value, keeping the order
+static void update_line(struct jump_entry *entries, int count, int pos, int old_value, int new_value) {
+    int from = lower_bound(entries, count, old_value, pos);
+    int to = lower_bound(entries, count, new_value, pos);
+    if (to > from) {
+        to--;   // the removed entry no longer sits in front of the new slot
+        memmove(&entries[from], &entries[from + 1], (to - from) * sizeof(struct jump_entry));
+    } else {
+        memmove(&entries[to + 1], &entries[to], (from - to) * sizeof(struct jump_entry));
+    }
+    entries[to].value = new_value;
+    entries[to].pos = pos;
+}
+
+// Nearest position after 'from' (forward) or before it holding value, or -1
+static int find_in_line(const struct jump_entry *entries, int count, int from, int forward, int value) {
+    if (forward) {
+        int i = lower_bound(entries, count, value, from + 1);
+        return i < count && entries[i].value == value ? entries[i].pos : -1;
+    }
+    int i = lower_bound(entries, count, value, from) - 1;
+    return i >= 0 && entries[i].value == value ? entries[i].pos : -1;
+}
+
+// Build the row and column indexes from the loaded grid
+void build_jump_index(void) {
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            jump_index->rows[y][x].value = grid[y][x];
+            jump_index->rows[y][x].pos = x;
+            jump_index->columns[x][y].value = grid[y][x];
+            jump_index->columns[x][y].pos = y;
+        }
+        qsort(jump_index->rows[y], GRID_WIDTH, sizeof(struct jump_entry), compare_entries);
+    }
+    for (int x = 0; x < GRID_WIDTH; x++) {
+        qsort(jump_index->columns[x], GRID_HEIGHT, sizeof(struct jump_entry), compare_entries);
+    }
+}
+
+// Keep the indexes in sync with a grid write
+void update_jump_index(int x, int y, int old_value, int new_value) {
+    if (old_value == new_value) {
+        return;
+    }
+    update_line(jump_index->rows[y], GRID_WIDTH, x, old_value, new_value);
+    update_line(jump_index->columns[x], GRID_HEIGHT, y, old_value, new_value);
+}
+
+// Position (x for LEFT/RIGHT, y for UP/DOWN) of the nearest cell holding
+// value when scanning from (x, y) in dir, or -1 if there is none
+int find_jump_target(int x, int y, enum direction dir, int value) {
+    switch (dir) {
+        case LEFT: return find_in_line(jump_index->rows[y], GRID_WIDTH, x, 0, value);
+        case RIGHT: return find_in_line(jump_index->rows[y], GRID_WIDTH, x, 1, value);
+        case UP: return find_in_line(jump_index->columns[x], GRID_HEIGHT, y, 0, value);
+        case DOWN: return find_in_line(jump_index->columns[x], GRID_HEIGHT, y, 1, value);
+    }
+    return -1;
+}
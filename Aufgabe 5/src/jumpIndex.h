@@ -0,0 +1,27 @@
+#ifndef JUMPINDEX_H
+#define JUMPINDEX_H
+
+#include "interpreter.h"
+
+// (value, position) pair; every row and column keeps its cells sorted by
+// value and then position, so jump targets are found by binary search
+struct jump_entry {
+    int value;
+    int pos;
+};
+
+// Sorted cells of every row (positions are x) and column (positions are y)
+struct jump_index {
+    struct jump_entry rows[GRID_HEIGHT][GRID_WIDTH];
+    struct jump_entry columns[GRID_WIDTH][GRID_HEIGHT];
+};
+
+// Jump index of the running program
+extern _Thread_local struct jump_index *jump_index;
+
+// Function declarations
+void build_jump_index(void);
+void update_jump_index(int x, int y, int old_value, int new_value);
+int find_jump_target(int x, int y, enum direction dir, int value);
+
+#endif // JUMPINDEX_H
@@ -0,0 +1,93 @@
+#include "loopDetector.h"
+#include <string.h>
+
+_Thread_local uint64_t grid_hash = 0;
+_Thread_local long input_bytes_read = 0;
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+uint64_t cell_hash(int x, int y, int value) {
+    return mix(((uint64_t)GRID_INDEX(x, y) << 32) | (uint32_t)value);
+}
+
+// Hash the whole grid; called once after loading
+void init_grid_hash(void) {
+    grid_hash = 0;
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            grid_hash ^= cell_hash(x, y, grid[y][x]);
+        }
+    }
+}
+
+// Only the top of the stack goes into the hash so sampling stays cheap;
+// equal hashes are confirmed by comparing the whole state
+#define HASHED_STACK_ENTRIES 4
+
+static uint64_t state_hash(const struct state *state) {
+    uint64_t hash = grid_hash ^ mix(((uint64_t)GRID_INDEX(state->ip.x, state->ip.y) << 2) | state->ip.direction);
+    int bottom = state->stack.top - HASHED_STACK_ENTRIES + 1;
+    for (int i = bottom > 0 ? bottom : 0; i <= state->stack.top; i++) {
+        hash = mix(hash ^ (uint32_t)state->stack.data[i]);
+    }
+    return mix(hash ^ (uint64_t)(state->stack.top + 1));
+}
+
+void loop_detector_init(struct loop_detector *detector) {
+    detector->has_saved = 0;
+}
+
+// Release the saved stack; the detector may be initialised again after
+void loop_detector_free(struct loop_detector *detector) {
+    stack_free(&detector->saved_state.stack);
+}
+
+static void save_state(struct loop_detector *detector, const struct state *state, uint64_t hash, long step) {
+    detector->saved_hash = hash;
+    detector->saved_step = step;
+    detector->saved_inputs = input_bytes_read;
+    detector->samples = 0;
+    detector->saved_state.ip = state->ip;
+    stack_copy(&detector->saved_state.stack, &state->stack, state->stack.top + 1);
+    memcpy(detector->saved_cells, grid_cells, sizeof(detector->saved_cells));
+}
+
+// Check if the state equals the saved one
+int loop_detector_matches(const struct loop_detector *detector, const struct state *state) {
+    const struct state *saved = &detector->saved_state;
+    return state->ip.x == saved->ip.x && state->ip.y == saved->ip.y &&
+           state->ip.direction == saved->ip.direction &&
+           state->stack.top == saved->stack.top &&
+           // An empty saved stack may have no data yet
+           (state->stack.top < 0 ||
+            memcmp(state->stack.data, saved->stack.data, (state->stack.top + 1) * sizeof(int)) == 0) &&
+           memcmp(grid_cells, detector->saved_cells, sizeof(detector->saved_cells)) == 0;
+}
+
+// Sample the state at step; returns 1 if it repeats the saved sample, which
+// is then saved_step steps into the run and still in detector->saved_state
+int loop_detector_check(struct loop_detector *detector, const struct state *state, long step) {
+    uint64_t hash = state_hash(state);
+    if (!detector->has_saved || detector->saved_inputs != input_bytes_read) {
+        // Start over; states from before an input read may not come back
+        detector->has_saved = 1;
+        detector->power = 1;
+        save_state(detector, state, hash, step);
+        return 0;
+    }
+    detector->samples++;
+    if (hash == detector->saved_hash && loop_detector_matches(detector, state)) {
+        return 1;
+    }
+    if (detector->samples == detector->power) {
+        detector->power *= 2;
+        save_state(detector, state, hash, step);
+    }
+    return 0;
+}
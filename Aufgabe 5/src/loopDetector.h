@@ -0,0 +1,39 @@
+#ifndef LOOPDETECTOR_H
+#define LOOPDETECTOR_H
+
+#include "interpreter.h"
+#include <stdint.h>
+
+// Zobrist-style hash of the running program's grid: the xor of
+// cell_hash(x, y, value) over all cells, kept up to date by set_cell_value
+extern _Thread_local uint64_t grid_hash;
+
+// Number of input bytes read so far; a loop that consumes input may still end
+extern _Thread_local long input_bytes_read;
+
+// Steps between two loop checks of a run
+#define LOOP_CHECK_INTERVAL 256
+
+// Brent's cycle detection over states sampled at a fixed step interval.
+// The sampled states form a deterministic sequence as long as no input is
+// read, so a repeated sample means the program loops forever.
+struct loop_detector {
+    uint64_t saved_hash;
+    long saved_step;
+    long saved_inputs;
+    long power;                 // samples until the saved state moves on
+    long samples;               // samples since the state was saved
+    int has_saved;
+    struct state saved_state;
+    int saved_cells[GRID_CELLS];
+};
+
+// Function declarations
+uint64_t cell_hash(int x, int y, int value);
+void init_grid_hash(void);
+void loop_detector_init(struct loop_detector *detector);
+void loop_detector_free(struct loop_detector *detector);
+int loop_detector_check(struct loop_detector *detector, const struct state *state, long step);
+int loop_detector_matches(const struct loop_detector *detector, const struct state *state);
+
+#endif // LOOPDETECTOR_H
@@ -3,20 +3,361 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <limits.h>
 #include "interpreter.h"
 #include "visualizer.h"
 #include "hashTable.h"
+#include "engine.h"
+#include "decoder.h"
+#include "trace.h"
+#include "jit.h"
+#include "jumpIndex.h"
+#include "output.h"
+#include "renderThread.h"
+#include "batch.h"
+#include "server.h"
+#include "loopDetector.h"
+#include "profile.h"
+#include "checkpoint.h"
+#include "debugger.h"
+#include "history.h"
+#include "recording.h"
+#include "replay.h"
+#include "analysis.h"
+#include "programCache.h"
+#include "input.h"
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Default step limits of headless and visual runs (--max-steps overrides them)
+#define HEADLESS_MAX_STEPS 1000000
+#define VISUAL_MAX_STEPS 10000
+
+// Steps between two limit checks without loop checks or checkpoints; long
+// enough that counting loops are skipped at once (see countingLoop.h)
+#define LIMIT_CHECK_INTERVAL (1L << 20)
+
+// Limits of a run; 0 disables a limit
+struct run_limits {
+    long max_steps;
+    double time_limit;          // wall-clock seconds
+    int loop_check;
+    long start_ns;
+};
+
+static struct loop_detector loop_detector;
+static struct program_analysis analysis;
+
+// Periodic checkpoints (--checkpoint-every); one more is written when the
+// run stops at a limit or is terminated with SIGTERM or SIGINT
+struct checkpoint_schedule {
+    const char *path;
+    long every;                 // steps, 0 when off
+    long next;
+};
+
+static struct checkpoint_schedule checkpoints;
+// Signal that asked the run to stop, 0 if none
+static volatile sig_atomic_t terminate_requested = 0;
+
+static void request_termination(int signal_number) {
+    terminate_requested = signal_number;
+}
+
+static void write_checkpoint(const struct state *state, long steps) {
+    if (save_checkpoint(checkpoints.path, state, steps) != 0) {
+        output_flush();
+        fprintf(stderr, "Error: Could not write checkpoint %s\n", checkpoints.path);
+    }
+    checkpoints.next = steps + checkpoints.every;
+}
+
+// Why the run ended; printed once the visual output is done
+static char stop_message[128];
+
+// Set by --trace: every step is written to the trace (see recording.c)
+static int recording = 0;
+
+static void run_steps(struct state *state, enum engine engine, long count) {
+    if (recording) {
+        record_steps(state, count);
+    } else if (engine == ENGINE_FAST) {
+        run_program(state, (int)count);
+    } else {
+        for (long i = 0; i < count; i++) {
+            execute_step(state);
+        }
+    }
+}
+
+// An i or I waits for its byte outside the step, so visual mode keeps
+// drawing while the input is typed
+static int waiting_for_input(const struct state *state) {
+    char instruction = (char)grid_cells[GRID_INDEX(state->ip.x, state->ip.y)];
+    return (instruction == 'i' || instruction == 'I') && !input_ready();
+}
+
+// Steps of the period search: not recorded, profiled or shown
+static void look_ahead(struct state *state, enum engine engine, long count) {
+    if (engine == ENGINE_FAST) {
+        run_program(state, (int)count);
+    } else {
+        for (long i = 0; i < count; i++) {
+            execute_step(state);
+        }
+    }
+}
+
+// Steps to run before the next check, at most the remaining step budget
+static long next_chunk(const struct run_limits *limits, long steps, long chunk) {
+    if (limits->max_steps > 0 && limits->max_steps - steps < chunk) {
+        return limits->max_steps - steps;
+    }
+    return chunk;
+}
+
+// The state repeats after distance steps, so the period of the loop is the
+// first divisor of distance after which it repeats. The steps run for this
+// go past the reported end of the run, so their output and errors are
+// dropped and the profile left alone; the run stops afterwards either way.
+static long find_period(struct state *state, enum engine engine, long distance) {
+    struct profile *profile = active_profile;
+    active_profile = NULL;
+    output_mute(1);
+    mute_errors(1);
+    long period = distance;
+    long done = 0;
+    long root = 1;
+    while ((root + 1) * (root + 1) <= distance) {
+        root++;
+    }
+    for (long i = 1; i <= root && period == distance; i++) {
+        if (distance % i == 0) {
+            look_ahead(state, engine, i - done);
+            done = i;
+            if (loop_detector_matches(&loop_detector, state)) {
+                period = i;
+            }
+        }
+    }
+    for (long i = root; i >= 1 && period == distance; i--) {
+        if (distance % i == 0 && distance / i > done) {
+            look_ahead(state, engine, distance / i - done);
+            done = distance / i;
+            if (loop_detector_matches(&loop_detector, state)) {
+                period = done;
+            }
+        }
+    }
+    mute_errors(0);
+    output_mute(0);
+    active_profile = profile;
+    return period;
+}
+
+// Called between chunks of a run; returns 1 when the run ends
+static int run_finished(struct state *state, enum engine engine, const struct run_limits *limits, long steps) {
+    if (limits->loop_check && loop_detector_check(&loop_detector, state, steps)) {
+        // The output so far ends at this step, so that is the one reported;
+        // its state was already seen at loop_detector.saved_step
+        long period = find_period(state, engine, steps - loop_detector.saved_step);
+        snprintf(stop_message, sizeof(stop_message),
+                 "\nProgram loops forever: the state at step %ld repeats every %ld steps.\n", steps, period);
+        return 1;   // no checkpoint, resuming would loop again
+    }
+    int finished = 1;
+    if (limits->max_steps > 0 && steps >= limits->max_steps) {
+        snprintf(stop_message, sizeof(stop_message),
+                 "\nExecution stopped after %ld steps to prevent infinite loop.\n", steps);
+    } else if (limits->time_limit > 0 && now_ns() - limits->start_ns >= limits->time_limit * 1e9) {
+        snprintf(stop_message, sizeof(stop_message),
+                 "\nExecution stopped after %ld steps: time limit of %g seconds reached.\n", steps, limits->time_limit);
+    } else if (terminate_requested) {
+        snprintf(stop_message, sizeof(stop_message), "\nExecution stopped after %ld steps: %s.\n", steps,
+                 terminate_requested == SIGINT ? "interrupted" : "terminated");
+    } else {
+        finished = 0;
+        output_tick();
+    }
+    if (checkpoints.every > 0 && (finished || steps >= checkpoints.next)) {
+        write_checkpoint(state, steps);
+    }
+    return finished;
+}
+
+// Visual mode with a render thread: execute in chunks and publish a
+// snapshot after each one; with steps_per_second, sleep to keep that pace
+static void run_with_render_thread(struct state *state, enum engine engine, const struct run_limits *limits,
+                                   int fps, int steps_per_second, long first_step) {
+    long chunk = 10000;
+    if (steps_per_second > 0) {
+        chunk = steps_per_second / fps > 0 ? steps_per_second / fps : 1;
+    }
+    long start = now_ns();
+
+    start_render_thread(state, fps);
+    for (long steps = first_step; ; ) {
+        long count = next_chunk(limits, steps, chunk);
+        run_steps(state, engine, count);
+        steps += count;
+        publish_snapshot();
+        if (run_finished(state, engine, limits, steps)) {
+            break;
+        }
+
+        if (steps_per_second > 0) {
+            long wait = start + (steps - first_step) * 1000000000L / steps_per_second - now_ns();
+            if (wait > 0) {
+                struct timespec ts = { wait / 1000000000L, wait % 1000000000L };
+                nanosleep(&ts, NULL);
+            }
+        }
+    }
+    stop_render_thread();
+}
 
 int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--replay") == 0) {
+        // Show a trace written by --trace; the program is in the trace
+        init_hash_table();
+        int result = run_replay(argv[2]);
+        cleanup_hash_table();
+        return result;
+    }
+    if (argc >= 3 && strcmp(argv[1], "--serve") == 0) {
+        // Warm worker process for pfuschclient (see server.c)
+        int jobs = argc == 5 && strcmp(argv[3], "--jobs") == 0 ? atoi(argv[4]) : 0;
+        return run_server(argv[2], jobs);
+    }
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <pfusch program> [--no-visual]\n", argv[0]);
+        fprintf(stderr, "Usage: %s <pfusch program> [--no-visual] [--engine fast|reference] [--no-jit]\n"
+                        "       [--unbuffered] [--flush-interval ms] [--fps n] [--steps-per-second n]\n"
+                        "       [--max-steps n] [--time-limit seconds] [--no-loop-check] [--stack-size n]\n"
+                        "       [--profile out.json] [--heatmap] [--analyze] [--input file] [--cache-dir dir]\n"
+                        "       [--checkpoint-every steps [--checkpoint-file path]] [--resume checkpoint]\n"
+                        "       [--debug [--history MB]] [--trace out.ptr]\n"
+                        "       [--batch input-dir [--jobs n] [--output-dir dir]]\n"
+                        "       %s --replay out.ptr\n"
+                        "       %s --serve socket [--jobs n]\n", argv[0], argv[0], argv[0]);
         return 1;
     }
 
-    // Check for visualization flag
+    // Check for visualization, engine and output flags
     int visual_mode = 1;
-    if (argc >= 3 && strcmp(argv[2], "--no-visual") == 0) {
-        visual_mode = 0;
+    enum engine engine = DEFAULT_ENGINE;
+    int unbuffered = 0;
+    int flush_interval = DEFAULT_FLUSH_INTERVAL;
+    int fps = 0;
+    int steps_per_second = 0;
+    const char *batch_dir = NULL;
+    const char *output_dir = NULL;
+    int jobs = 0;
+    const char *profile_path = NULL;
+    int heatmap = 0;
+    int analyze = 0;
+    const char *input_path = NULL;
+    const char *cache_dir = NULL;
+    const char *resume_path = NULL;
+    int debug = 0;
+    long history_mb = DEFAULT_HISTORY_MB;
+    const char *trace_path = NULL;
+    struct run_limits limits = { -1, 0, 1, 0 };
+    long stack_size = STACK_SIZE;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--no-visual") == 0) {
+            visual_mode = 0;
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            jit_enabled = 0;
+        } else if (strcmp(argv[i], "--unbuffered") == 0) {
+            unbuffered = 1;
+        } else if (strcmp(argv[i], "--flush-interval") == 0 && i + 1 < argc) {
+            flush_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--steps-per-second") == 0 && i + 1 < argc) {
+            steps_per_second = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            limits.max_steps = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--time-limit") == 0 && i + 1 < argc) {
+            limits.time_limit = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--no-loop-check") == 0) {
+            limits.loop_check = 0;
+        } else if (strcmp(argv[i], "--stack-size") == 0 && i + 1 < argc) {
+            stack_size = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (strcmp(argv[i], "--heatmap") == 0) {
+            heatmap = 1;
+        } else if (strcmp(argv[i], "--analyze") == 0) {
+            analyze = 1;
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            checkpoints.every = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--checkpoint-file") == 0 && i + 1 < argc) {
+            checkpoints.path = argv[++i];
+        } else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+            resume_path = argv[++i];
+        } else if (strcmp(argv[i], "--debug") == 0) {
+            debug = 1;
+        } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            history_mb = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_dir = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output-dir") == 0 && i + 1 < argc) {
+            output_dir = argv[++i];
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "fast") == 0) {
+                engine = ENGINE_FAST;
+            } else if (strcmp(argv[i], "reference") == 0) {
+                engine = ENGINE_REFERENCE;
+            } else {
+                fprintf(stderr, "Error: Unknown engine '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+    }
+
+    if (stack_size < 1 || stack_size > INT_MAX) {
+        fprintf(stderr, "Error: Stack size must be between 1 and %d entries\n", INT_MAX);
+        return 1;
+    }
+    if (debug) {
+        if (history_mb <= 0) {
+            fprintf(stderr, "Error: History size must be at least 1 MB\n");
+            return 1;
+        }
+        visual_mode = 1;    // the debugger always shows the grid
+    } else if (trace_path) {
+        visual_mode = 0;    // traces are recorded headless
+    }
+
+    if (batch_dir) {
+        // One run per input file on a pool of threads (see batch.c), each
+        // with the limits of a headless run
+        if (limits.max_steps < 0) {
+            limits.max_steps = HEADLESS_MAX_STEPS;
+        }
+        return run_batch(argv[1], batch_dir, output_dir, jobs, limits.max_steps, limits.time_limit,
+                         limits.loop_check, (int)stack_size);
+    }
+
+    output_init(unbuffered, flush_interval, !visual_mode);
+    if (input_path && input_open(input_path) != 0) {
+        return 1;
     }
 
     FILE *fp = fopen(argv[1], "r");
@@ -27,14 +368,38 @@ int main(int argc, char *argv[]) {
 
     // Initialize the hash table before using the interpreter
     init_hash_table();
+    init_decode_table();
 
     init_grid();
-    load_program(fp);
+    // A program run before comes decoded, analysed and indexed from its
+    // .pfb (see programCache.c)
+    int cached = cache_dir && load_program_cache(cache_dir, argv[1]) == 0;
+    if (!cached) {
+        load_program(fp);
+        decode_program();
+        analyze_program(&analysis);
+        mark_fixed_cells(&analysis);
+        build_jump_index();
+        if (cache_dir) {
+            save_program_cache(cache_dir);
+        }
+    }
     fclose(fp);
+    if (analyze) {
+        if (cached) {
+            analyze_program(&analysis);
+        }
+        report_analysis(&analysis, stderr);
+    }
+    init_grid_hash();
+    checkpoint_program_loaded();
 
     // Initialize state
     struct state state = {0};
-    state.stack.top = -1;
+    if (stack_init(&state.stack, (int)stack_size) != 0) {
+        fprintf(stderr, "Error: Out of memory for the stack\n");
+        exit(1);
+    }
     state.ip.x = 0;
     state.ip.y = 0;
     state.ip.direction = RIGHT; // Default direction
@@ -50,31 +415,106 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    if (visual_mode) {
+    // Continue a run from a checkpoint: grid changes, IP, stack, output
+    // scrollback and input position
+    long first_step = 0;
+    if (resume_path && load_checkpoint(resume_path, &state, &first_step) != 0) {
+        cleanup_hash_table();
+        return 1;
+    }
+    if (checkpoints.every > 0) {
+        static char default_path[4096];
+        if (!checkpoints.path) {
+            snprintf(default_path, sizeof(default_path), "%s.ckpt", argv[1]);
+            checkpoints.path = default_path;
+        }
+        checkpoints.next = first_step + checkpoints.every;
+        signal(SIGTERM, request_termination);
+    }
+    if (!debug) {
+        // Ctrl+C ends the run at the next check, so buffered output and the
+        // last checkpoint are written; a second one kills it (e.g. while it
+        // waits for input, which flushed the output already)
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = request_termination;
+        action.sa_flags = SA_RESETHAND | SA_RESTART;
+        sigaction(SIGINT, &action, NULL);
+    }
+
+    if (limits.max_steps < 0) {
+        limits.max_steps = visual_mode && fps == 0 && steps_per_second == 0 ? VISUAL_MAX_STEPS : HEADLESS_MAX_STEPS;
+    }
+    loop_detector_init(&loop_detector);
+    if (profile_path || heatmap) {
+        // Counts executions per cell and instruction (see profile.c)
+        profile_start(profile_path);
+    }
+    if (heatmap) {
+        enable_heatmap();
+    }
+    if (trace_path && !debug) {
+        if (recording_start(trace_path, first_step) != 0) {
+            cleanup_hash_table();
+            return 1;
+        }
+        recording = 1;
+    }
+    limits.start_ns = now_ns();
+
+    int exit_code = 0;
+    if (debug) {
+        // Step forward and backward through the reference interpreter,
+        // recording every step in the undo log (see debugger.c)
+        exit_code = run_debugger(&state, first_step, limits.max_steps, (size_t)history_mb * 1024 * 1024);
+    } else if (visual_mode && (fps > 0 || steps_per_second > 0)) {
+        // Run at full speed (or throttled) while a render thread draws
+        printf("Starting Pfusch interpreter in visual mode...\n");
+        printf("Press Ctrl+C to stop execution.\n\n");
+
+        run_with_render_thread(&state, engine, &limits, fps > 0 ? fps : DEFAULT_FPS, steps_per_second, first_step);
+    } else if (visual_mode) {
         // Visual execution loop
         printf("Starting Pfusch interpreter in visual mode...\n");
         printf("Press Ctrl+C to stop execution.\n\n");
         
-        for (int steps = 0; steps < 10000; steps++) {  // Limit to prevent infinite loops
-            print_visual_grid(&state);
-            print_current_instruction_info(&state);
-            execute_step(&state);
+        for (long steps = first_step; ; ) {
+            print_visual_grid(&state);  // draws the changes since the last frame
+            if (waiting_for_input(&state)) {
+                usleep(100000);     // keep drawing until a line was typed
+                continue;
+            }
+            run_steps(&state, engine, 1);
+            steps++;
             usleep(100000);  // delay for better visualization
+            if (run_finished(&state, engine, &limits, steps)) {
+                break;
+            }
         }
-        
-        printf("\nExecution stopped after 10000 steps to prevent infinite loop.\n");
     } else {
         // Non-visual execution
         printf("Starting Pfusch interpreter...\n");
         
-        for (int steps = 0; steps < 1000000; steps++) {  // Higher limit for non-visual
-            execute_step(&state);
+        long interval = limits.loop_check || checkpoints.every > 0 ? LOOP_CHECK_INTERVAL : LIMIT_CHECK_INTERVAL;
+        for (long steps = first_step; ; ) {
+            long count = next_chunk(&limits, steps, interval);
+            run_steps(&state, engine, count);
+            steps += count;
+            if (run_finished(&state, engine, &limits, steps)) {
+                break;
+            }
         }
-        
-        printf("\nExecution stopped after 1000000 steps to prevent infinite loop.\n");
     }
+    if (recording) {
+        recording_finish(PFUSCH_STEP_LIMIT);
+    }
+    printf("%s", stop_message);
+    profile_finish();
 
-    // Clean up hash table before exiting
+    // Clean up the stack, traces and hash table before exiting
+    stack_free(&state.stack);
+    free_traces();
+    jit_shutdown();
     cleanup_hash_table();
-    return 0;
+    return exit_code;
 }
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "output.h"
+#include "visualizer.h"
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+// Program output shares the stdout buffer with the interpreter's own
+// messages, so everything stays in order. The buffer is flushed when it is
+// full, at exit, before input is read and every flush_interval ms (checked
+// by the run loop through output_tick). On a terminal it is line buffered.
+static char output_storage[OUTPUT_BUFFER_SIZE];
+static int output_unbuffered = 0;
+static int output_echo = 1;
+static long flush_interval_ns = 0;
+static long last_flush_ns = 0;
+static int output_muted = 0;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// With echo off (visual mode) the output only goes to the visualizer's
+// output panel, so it does not scribble over the drawn frame
+void output_init(int unbuffered, int flush_interval_ms, int echo) {
+    output_unbuffered = unbuffered;
+    output_echo = echo;
+    flush_interval_ns = flush_interval_ms * 1000000L;
+    if (!unbuffered) {
+        setvbuf(stdout, output_storage, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, sizeof(output_storage));
+        last_flush_ns = now_ns();
+    }
+}
+
+void output_flush(void) {
+    fflush(stdout);
+    if (flush_interval_ns > 0) {
+        last_flush_ns = now_ns();
+    }
+}
+
+// Called by the run loop between chunks of steps, so output written before
+// a long silent stretch still shows up after flush_interval ms
+void output_tick(void) {
+    if (!output_unbuffered && flush_interval_ns > 0 && now_ns() - last_flush_ns >= flush_interval_ns) {
+        output_flush();
+    }
+}
+
+// While muted, program output is dropped; used to look ahead of the
+// reported end of a run without showing what it writes
+void output_mute(int muted) {
+    output_muted = muted;
+}
+
+// Write a run of program output bytes at once
+void output_block(const char *bytes, int count) {
+    if (output_muted) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        add_to_output(bytes[i]);
+    }
+    if (output_echo) {
+        fwrite(bytes, 1, count, stdout);
+        if (output_unbuffered) {
+            fflush(stdout);
+        }
+    }
+}
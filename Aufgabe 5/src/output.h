@@ -0,0 +1,17 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+// Size of the stdout buffer used unless --unbuffered is given
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+// Default for --flush-interval, in milliseconds (0 disables it)
+#define DEFAULT_FLUSH_INTERVAL 100
+
+// Function declarations
+void output_init(int unbuffered, int flush_interval_ms, int echo);
+void output_block(const char *bytes, int count);
+void output_flush(void);
+void output_tick(void);
+void output_mute(int muted);
+
+#endif // OUTPUT_H
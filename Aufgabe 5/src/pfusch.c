@@ -0,0 +1,339 @@
+#include "pfusch.h"
+#include "interpreter.h"
+#include "hashTable.h"
+#include "engine.h"
+#include "decoder.h"
+#include "trace.h"
+#include "jumpIndex.h"
+#include "loopDetector.h"
+#include "analysis.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Interpreter instance; the runtime works on whatever storage the
+// thread-local pointers select, so a call switches in the instance's own
+struct pfusch {
+    int grid_cells[GRID_CELLS];
+    struct decoded_cell program_cells[GRID_CELLS];
+    struct trace_cache traces;
+    struct jump_index jumps;
+    // Loaded program, decoded and indexed once; pfusch_reset copies it back
+    int initial_cells[GRID_CELLS];
+    struct decoded_cell initial_program[GRID_CELLS];
+    struct jump_index initial_jumps;
+    uint64_t initial_grid_hash;
+    struct state state;
+    struct run_context context;
+    struct pfusch_io io;
+    enum pfusch_status status;              // how the last run (or load) stopped
+    int loaded;
+    int started;                            // the start cell has been checked
+    int finished;
+    // Limits of pfusch_set_limits and pfusch_set_stack_size, and the loop
+    // detector's view of the run
+    double time_limit;
+    int loop_check;
+    long steps;                             // since the last reset
+    int stack_size;
+    uint64_t grid_hash;
+    long input_bytes_read;
+    struct loop_detector loops;
+};
+
+// Storage selected before an instance was switched in
+struct saved_storage {
+    int *grid_cells;
+    struct decoded_cell *program_cells;
+    struct trace_cache *trace_cache;
+    struct jump_index *jump_index;
+    struct run_context *run_context;
+    uint64_t grid_hash;
+    long input_bytes_read;
+};
+
+static pthread_once_t runtime_once = PTHREAD_ONCE_INIT;
+
+static void init_runtime(void) {
+    init_hash_table();
+    init_decode_table();
+}
+
+static void activate(pfusch *p, struct saved_storage *saved) {
+    saved->grid_cells = grid_cells;
+    saved->program_cells = program_cells;
+    saved->trace_cache = trace_cache;
+    saved->jump_index = jump_index;
+    saved->run_context = run_context;
+    saved->grid_hash = grid_hash;
+    saved->input_bytes_read = input_bytes_read;
+    grid_cells = p->grid_cells;
+    program_cells = p->program_cells;
+    trace_cache = &p->traces;
+    jump_index = &p->jumps;
+    run_context = &p->context;
+    grid_hash = p->grid_hash;
+    input_bytes_read = p->input_bytes_read;
+}
+
+static void deactivate(pfusch *p, const struct saved_storage *saved) {
+    p->grid_hash = grid_hash;
+    p->input_bytes_read = input_bytes_read;
+    grid_cells = saved->grid_cells;
+    program_cells = saved->program_cells;
+    trace_cache = saved->trace_cache;
+    jump_index = saved->jump_index;
+    run_context = saved->run_context;
+    grid_hash = saved->grid_hash;
+    input_bytes_read = saved->input_bytes_read;
+}
+
+pfusch *pfusch_create(const struct pfusch_io *io) {
+    pthread_once(&runtime_once, init_runtime);
+    pfusch *p = calloc(1, sizeof(*p));
+    if (!p) {
+        return NULL;
+    }
+    if (io) {
+        p->io = *io;
+    }
+    p->context.io = &p->io;
+    p->stack_size = STACK_SIZE;
+    if (stack_init(&p->state.stack, p->stack_size) != 0) {
+        free(p);
+        return NULL;
+    }
+    p->status = PFUSCH_LOAD_ERROR;
+    p->finished = 1;
+    snprintf(p->context.message, sizeof(p->context.message), "Error: No program loaded");
+    return p;
+}
+
+pfusch *pfusch_clone(const pfusch *p, const struct pfusch_io *io) {
+    pfusch *copy = pfusch_create(io);
+    if (!copy || !p->loaded) {
+        return copy;
+    }
+    memcpy(copy->initial_cells, p->initial_cells, sizeof(copy->initial_cells));
+    memcpy(copy->initial_program, p->initial_program, sizeof(copy->initial_program));
+    copy->initial_jumps = p->initial_jumps;
+    copy->initial_grid_hash = p->initial_grid_hash;
+    // Point the decoded cells at the copy's grid
+    for (int i = 0; i < GRID_CELLS; i++) {
+        copy->initial_program[i].value = copy->grid_cells + (p->initial_program[i].value - p->grid_cells);
+    }
+    copy->loaded = 1;
+    pfusch_reset(copy);
+    return copy;
+}
+
+void pfusch_destroy(pfusch *p) {
+    if (!p) {
+        return;
+    }
+    struct saved_storage saved;
+    activate(p, &saved);
+    free_traces();
+    deactivate(p, &saved);
+    stack_free(&p->state.stack);
+    loop_detector_free(&p->loops);
+    free(p);
+}
+
+int pfusch_load(pfusch *p, FILE *fp) {
+    struct saved_storage saved;
+    activate(p, &saved);
+    p->loaded = 0;
+    if (setjmp(p->context.stop) == 0) {
+        free_traces();
+        init_grid();
+        load_program(fp);
+        decode_program();
+        // The analysis is large; without it no cell is taken for constant
+        struct program_analysis *analysis = malloc(sizeof(*analysis));
+        if (analysis) {
+            analyze_program(analysis);
+            mark_fixed_cells(analysis);
+            free(analysis);
+        }
+        build_jump_index();
+        init_grid_hash();
+        p->initial_grid_hash = grid_hash;
+        memcpy(p->initial_cells, p->grid_cells, sizeof(p->initial_cells));
+        memcpy(p->initial_program, p->program_cells, sizeof(p->initial_program));
+        p->initial_jumps = p->jumps;
+        p->loaded = 1;
+    }
+    deactivate(p, &saved);
+
+    if (!p->loaded) {
+        p->status = PFUSCH_LOAD_ERROR;
+        p->finished = 1;
+        return -1;
+    }
+    pfusch_reset(p);
+    return 0;
+}
+
+int pfusch_load_string(pfusch *p, const char *source) {
+    FILE *fp = fmemopen((void *)source, strlen(source), "r");
+    if (!fp) {
+        p->loaded = 0;
+        p->status = PFUSCH_LOAD_ERROR;
+        p->finished = 1;
+        snprintf(p->context.message, sizeof(p->context.message), "Error: Could not read the program");
+        return -1;
+    }
+    int result = pfusch_load(p, fp);
+    fclose(fp);
+    return result;
+}
+
+// Restore the loaded program and start it over
+void pfusch_reset(pfusch *p) {
+    if (!p->loaded) {
+        return;
+    }
+    struct saved_storage saved;
+    activate(p, &saved);
+    free_traces();
+    deactivate(p, &saved);
+    // The decoded cells point into grid_cells of the same instance
+    memcpy(p->grid_cells, p->initial_cells, sizeof(p->grid_cells));
+    memcpy(p->program_cells, p->initial_program, sizeof(p->program_cells));
+    p->jumps = p->initial_jumps;
+    p->grid_hash = p->initial_grid_hash;
+    p->input_bytes_read = 0;
+    p->steps = 0;
+    loop_detector_init(&p->loops);
+
+    // The stack keeps its storage for the next run unless its limit changed
+    // (or it could not be allocated)
+    if (p->state.stack.limit != p->stack_size || !p->state.stack.data) {
+        stack_free(&p->state.stack);
+        if (stack_init(&p->state.stack, p->stack_size) != 0) {
+            p->status = PFUSCH_OUT_OF_MEMORY;
+            p->finished = 1;
+            snprintf(p->context.message, sizeof(p->context.message), "Error: Out of memory for the stack");
+            return;
+        }
+    }
+    p->state.stack.top = -1;
+    memset(&p->state.ip, 0, sizeof(p->state.ip));
+    p->state.ip.direction = RIGHT;
+    p->context.message[0] = '\0';
+    p->status = PFUSCH_STEP_LIMIT;
+    p->started = 0;
+    p->finished = 0;
+}
+
+void pfusch_set_limits(pfusch *p, double time_limit, int loop_check) {
+    p->time_limit = time_limit;
+    p->loop_check = loop_check;
+}
+
+void pfusch_set_stack_size(pfusch *p, int entries) {
+    p->stack_size = entries > 0 ? entries : 1;
+}
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Run in chunks of LOOP_CHECK_INTERVAL steps, checking the limits of
+// pfusch_set_limits after each one
+static enum pfusch_status run_checked(pfusch *p, long max_steps) {
+    long start_ns = now_ns();
+    while (max_steps > 0) {
+        int chunk = max_steps < LOOP_CHECK_INTERVAL ? (int)max_steps : LOOP_CHECK_INTERVAL;
+        p->steps += run_program(&p->state, chunk);
+        max_steps -= chunk;
+        if (p->loop_check && loop_detector_check(&p->loops, &p->state, p->steps)) {
+            snprintf(p->context.message, sizeof(p->context.message),
+                     "Program loops forever: the state at step %ld repeats the one at step %ld",
+                     p->steps, p->loops.saved_step);
+            return PFUSCH_LOOPS_FOREVER;
+        }
+        if (p->time_limit > 0 && now_ns() - start_ns >= p->time_limit * 1e9) {
+            return PFUSCH_TIME_LIMIT;
+        }
+    }
+    return PFUSCH_STEP_LIMIT;
+}
+
+// Body of pfusch_run; errors leave it through stop_execution
+static enum pfusch_status run_steps(pfusch *p, long max_steps) {
+    if (!p->started) {
+        char first_instruction = grid[0][0];
+        if (first_instruction != 'h' && first_instruction != 'j' &&
+            first_instruction != 'k' && first_instruction != 'l' &&
+            first_instruction != 'H' && first_instruction != 'J' &&
+            first_instruction != 'K' && first_instruction != 'L') {
+            report_error("Error: Program must start with a flow control instruction\n");
+            stop_execution(PFUSCH_INVALID_START);
+        }
+        p->started = 1;
+    }
+    if (p->loop_check || p->time_limit > 0) {
+        return run_checked(p, max_steps);
+    }
+    // run_program counts steps in an int
+    while (max_steps > 0) {
+        int chunk = max_steps < INT_MAX ? (int)max_steps : INT_MAX;
+        p->steps += run_program(&p->state, chunk);
+        max_steps -= chunk;
+    }
+    return PFUSCH_STEP_LIMIT;
+}
+
+enum pfusch_status pfusch_run(pfusch *p, long max_steps) {
+    if (p->finished) {
+        return p->status;
+    }
+    struct saved_storage saved;
+    activate(p, &saved);
+    p->context.steps = 0;
+    int stopped = setjmp(p->context.stop);
+    if (stopped == 0) {
+        p->status = run_steps(p, max_steps);
+        p->finished = p->status == PFUSCH_LOOPS_FOREVER;
+    } else {
+        // The engine recorded how far the stopped chunk got
+        p->steps += p->context.steps;
+        p->status = (enum pfusch_status)(stopped - 1);
+        p->finished = 1;
+    }
+    deactivate(p, &saved);
+    return p->status;
+}
+
+// Steps run since the last reset; the step that stopped the program, an
+// 'e' or a failing instruction, is not counted
+long pfusch_steps(const pfusch *p) {
+    return p->steps;
+}
+
+// Message of the error that stopped the last run or load, "" otherwise
+const char *pfusch_error(const pfusch *p) {
+    if (p->status == PFUSCH_ENDED || p->status == PFUSCH_STEP_LIMIT || p->status == PFUSCH_TIME_LIMIT) {
+        return "";
+    }
+    return p->context.message;
+}
+
+const char *pfusch_status_name(enum pfusch_status status) {
+    static const char *const names[] = {
+        "ended", "step_limit", "stack_underflow", "stack_overflow", "out_of_bounds",
+        "cell_out_of_bounds", "invalid_instruction", "jump_target_not_found",
+        "division_by_zero", "invalid_output", "invalid_start", "load_error", "time_limit",
+        "loops_forever", "out_of_memory"
+    };
+    if ((unsigned)status >= sizeof(names) / sizeof(names[0])) {
+        return "unknown";
+    }
+    return names[status];
+}
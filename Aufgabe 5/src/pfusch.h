@@ -0,0 +1,70 @@
+#ifndef PFUSCH_H
+#define PFUSCH_H
+
+#include <stdio.h>
+
+// Embedding interface of libpfusch.a. Every instance owns its grid, stack,
+// caches and I/O callbacks; a run never prints or exits, it returns how the
+// program stopped. An instance must only be used by one thread at a time.
+
+// Result of pfusch_run
+enum pfusch_status {
+    PFUSCH_ENDED,                       // the program reached 'e'
+    PFUSCH_STEP_LIMIT,                  // max_steps executed
+    PFUSCH_STACK_UNDERFLOW,
+    PFUSCH_STACK_OVERFLOW,
+    PFUSCH_OUT_OF_BOUNDS,               // the instruction pointer left the grid
+    PFUSCH_CELL_OUT_OF_BOUNDS,          // a cell outside the grid was read or written
+    PFUSCH_INVALID_INSTRUCTION,
+    PFUSCH_JUMP_TARGET_NOT_FOUND,
+    PFUSCH_DIVISION_BY_ZERO,
+    PFUSCH_INVALID_OUTPUT,
+    PFUSCH_INVALID_START,               // the first cell is not a flow control instruction
+    PFUSCH_LOAD_ERROR,
+    PFUSCH_TIME_LIMIT,                  // the run took longer than its time limit
+    PFUSCH_LOOPS_FOREVER,               // the program repeated a state (see pfusch_set_limits)
+    PFUSCH_OUT_OF_MEMORY                // the stack could not grow
+};
+
+// Program I/O. read returns the next input byte or EOF (read as 0); write
+// receives every run of output bytes. NULL callbacks read EOF and drop output.
+struct pfusch_io {
+    int (*read)(void *user);
+    void (*write)(void *user, const char *bytes, int count);
+    void *user;
+};
+
+typedef struct pfusch pfusch;
+
+// pfusch_create returns NULL when out of memory; a stack that cannot grow
+// later stops the run with PFUSCH_OUT_OF_MEMORY instead of exiting.
+// pfusch_load returns 0, or -1 with the reason in pfusch_error; a loaded
+// program starts over with pfusch_reset, and pfusch_run continues it until
+// it stops or max_steps more steps have run. Once it has stopped, pfusch_run
+// returns the same status until the next reset or load. pfusch_clone makes
+// a new instance with the loaded program of p, without decoding it again;
+// several threads may clone the same instance as long as none modifies it.
+//
+// pfusch_set_limits makes each pfusch_run stop early: after time_limit
+// seconds (0 for none), or for good with PFUSCH_LOOPS_FOREVER once
+// loop_check finds the program back in a state it was in before. Both are
+// checked every LOOP_CHECK_INTERVAL steps (see loopDetector.h).
+// pfusch_set_stack_size sets the depth at which a push overflows (1000 by
+// default) for the runs after the next reset or load.
+// pfusch_steps counts the steps run since the last reset or load.
+
+// Function declarations
+pfusch *pfusch_create(const struct pfusch_io *io);
+pfusch *pfusch_clone(const pfusch *p, const struct pfusch_io *io);
+void pfusch_destroy(pfusch *p);
+int pfusch_load(pfusch *p, FILE *fp);
+int pfusch_load_string(pfusch *p, const char *source);
+void pfusch_reset(pfusch *p);
+void pfusch_set_limits(pfusch *p, double time_limit, int loop_check);
+void pfusch_set_stack_size(pfusch *p, int entries);
+enum pfusch_status pfusch_run(pfusch *p, long max_steps);
+long pfusch_steps(const pfusch *p);
+const char *pfusch_error(const pfusch *p);
+const char *pfusch_status_name(enum pfusch_status status);
+
+#endif // PFUSCH_H
@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "benchPrograms.h"
+
+// Benchmark driver: generates the benchmark programs, runs each of them
+// headless with a fixed step limit and reports steps/sec, ns/step and peak
+// RSS (min and median over the repetitions). With a baseline file the
+// medians are compared against a saved run, and runs that got slower than
+// the threshold are reported as regressions.
+
+#define DEFAULT_STEPS 10000000L
+#define DEFAULT_REPETITIONS 5
+#define DEFAULT_THRESHOLD 10.0
+#define MAX_REPETITIONS 101
+#define MAX_EXTRA_ARGS 16
+
+struct benchmark {
+    const char *name;
+    enum bench_kind kind;
+    int size;
+};
+
+static const struct benchmark benchmarks[] = {
+    { "count-tight", BENCH_COUNT, 0 },
+    { "count-wide", BENCH_COUNT, 24 },
+    { "jump-near", BENCH_JUMP, 0 },
+    { "jump-far", BENCH_JUMP, 12 },
+    { "selfmod-tight", BENCH_SELFMOD, 0 },
+    { "selfmod-wide", BENCH_SELFMOD, 48 },
+    { "output-short", BENCH_OUTPUT, 8 },
+    { "output-wide", BENCH_OUTPUT, 64 },
+};
+#define BENCHMARK_COUNT ((int)(sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+struct result {
+    double min_ns;              // ns per step
+    double median_ns;
+    long min_rss;               // peak RSS in KiB
+    long median_rss;
+};
+
+// Saved medians of an earlier run
+struct baseline_entry {
+    char name[64];
+    double median_ns;
+    long median_rss;
+};
+
+static struct baseline_entry baseline[64];
+static int baseline_count = 0;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int compare_longs(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Run the interpreter once; returns the wall time in ns, or -1 if the run
+// did not reach the step limit
+static long run_once(char *const args[], long *rss) {
+    long start = now_ns();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Error starting the interpreter");
+        return -1;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(args[0], args);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("Error waiting for the interpreter");
+        return -1;
+    }
+    long elapsed = now_ns() - start;
+    *rss = usage.ru_maxrss;
+    // The programs never end, so only a run stopped by the step limit is valid
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : -1;
+}
+
+static int run_benchmark(const struct benchmark *benchmark, const char *pfusch, const char *directory,
+                         long steps, int repetitions, char *extra[], int extra_count, struct result *result) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.pfusch", directory, benchmark->name);
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror("Error writing benchmark program");
+        return -1;
+    }
+    write_bench_program(fp, benchmark->kind, benchmark->size);
+    fclose(fp);
+
+    char limit[32];
+    snprintf(limit, sizeof(limit), "%ld", steps);
+    char *args[8 + MAX_EXTRA_ARGS] = { (char *)pfusch, path, "--no-visual", "--no-loop-check", "--max-steps", limit };
+    int count = 6;
+    for (int i = 0; i < extra_count; i++) {
+        args[count++] = extra[i];
+    }
+    args[count] = NULL;
+
+    double ns[MAX_REPETITIONS];
+    long rss[MAX_REPETITIONS];
+    for (int i = 0; i < repetitions; i++) {
+        long elapsed = run_once(args, &rss[i]);
+        if (elapsed < 0) {
+            fprintf(stderr, "Error: %s did not run %ld steps (%s)\n", benchmark->name, steps, path);
+            return -1;
+        }
+        ns[i] = (double)elapsed / steps;
+    }
+    qsort(ns, repetitions, sizeof(double), compare_doubles);
+    qsort(rss, repetitions, sizeof(long), compare_longs);
+    result->min_ns = ns[0];
+    result->median_ns = ns[repetitions / 2];
+    result->min_rss = rss[0];
+    result->median_rss = rss[repetitions / 2];
+    return 0;
+}
+
+// Lines of "name median-ns-per-step median-rss-kib"; '#' starts a comment
+static int load_baseline(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), fp) && baseline_count < (int)(sizeof(baseline) / sizeof(baseline[0]))) {
+        struct baseline_entry *entry = &baseline[baseline_count];
+        if (line[0] != '#' && sscanf(line, "%63s %lf %ld", entry->name, &entry->median_ns, &entry->median_rss) == 3) {
+            baseline_count++;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+static const struct baseline_entry *find_baseline(const char *name) {
+    for (int i = 0; i < baseline_count; i++) {
+        if (strcmp(baseline[i].name, name) == 0) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    const char *pfusch = "./pfusch";
+    const char *directory = "build/bench";
+    const char *baseline_path = NULL;
+    const char *save_path = NULL;
+    long steps = DEFAULT_STEPS;
+    int repetitions = DEFAULT_REPETITIONS;
+    double threshold = DEFAULT_THRESHOLD;
+    char *extra[MAX_EXTRA_ARGS];
+    int extra_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pfusch") == 0 && i + 1 < argc) {
+            pfusch = argv[++i];
+        } else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            repetitions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--") == 0) {
+            // The rest goes to the interpreter, e.g. -- --engine reference
+            for (i++; i < argc && extra_count < MAX_EXTRA_ARGS; i++) {
+                extra[extra_count++] = argv[i];
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [--pfusch path] [--dir dir] [--steps n] [--repetitions n]\n"
+                            "       [--baseline file] [--save file] [--threshold percent] [-- interpreter args]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (steps <= 0 || repetitions < 1 || repetitions > MAX_REPETITIONS) {
+        fprintf(stderr, "Error: Steps must be positive and repetitions 1-%d\n", MAX_REPETITIONS);
+        return 1;
+    }
+    if (baseline_path && load_baseline(baseline_path) != 0) {
+        fprintf(stderr, "No baseline at %s yet (make bench-save writes one)\n", baseline_path);
+        baseline_path = NULL;
+    }
+    mkdir(directory, 0777);
+
+    FILE *save = NULL;
+    if (save_path) {
+        save = fopen(save_path, "w");
+        if (!save) {
+            perror("Error writing baseline");
+            return 1;
+        }
+        fprintf(save, "# pfuschbench baseline: name ns-per-step rss-kib (%ld steps, median of %d)\n", steps, repetitions);
+    }
+
+    printf("%ld steps per run, min/median of %d runs\n", steps, repetitions);
+    printf("%-14s %12s %9s %9s %9s %9s", "program", "steps/sec", "ns/step", "median", "RSS KiB", "median");
+    printf(baseline_path ? "  vs baseline\n" : "\n");
+
+    int failures = 0;
+    int regressions = 0;
+    for (int i = 0; i < BENCHMARK_COUNT; i++) {
+        const struct benchmark *benchmark = &benchmarks[i];
+        struct result result;
+        if (run_benchmark(benchmark, pfusch, directory, steps, repetitions, extra, extra_count, &result) != 0) {
+            failures++;
+            continue;
+        }
+        printf("%-14s %12.0f %9.2f %9.2f %9ld %9ld", benchmark->name, 1e9 / result.median_ns,
+               result.min_ns, result.median_ns, result.min_rss, result.median_rss);
+
+        const struct baseline_entry *entry = baseline_path ? find_baseline(benchmark->name) : NULL;
+        if (entry) {
+            double change = (result.median_ns - entry->median_ns) / entry->median_ns * 100.0;
+            int slower = change > threshold;
+            regressions += slower;
+            printf("  %+6.1f%% time %+6.1f%% RSS%s", change,
+                   (double)(result.median_rss - entry->median_rss) / entry->median_rss * 100.0,
+                   slower ? "  REGRESSION" : "");
+        } else if (baseline_path) {
+            printf("  (not in baseline)");
+        }
+        printf("\n");
+        fflush(stdout);
+
+        if (save) {
+            fprintf(save, "%s %.4f %ld\n", benchmark->name, result.median_ns, result.median_rss);
+        }
+    }
+    if (save) {
+        fclose(save);
+        printf("Baseline saved to %s\n", save_path);
+    }
+    if (regressions > 0) {
+        printf("%d benchmark(s) more than %.0f%% slower than the baseline\n", regressions, threshold);
+    }
+    return failures > 0 || regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interpreter.h"
+#include "hashTable.h"
+#include "analysis.h"
+
+// Ahead-of-time compiler: translates a Pfusch program into a standalone C
+// file with one label per reachable (cell, direction) state. The generated
+// program behaves like "pfusch <program> --no-visual".
+
+static const int step_x[4] = { 0, 0, -1, 1 };
+static const int step_y[4] = { -1, 1, 0, 0 };
+static const enum direction right_of[4] = { RIGHT, LEFT, UP, DOWN };
+static const enum direction left_of[4] = { LEFT, RIGHT, DOWN, UP };
+static const char* const direction_names[4] = { "UP", "DOWN", "LEFT", "RIGHT" };
+static const char direction_letters[4] = { 'u', 'd', 'l', 'r' };
+
+// Reachable states and writable cells (see analysis.c)
+static struct program_analysis analysis;
+
+// Runtime emitted in front of the compiled states: limits, error reporting
+// matching the interpreter, and a plain interpreter that takes over when
+// the program overwrites one of its compiled cells
+static const char* const runtime_source[] = {
+    "#include <stdio.h>",
+    "#include <stdlib.h>",
+    "",
+    "#define STACK_SIZE 1000",
+    "#define MAX_STEPS 1000000L",
+    "",
+    "static void fail(const char *message) {",
+    "    fflush(stdout);",
+    "    fputs(message, stderr);",
+    "    exit(1);",
+    "}",
+    "",
+    "static void fail_cell(const char *what, int x, int y) {",
+    "    fflush(stdout);",
+    "    fprintf(stderr, \"Error: %s cell outside bounds (%d, %d)\\n\", what, x, y);",
+    "    exit(1);",
+    "}",
+    "",
+    "static void fail_output(int value) {",
+    "    fflush(stdout);",
+    "    fprintf(stderr, \"Error: Invalid ASCII value for output: %d (must be 0-127)\\n\", value);",
+    "    exit(1);",
+    "}",
+    "",
+    "static void fail_instruction(int x, int y, int value) {",
+    "    unsigned char ch = (unsigned char)value;",
+    "    fflush(stdout);",
+    "    fprintf(stderr, \"Error: Invalid instruction at (%d, %d): ASCII %d (%s)\\n\", x, y, ch,",
+    "            ch > 127 ? \"must be 7-bit ASCII\" : \"control character\");",
+    "    exit(1);",
+    "}",
+    "",
+    "static void fail_move(const char *direction) {",
+    "    fflush(stdout);",
+    "    fprintf(stderr, \"Error: Instruction pointer moved outside bounds (%s)\\n\", direction);",
+    "    exit(1);",
+    "}",
+    "",
+    "static void report_empty_peek(void) {",
+    "    fflush(stdout);",
+    "    fputs(\"Error: Stack is empty - cannot peek\\n\", stderr);",
+    "}",
+    "",
+    "static void program_end(void) {",
+    "    printf(\"\\nProgram ended normally.\\n\");",
+    "    exit(0);",
+    "}",
+    "",
+    "static void program_stopped(void) {",
+    "    printf(\"\\nExecution stopped after 1000000 steps to prevent infinite loop.\\n\");",
+    "    exit(0);",
+    "}",
+    "",
+    "#define FAIL_PEEK() fail(\"Error: Stack is empty - cannot peek\\n\")",
+    "#define PEEK() do { if (top < 0) FAIL_PEEK(); } while (0)",
+    "#define POP(v) do { if (top < 0) fail(\"Error: Stack underflow - cannot pop from empty stack\\n\"); (v) = stack[top--]; } while (0)",
+    "#define PUSH(v) do { if (top >= STACK_SIZE - 1) fail(\"Error: Stack overflow\\n\"); stack[++top] = (v); } while (0)",
+    "#define STEP() do { if (steps >= MAX_STEPS) program_stopped(); steps++; } while (0)",
+    "#define OUTPUT(v) do { int c_ = (v); if (c_ < 0 || c_ > 127) fail_output(c_); putchar(c_); } while (0)",
+    "#define INPUT(v) do { fflush(stdout); (v) = getchar(); if ((v) == EOF) (v) = 0; } while (0)",
+    "",
+    "static const int step_x[4] = { 0, 0, -1, 1 };",
+    "static const int step_y[4] = { -1, 1, 0, 0 };",
+    "static const int right_of[4] = { 3, 2, 0, 1 };",
+    "static const int left_of[4] = { 2, 3, 1, 0 };",
+    "static const char *const direction_names[4] = { \"UP\", \"DOWN\", \"LEFT\", \"RIGHT\" };",
+    "",
+    "static int cell_at(int x, int y) {",
+    "    if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT) fail_cell(\"Accessing\", x, y);",
+    "    return grid[y][x];",
+    "}",
+    "",
+    "static void set_cell(int x, int y, int value) {",
+    "    if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT) fail_cell(\"Setting\", x, y);",
+    "    grid[y][x] = value;",
+    "}",
+    "",
+    "static int find_jump_target(int *x, int *y, int dir, int value) {",
+    "    int tx = *x + step_x[dir], ty = *y + step_y[dir];",
+    "    for (; tx >= 0 && tx < GRID_WIDTH && ty >= 0 && ty < GRID_HEIGHT; tx += step_x[dir], ty += step_y[dir]) {",
+    "        if (grid[ty][tx] == value) { *x = tx; *y = ty; return 0; }",
+    "    }",
+    "    fail(\"Error: Jump target not found\\n\");",
+    "    return -1;",
+    "}",
+    "",
+    "// Plain interpreter, used once a compiled cell has been overwritten",
+    "static void interpret(int x, int y, int dir, long steps, int *stack, int top) {",
+    "    int v, c;",
+    "    for (; steps < MAX_STEPS; steps++) {",
+    "        unsigned char ch = (unsigned char)grid[y][x];",
+    "        switch (instruction_class[ch]) {",
+    "            case 'h': dir = 2; break;",
+    "            case 'j': dir = 1; break;",
+    "            case 'k': dir = 0; break;",
+    "            case 'l': dir = 3; break;",
+    "            case 'H': case 'J': case 'K': case 'L':",
+    "                PEEK();",
+    "                dir = ch == 'H' ? 2 : ch == 'J' ? 1 : ch == 'K' ? 0 : 3;",
+    "                find_jump_target(&x, &y, dir, stack[top]);",
+    "                continue;",
+    "            case 'x':",
+    "                if (top < 0) report_empty_peek(); else if (stack[top] > 0) dir = right_of[dir];",
+    "                break;",
+    "            case 'X':",
+    "                if (top < 0) report_empty_peek(); else if (stack[top] < 0) dir = left_of[dir];",
+    "                break;",
+    "            case 'e': program_end(); break;",
+    "            case 's': c = cell_at(x, y + 1); PUSH(c); break;",
+    "            case 'S': c = cell_at(x, y - 1); PUSH(c); break;",
+    "            case 'd': PEEK(); v = stack[top]; PUSH(v); break;",
+    "            case 'D': POP(v); break;",
+    "            case 'a': PEEK(); stack[top] += cell_at(x, y + 1); break;",
+    "            case 'A': PEEK(); stack[top] += cell_at(x, y - 1); break;",
+    "            case 'r': PEEK(); stack[top] -= cell_at(x, y + 1); break;",
+    "            case 'R': PEEK(); stack[top] -= cell_at(x, y - 1); break;",
+    "            case 'p': PEEK(); stack[top] *= cell_at(x, y + 1); break;",
+    "            case 'P': PEEK(); stack[top] *= cell_at(x, y - 1); break;",
+    "            case 'q': case 'Q': case 'm': case 'M':",
+    "                PEEK();",
+    "                c = cell_at(x, y + (ch == 'q' || ch == 'm' ? 1 : -1));",
+    "                if (c == 0) fail(\"Error: Division by zero\\n\");",
+    "                stack[top] = ch == 'q' || ch == 'Q' ? stack[top] / c : stack[top] % c;",
+    "                break;",
+    "            case 'f': POP(v); set_cell(x, y + 1, v); break;",
+    "            case 'F': POP(v); set_cell(x, y - 1, v); break;",
+    "            case 'o': OUTPUT(cell_at(x, y + 1)); break;",
+    "            case 'O': OUTPUT(cell_at(x, y - 1)); break;",
+    "            case 'i': INPUT(v); set_cell(x, y + 1, v); break;",
+    "            case 'I': INPUT(v); set_cell(x, y - 1, v); break;",
+    "            case '!': fail_instruction(x, y, grid[y][x]); break;",
+    "            default: break;",
+    "        }",
+    "        x += step_x[dir];",
+    "        y += step_y[dir];",
+    "        if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT) fail_move(direction_names[dir]);",
+    "    }",
+    "    program_stopped();",
+    "}",
+    "",
+    "// Leave compiled code if a write changed the instruction in a compiled cell",
+    "#define CHECK_CODE(x, y, original, nx, ny, ndir) do { \\",
+    "        if (instruction_class[(unsigned char)grid[y][x]] != instruction_class[(unsigned char)(original)]) \\",
+    "            interpret(nx, ny, ndir, steps, stack, top); \\",
+    "    } while (0)",
+    NULL
+};
+
+static void emit_lines(FILE *out, const char* const *lines) {
+    for (int i = 0; lines[i]; i++) {
+        fprintf(out, "%s\n", lines[i]);
+    }
+}
+
+static int inside(int x, int y) {
+    return x >= 0 && x < GRID_WIDTH && y >= 0 && y < GRID_HEIGHT;
+}
+
+static void emit_label(FILE *out, int x, int y, enum direction dir) {
+    fprintf(out, "s_%d_%d_%c", x, y, direction_letters[dir]);
+}
+
+// Continue with the next cell in dir, or fail if that leaves the grid
+static void emit_move(FILE *out, int x, int y, enum direction dir) {
+    int nx = x + step_x[dir];
+    int ny = y + step_y[dir];
+    if (inside(nx, ny)) {
+        fprintf(out, "    goto ");
+        emit_label(out, nx, ny, dir);
+        fprintf(out, ";\n");
+    } else {
+        fprintf(out, "    fail_move(\"%s\");\n", direction_names[dir]);
+    }
+}
+
+// Operand expression: a constant if no reachable write can change the cell
+static void emit_operand(FILE *out, int x, int y) {
+    if (!inside(x, y)) {
+        fprintf(out, "cell_at(%d, %d)", x, y);
+    } else if (analysis.writable[y][x]) {
+        fprintf(out, "grid[%d][%d]", y, x);
+    } else {
+        fprintf(out, "%d", grid[y][x]);
+    }
+}
+
+static void emit_arithmetic(FILE *out, int x, int y, const char *op) {
+    fprintf(out, "    PEEK();\n    stack[top] %s= ", op);
+    emit_operand(out, x, y);
+    fprintf(out, ";\n");
+}
+
+static void emit_division(FILE *out, int x, int y, const char *op) {
+    fprintf(out, "    PEEK();\n");
+    if (inside(x, y) && !analysis.writable[y][x]) {
+        if (grid[y][x] == 0) {
+            fprintf(out, "    fail(\"Error: Division by zero\\n\");\n");
+        } else {
+            fprintf(out, "    stack[top] %s= %d;\n", op, grid[y][x]);
+        }
+        return;
+    }
+    fprintf(out, "    c = ");
+    emit_operand(out, x, y);
+    fprintf(out, ";\n    if (c == 0) fail(\"Error: Division by zero\\n\");\n");
+    fprintf(out, "    stack[top] %s= c;\n", op);
+}
+
+// Store v into (x, y); leave for the interpreter if that changed code
+static void emit_store(FILE *out, int x, int y, int from_x, int from_y, enum direction dir) {
+    if (!inside(x, y)) {
+        fprintf(out, "    set_cell(%d, %d, v);\n", x, y);
+        return;
+    }
+    fprintf(out, "    grid[%d][%d] = v;\n", y, x);
+    int nx = from_x + step_x[dir];
+    int ny = from_y + step_y[dir];
+    if (analysis.code_cell[y][x] && inside(nx, ny)) {
+        fprintf(out, "    CHECK_CODE(%d, %d, %d, %d, %d, %d);\n", x, y, grid[y][x], nx, ny, (int)dir);
+    }
+}
+
+static void emit_jump(FILE *out, int x, int y, enum direction dir) {
+    fprintf(out, "    PEEK();\n    tx = %d;\n    ty = %d;\n", x, y);
+    fprintf(out, "    find_jump_target(&tx, &ty, %d, stack[top]);\n", (int)dir);
+    fprintf(out, "    switch (%s) {\n", dir == LEFT || dir == RIGHT ? "tx" : "ty");
+    for (int tx = x + step_x[dir], ty = y + step_y[dir]; inside(tx, ty); tx += step_x[dir], ty += step_y[dir]) {
+        fprintf(out, "        case %d: goto ", dir == LEFT || dir == RIGHT ? tx : ty);
+        emit_label(out, tx, ty, dir);
+        fprintf(out, ";\n");
+    }
+    fprintf(out, "    }\n");
+}
+
+static void emit_state(FILE *out, int x, int y, enum direction dir) {
+    enum opcode op = analysis.opcodes[y][x];
+
+    emit_label(out, x, y, dir);
+    fprintf(out, ":\n    STEP();\n");
+    switch (op) {
+        case OP_NOP: break;
+        case OP_LEFT: dir = LEFT; break;
+        case OP_DOWN: dir = DOWN; break;
+        case OP_UP: dir = UP; break;
+        case OP_RIGHT: dir = RIGHT; break;
+        case OP_JUMP_LEFT: emit_jump(out, x, y, LEFT); return;
+        case OP_JUMP_DOWN: emit_jump(out, x, y, DOWN); return;
+        case OP_JUMP_UP: emit_jump(out, x, y, UP); return;
+        case OP_JUMP_RIGHT: emit_jump(out, x, y, RIGHT); return;
+        case OP_TURN_RIGHT:
+        case OP_TURN_LEFT:
+            fprintf(out, "    if (top < 0) report_empty_peek();\n");
+            fprintf(out, "    else if (stack[top] %s 0) {\n", op == OP_TURN_RIGHT ? ">" : "<");
+            emit_move(out, x, y, op == OP_TURN_RIGHT ? right_of[dir] : left_of[dir]);
+            fprintf(out, "    }\n");
+            break;
+        case OP_END: fprintf(out, "    program_end();\n"); return;
+        case OP_STORE_BELOW:
+        case OP_STORE_ABOVE:
+            fprintf(out, "    c = ");
+            emit_operand(out, x, op == OP_STORE_BELOW ? y + 1 : y - 1);
+            fprintf(out, ";\n    PUSH(c);\n");
+            break;
+        case OP_DUPLICATE: fprintf(out, "    PEEK();\n    v = stack[top];\n    PUSH(v);\n"); break;
+        case OP_DELETE: fprintf(out, "    POP(v);\n"); break;
+        case OP_ADD_BELOW: emit_arithmetic(out, x, y + 1, "+"); break;
+        case OP_ADD_ABOVE: emit_arithmetic(out, x, y - 1, "+"); break;
+        case OP_REDUCE_BELOW: emit_arithmetic(out, x, y + 1, "-"); break;
+        case OP_REDUCE_ABOVE: emit_arithmetic(out, x, y - 1, "-"); break;
+        case OP_MULTIPLY_BELOW: emit_arithmetic(out, x, y + 1, "*"); break;
+        case OP_MULTIPLY_ABOVE: emit_arithmetic(out, x, y - 1, "*"); break;
+        case OP_DIVIDE_BELOW: emit_division(out, x, y + 1, "/"); break;
+        case OP_DIVIDE_ABOVE: emit_division(out, x, y - 1, "/"); break;
+        case OP_MODULO_BELOW: emit_division(out, x, y + 1, "%"); break;
+        case OP_MODULO_ABOVE: emit_division(out, x, y - 1, "%"); break;
+        case OP_FETCH_BELOW:
+        case OP_FETCH_ABOVE:
+            fprintf(out, "    POP(v);\n");
+            emit_store(out, x, op == OP_FETCH_BELOW ? y + 1 : y - 1, x, y, dir);
+            break;
+        case OP_OUTPUT_BELOW:
+        case OP_OUTPUT_ABOVE:
+            fprintf(out, "    OUTPUT(");
+            emit_operand(out, x, op == OP_OUTPUT_BELOW ? y + 1 : y - 1);
+            fprintf(out, ");\n");
+            break;
+        case OP_INPUT_BELOW:
+        case OP_INPUT_ABOVE:
+            fprintf(out, "    INPUT(v);\n");
+            emit_store(out, x, op == OP_INPUT_BELOW ? y + 1 : y - 1, x, y, dir);
+            break;
+        case OP_INVALID:
+        default:
+            fprintf(out, "    fail_instruction(%d, %d, grid[%d][%d]);\n", x, y, y, x);
+            return;
+    }
+    emit_move(out, x, y, dir);
+}
+
+static void emit_program(FILE *out, const char *source_name) {
+    fprintf(out, "// Generated by pfuschc from %s; do not edit.\n", source_name);
+    fprintf(out, "#define GRID_HEIGHT %d\n#define GRID_WIDTH %d\n\n", GRID_HEIGHT, GRID_WIDTH);
+
+    fprintf(out, "static int grid[GRID_HEIGHT][GRID_WIDTH] = {\n");
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        fprintf(out, "    {");
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            fprintf(out, "%s%d", x ? "," : "", grid[y][x]);
+        }
+        fprintf(out, "},\n");
+    }
+    fprintf(out, "};\n\n");
+
+    // Instruction class of every byte: the instruction character, ' ' for
+    // no-ops and '!' for invalid instructions
+    fprintf(out, "static const unsigned char instruction_class[256] = {");
+    for (int ch = 0; ch < 256; ch++) {
+        enum opcode op = get_instruction_opcode((char)ch);
+        int class = op == OP_NOP ? ' ' : op == OP_INVALID ? '!' : ch;
+        fprintf(out, "%s%d", ch == 0 ? "\n    " : ch % 32 ? "," : ",\n    ", class);
+    }
+    fprintf(out, "\n};\n\n");
+
+    emit_lines(out, runtime_source);
+
+    fprintf(out, "\nint main(void) {\n");
+    fprintf(out, "    int stack[STACK_SIZE] = { 0 };\n    int top = -1;\n    long steps = 0;\n");
+    fprintf(out, "    int v, c, tx, ty;\n");
+    fprintf(out, "    (void)stack; (void)top; (void)v; (void)c; (void)tx; (void)ty; (void)interpret;\n\n");
+    fprintf(out, "    printf(\"Starting Pfusch interpreter...\\n\");\n");
+    fprintf(out, "    goto ");
+    emit_label(out, 0, 0, RIGHT);
+    fprintf(out, ";\n\n");
+    for (int i = 0; i < analysis.queue_length; i++) {
+        int state = analysis.queue[i];
+        emit_state(out, (state / 4) % GRID_WIDTH, (state / 4) / GRID_WIDTH, (enum direction)(state % 4));
+    }
+    fprintf(out, "}\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *output_name = NULL;
+    const char *source_name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_name = argv[++i];
+        } else {
+            source_name = argv[i];
+        }
+    }
+    if (!source_name) {
+        fprintf(stderr, "Usage: %s <pfusch program> [-o output.c]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(source_name, "r");
+    if (!fp) {
+        perror("Error opening file");
+        return 1;
+    }
+    init_hash_table();
+    init_grid();
+    load_program(fp);
+    fclose(fp);
+
+    enum opcode first = get_instruction_opcode((char)grid[0][0]);
+    if (first < OP_LEFT || first > OP_JUMP_RIGHT) {
+        fprintf(stderr, "Error: Program must start with a flow control instruction\n");
+        cleanup_hash_table();
+        return 1;
+    }
+
+    analyze_program(&analysis);
+
+    FILE *out = output_name ? fopen(output_name, "w") : stdout;
+    if (!out) {
+        perror("Error opening output file");
+        cleanup_hash_table();
+        return 1;
+    }
+    emit_program(out, source_name);
+    if (out != stdout) {
+        fclose(out);
+    }
+    cleanup_hash_table();
+    return 0;
+}
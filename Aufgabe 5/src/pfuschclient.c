@@ -0,0 +1,213 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "pfusch.h"
+#include "server.h"
+#include "frame.h"
+#include "input.h"
+
+// Client of "pfusch --serve": sends a program and its input (stdin or
+// --input) to the server, prints the output of the run on stdout and the
+// status and step count on stderr. With --repeat the request is sent again
+// on the same connection, by program id, and the request rate is reported.
+
+struct request {
+    int kind;
+    uint64_t id;
+    const char *program;
+    size_t program_length;
+    const char *input;
+    size_t input_length;
+    long max_steps;
+};
+
+struct reply {
+    int status;
+    uint64_t id;
+    long steps;
+    char *output;
+    size_t output_length;
+    char *error;
+};
+
+// Whole file (or stdin for NULL) in memory; NULL if it cannot be read
+static const char *read_all(const char *path, size_t *length) {
+    if (path) {
+        const char *mapped = map_file(path, length);
+        if (mapped) {
+            return mapped;
+        }
+    }
+    int fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+        return NULL;
+    }
+    char *data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    for (;;) {
+        if (size == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            char *grown = realloc(data, capacity);
+            if (!grown) {
+                free(data);
+                return NULL;
+            }
+            data = grown;
+        }
+        ssize_t count = read(fd, data + size, capacity - size);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        size += (size_t)count;
+    }
+    if (path) {
+        close(fd);
+    }
+    *length = size;
+    return data;
+}
+
+// Send a request and wait for its reply; -1 if the server hung up
+static int exchange(int fd, const struct request *request, struct reply *reply) {
+    unsigned char header[SERVE_HEADER_SIZE];
+    memcpy(header, SERVE_REQUEST_MAGIC, 4);
+    header[4] = (unsigned char)request->kind;
+    put_fixed(header + 5, request->id, 8);
+    put_fixed(header + 13, request->kind == SERVE_SOURCE ? request->program_length : 0, 4);
+    put_fixed(header + 17, request->input_length, 4);
+    put_fixed(header + 21, (uint64_t)request->max_steps, 8);
+    if (write_full(fd, header, sizeof(header)) != 0 ||
+        (request->kind == SERVE_SOURCE && write_full(fd, request->program, request->program_length) != 0) ||
+        write_full(fd, request->input, request->input_length) != 0) {
+        return -1;
+    }
+
+    if (read_full(fd, header, sizeof(header)) != 0 || memcmp(header, SERVE_REPLY_MAGIC, 4) != 0) {
+        return -1;
+    }
+    reply->status = header[4];
+    reply->id = get_fixed(header + 5, 8);
+    reply->steps = (long)get_fixed(header + 13, 8);
+    reply->output_length = (size_t)get_fixed(header + 21, 4);
+    size_t error_length = (size_t)get_fixed(header + 25, 4);
+    free(reply->output);
+    free(reply->error);
+    reply->output = malloc(reply->output_length + 1);
+    reply->error = malloc(error_length + 1);
+    if (!reply->output || !reply->error ||
+        read_full(fd, reply->output, reply->output_length) != 0 ||
+        read_full(fd, reply->error, error_length) != 0) {
+        return -1;
+    }
+    reply->error[error_length] = '\0';
+    return 0;
+}
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    const char *program_path = NULL;
+    const char *input_path = NULL;
+    struct request request = { SERVE_SOURCE, 0, NULL, 0, NULL, 0, 0 };
+    long repeat = 1;
+    int usage = argc < 2;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--id") == 0 && i + 1 < argc) {
+            request.kind = SERVE_CACHED;
+            request.id = strtoull(argv[++i], NULL, 16);
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            request.max_steps = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atol(argv[++i]);
+        } else if (argv[i][0] != '-' && !program_path) {
+            program_path = argv[i];
+        } else {
+            usage = 1;
+        }
+    }
+    if (usage || (!program_path && request.kind == SERVE_SOURCE) || repeat < 1) {
+        fprintf(stderr, "Usage: %s <socket> <pfusch program> | --id program-id\n"
+                        "       [--input file] [--max-steps n] [--repeat n]\n", argv[0]);
+        return 1;
+    }
+
+    if (program_path) {
+        request.kind = SERVE_SOURCE;
+        request.program = read_all(program_path, &request.program_length);
+        if (!request.program) {
+            perror("Error opening file");
+            return 1;
+        }
+    }
+    request.input = read_all(input_path, &request.input_length);
+    if (!request.input) {
+        perror("Error opening input file");
+        return 1;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", argv[1]);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror("Error connecting to server");
+        return 1;
+    }
+
+    struct reply reply = { 0, 0, 0, NULL, 0, NULL };
+    double start = now_seconds();
+    for (long i = 0; i < repeat; i++) {
+        if (exchange(fd, &request, &reply) != 0) {
+            fprintf(stderr, "Error: The server closed the connection\n");
+            return 1;
+        }
+        if (reply.status == SERVE_UNKNOWN_PROGRAM && program_path) {
+            // Evicted from the server's cache; send the source again
+            request.kind = SERVE_SOURCE;
+            i--;
+            continue;
+        }
+        if (reply.status == SERVE_UNKNOWN_PROGRAM) {
+            fprintf(stderr, "Error: Program %016llx is not cached\n", (unsigned long long)request.id);
+            return 1;
+        }
+        // Repeats name the program by the id the server gave it
+        if (reply.id != 0) {
+            request.kind = SERVE_CACHED;
+            request.id = reply.id;
+        }
+    }
+    double seconds = now_seconds() - start;
+    close(fd);
+
+    fwrite(reply.output, 1, reply.output_length, stdout);
+    fflush(stdout);
+    fprintf(stderr, "%s after %ld steps, program %016llx\n", pfusch_status_name((enum pfusch_status)reply.status),
+            reply.steps, (unsigned long long)reply.id);
+    if (reply.error[0]) {
+        fprintf(stderr, "%s\n", reply.error);
+    }
+    if (repeat > 1) {
+        fprintf(stderr, "%ld requests in %.3f s (%.0f per second)\n", repeat, seconds, repeat / seconds);
+    }
+    return reply.status == PFUSCH_ENDED ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "benchPrograms.h"
+
+// Benchmark program generator: prints a synthetic Pfusch program of the
+// given kind (see benchPrograms.h) that fits the 42x69 grid.
+int main(int argc, char *argv[]) {
+    int kind = argc >= 2 ? bench_kind_from_name(argv[1]) : -1;
+    if (kind < 0 || argc > 3) {
+        fprintf(stderr, "Usage: %s count|jump|selfmod|output [size]\n", argv[0]);
+        return 1;
+    }
+    int size = argc == 3 ? atoi(argv[2]) : bench_default_size(kind);
+    if (write_bench_program(stdout, kind, size) != 0) {
+        fprintf(stderr, "Error: Size of a %s program must be 0-%d\n", bench_kind_name(kind), bench_max_size(kind));
+        return 1;
+    }
+    return 0;
+}
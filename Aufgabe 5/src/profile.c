@@ -0,0 +1,196 @@
+#include "profile.h"
+#include "hashTable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+_Thread_local struct profile *active_profile = NULL;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Index into instruction_hits for a cell value
+static int instruction_index(int value) {
+    return value >= 0 && value < 128 ? value : 128;
+}
+
+// Add the counted runs of a trace to its cells
+void profile_fold_trace(struct trace *trace) {
+    if (trace->runs == 0) {
+        return;
+    }
+    struct decoded_cell *cell = trace->entry;
+    for (int i = 0; i < trace->length; i++) {
+        active_profile->hits[cell - program_cells] += trace->runs;
+        cell += cell_offset[trace->direction];
+    }
+    trace->runs = 0;
+}
+
+// Count the cells of the running pass up to and including its current op,
+// for a pass that ends early; the stack effect of that op is left out as it
+// failed or only writes a cell
+static void count_partial_pass(struct profile *profile) {
+    struct trace *trace = profile->running;
+    struct decoded_cell *cell = trace->entry;
+    for (int i = 0; i <= profile->running_op->offset; i++) {
+        profile->hits[cell - program_cells]++;
+        cell += cell_offset[trace->direction];
+    }
+    int depth = 0;
+    int rise = 0;
+    for (struct trace_op *op = trace->ops; op < profile->running_op; op++) {
+        depth += trace_op_stack_effect(op->opcode);
+        rise = depth > rise ? depth : rise;
+    }
+    profile_stack(profile, profile->running_top + rise);
+    profile->running = NULL;
+}
+
+// Called by set_cell_value before (x, y) changes, after the traces running
+// through it were invalidated. A pass ended by its own write is counted
+// here, before the cell gets a new value.
+void profile_cell_write(int x, int y) {
+    struct profile *profile = active_profile;
+    if (profile->running && !profile->running->valid) {
+        count_partial_pass(profile);
+    }
+
+    int index = GRID_INDEX(x, y);
+    profile->instruction_hits[instruction_index(grid[y][x])] += profile->hits[index] - profile->folded[index];
+    profile->folded[index] = profile->hits[index];
+}
+
+// Executions per cell, including the runs still counted in live traces
+void profile_count_cells(long hits[GRID_CELLS]) {
+    memcpy(hits, active_profile->hits, sizeof(active_profile->hits));
+    for (int i = 0; i < GRID_CELLS * 4; i++) {
+        struct trace *trace = trace_cache->slots[i];
+        if (!trace || trace->runs == 0) {
+            continue;
+        }
+        struct decoded_cell *cell = trace->entry;
+        for (int j = 0; j < trace->length; j++) {
+            hits[cell - program_cells] += trace->runs;
+            cell += cell_offset[trace->direction];
+        }
+    }
+}
+
+static int log2_floor(long value) {
+    int bits = 0;
+    while (value > 1) {
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+}
+
+// Heat of every cell on a log scale: 0 if never executed, up to HEAT_LEVELS
+void profile_heat_levels(unsigned char heat[GRID_HEIGHT][GRID_WIDTH]) {
+    static long hits[GRID_CELLS];
+    profile_count_cells(hits);
+    long max = 1;
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            max = hits[GRID_INDEX(x, y)] > max ? hits[GRID_INDEX(x, y)] : max;
+        }
+    }
+    int max_bits = log2_floor(max) > 0 ? log2_floor(max) : 1;
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            long count = hits[GRID_INDEX(x, y)];
+            heat[y][x] = count == 0 ? 0 : (unsigned char)(1 + log2_floor(count) * (HEAT_LEVELS - 1) / max_bits);
+        }
+    }
+}
+
+// Write the profile once, at the end of the run or at exit
+void profile_finish(void) {
+    struct profile *profile = active_profile;
+    if (!profile || !profile->path) {
+        return;
+    }
+    if (profile->running) {
+        count_partial_pass(profile);    // the run failed inside a trace
+    }
+    double seconds = (now_ns() - profile->start_ns) / 1e9;
+    static long hits[GRID_CELLS];
+    profile_count_cells(hits);
+
+    long steps = 0;
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            int index = GRID_INDEX(x, y);
+            profile->instruction_hits[instruction_index(grid[y][x])] += hits[index] - profile->folded[index];
+            profile->folded[index] = hits[index];
+            steps += hits[index];
+        }
+    }
+
+    FILE *fp = fopen(profile->path, "w");
+    profile->path = NULL;
+    if (!fp) {
+        perror("Error writing profile");
+        return;
+    }
+    fprintf(fp, "{\n  \"steps\": %ld,\n  \"seconds\": %.6f,\n", steps, seconds);
+    fprintf(fp, "  \"steps_per_second\": %.0f,\n", seconds > 0 ? steps / seconds : 0.0);
+    fprintf(fp, "  \"stack_high_water\": %d,\n", profile->stack_high_water);
+
+    // One entry per instruction registered in the hash table
+    long nops = 0;
+    long invalid = profile->instruction_hits[128];
+    fprintf(fp, "  \"instructions\": {");
+    const char *separator = "";
+    for (int ch = 0; ch < 128; ch++) {
+        if (get_instruction_handler((char)ch)) {
+            fprintf(fp, "%s\n    \"%c\": %ld", separator, ch, profile->instruction_hits[ch]);
+            separator = ",";
+        } else if (ch >= 32) {
+            nops += profile->instruction_hits[ch];
+        } else {
+            invalid += profile->instruction_hits[ch];
+        }
+    }
+    fprintf(fp, ",\n    \"nop\": %ld,\n    \"invalid\": %ld\n  },\n", nops, invalid);
+
+    fprintf(fp, "  \"jump_distances\": {");
+    separator = "";
+    for (int distance = 0; distance < GRID_WIDTH; distance++) {
+        if (profile->jump_distances[distance]) {
+            fprintf(fp, "%s\n    \"%d\": %ld", separator, distance, profile->jump_distances[distance]);
+            separator = ",";
+        }
+    }
+    fprintf(fp, "%s},\n", *separator ? "\n  " : "");
+
+    fprintf(fp, "  \"cells\": [");
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        fprintf(fp, "%s\n    [", y ? "," : "");
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            fprintf(fp, "%s%ld", x ? ", " : "", hits[GRID_INDEX(x, y)]);
+        }
+        fprintf(fp, "]");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+}
+
+// Start profiling; with a path, the profile is written there at exit
+void profile_start(const char *path) {
+    active_profile = calloc(1, sizeof(struct profile));
+    if (!active_profile) {
+        fprintf(stderr, "Error: Out of memory while starting the profiler\n");
+        exit(1);
+    }
+    active_profile->start_ns = now_ns();
+    active_profile->path = path;
+    if (path) {
+        atexit(profile_finish);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "trace.h"
+
+// Execution profile (--profile, --heatmap). The fast engine counts whole
+// trace runs in the trace and only the dispatched cells per cell, so the
+// counters cost a few increments per trace run; the runs are added to the
+// cells when a trace dies and when the counts are read.
+struct profile {
+    long hits[GRID_CELLS];                  // executions per cell
+    long folded[GRID_CELLS];                // part of hits already in instruction_hits
+    long instruction_hits[129];             // per cell value 0-127, 128 for all others
+    long jump_distances[GRID_WIDTH];        // H/J/K/L jumps by distance
+    int stack_high_water;                   // deepest stack seen
+    long start_ns;
+    const char *path;                       // JSON written here at exit, or NULL
+
+    // Trace pass in progress, and its op writing a cell or failing
+    struct trace *running;
+    struct trace_op *running_op;
+    int running_top;                        // stack top when the pass started
+};
+
+// Number of heat levels shown by the visualizer's heatmap
+#define HEAT_LEVELS 8
+
+// Profile of this thread's program, NULL when profiling is off
+extern _Thread_local struct profile *active_profile;
+
+static inline void profile_stack(struct profile *profile, int top) {
+    if (top + 1 > profile->stack_high_water) {
+        profile->stack_high_water = top + 1;
+    }
+}
+
+// A trace ran to its end, starting with the stack top at entry_top
+static inline void profile_trace_run(struct profile *profile, struct trace *trace, int entry_top) {
+    trace->runs++;
+    profile_stack(profile, entry_top + trace->max_rise);
+}
+
+static inline void profile_jump(struct profile *profile, int distance) {
+    profile->jump_distances[distance < 0 ? -distance : distance]++;
+}
+
+// Function declarations
+void profile_start(const char *path);
+void profile_finish(void);
+void profile_fold_trace(struct trace *trace);
+void profile_cell_write(int x, int y);
+void profile_count_cells(long hits[GRID_CELLS]);
+void profile_heat_levels(unsigned char heat[GRID_HEIGHT][GRID_WIDTH]);
+
+#endif // PROFILE_H
@@ -0,0 +1,158 @@
+#include "programCache.h"
+#include "decoder.h"
+#include "jumpIndex.h"
+#include "input.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PROGRAM_CACHE_MAGIC "PFUSCHPB"
+#define BYTE_ORDER_MARK 0x01020304u
+
+// load_program reads no further into a file, so only this much of the
+// source makes up the program
+#define SOURCE_LIMIT (GRID_HEIGHT * (GRID_WIDTH + 1))
+
+// Layout of a .pfb; it is mapped and checked as a whole
+struct program_file {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t width;
+    uint32_t height;
+    uint32_t opcode_count;
+    uint32_t zero;
+    uint64_t source_hash;
+    uint64_t source_length;
+    int cells[GRID_HEIGHT][GRID_WIDTH];
+    unsigned char opcodes[GRID_HEIGHT][GRID_WIDTH];
+    unsigned char fixed[GRID_HEIGHT][GRID_WIDTH];
+    struct jump_index jumps;
+    uint32_t checksum;
+};
+
+// Source of the program being loaded, hashed by load_program_cache
+static uint64_t source_hash;
+static uint64_t source_length;
+static int source_known = 0;
+
+static uint64_t hash_source(const char *source, size_t length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)source[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// FNV-1a over the 32-bit words in front of the checksum
+static uint32_t checksum(const struct program_file *file) {
+    const unsigned char *bytes = (const unsigned char *)file;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(struct program_file, checksum); i += 4) {
+        uint32_t word;
+        memcpy(&word, bytes + i, 4);
+        hash = (hash ^ word) * 16777619u;
+    }
+    return hash;
+}
+
+static void cache_path(char *path, size_t size, const char *dir) {
+    snprintf(path, size, "%s/%016llx.pfb", dir, (unsigned long long)source_hash);
+}
+
+static int valid_file(const struct program_file *file, size_t size) {
+    if (size != sizeof(*file) || memcmp(file->magic, PROGRAM_CACHE_MAGIC, 8) != 0 ||
+        file->version != PROGRAM_CACHE_VERSION || file->byte_order != BYTE_ORDER_MARK ||
+        file->width != GRID_WIDTH || file->height != GRID_HEIGHT || file->opcode_count != OP_COUNT ||
+        file->source_hash != source_hash || file->source_length != source_length ||
+        file->checksum != checksum(file)) {
+        return 0;
+    }
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            if (file->opcodes[y][x] >= OP_COUNT) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Load the program at program_path from its .pfb in dir, after init_grid:
+// the grid, the decoded image with its fixed cells and the jump index.
+// Returns 0, or -1 if there is no valid one; the caller then loads the
+// program itself and calls save_program_cache.
+int load_program_cache(const char *dir, const char *program_path) {
+    size_t length;
+    const char *source = map_file(program_path, &length);
+    if (!source) {
+        return -1;  // not a regular file; it is not cached
+    }
+    source_length = length < SOURCE_LIMIT ? length : SOURCE_LIMIT;
+    source_hash = hash_source(source, source_length);
+    source_known = 1;
+    unmap_file(source, length);
+
+    char path[4096];
+    cache_path(path, sizeof(path), dir);
+    size_t size;
+    const struct program_file *file = (const struct program_file *)map_file(path, &size);
+    if (!file) {
+        return -1;
+    }
+    int valid = valid_file(file, size);
+    if (valid) {
+        for (int y = 0; y < GRID_HEIGHT; y++) {
+            memcpy(grid[y], file->cells[y], sizeof(file->cells[y]));
+        }
+        restore_program(file->opcodes, file->fixed);
+        *jump_index = file->jumps;
+    }
+    unmap_file((const char *)file, size);
+    return valid ? 0 : -1;
+}
+
+// Write the loaded program to its .pfb, through a temporary file so that
+// concurrent runs only ever see complete ones
+void save_program_cache(const char *dir) {
+    if (!source_known) {
+        return;
+    }
+    static struct program_file file;
+    memset(&file, 0, sizeof(file));
+    memcpy(file.magic, PROGRAM_CACHE_MAGIC, 8);
+    file.version = PROGRAM_CACHE_VERSION;
+    file.byte_order = BYTE_ORDER_MARK;
+    file.width = GRID_WIDTH;
+    file.height = GRID_HEIGHT;
+    file.opcode_count = OP_COUNT;
+    file.source_hash = source_hash;
+    file.source_length = source_length;
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        memcpy(file.cells[y], grid[y], sizeof(file.cells[y]));
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            file.opcodes[y][x] = program_image[y][x].opcode;
+            file.fixed[y][x] = program_image[y][x].fixed;
+        }
+    }
+    file.jumps = *jump_index;
+    file.checksum = checksum(&file);
+
+    char path[4096];
+    char temporary[4200];
+    cache_path(path, sizeof(path), dir);
+    snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", path, (long)getpid());
+    mkdir(dir, 0777);
+    FILE *fp = fopen(temporary, "wb");
+    int written = fp && fwrite(&file, sizeof(file), 1, fp) == 1;
+    if (fp && fclose(fp) != 0) {
+        written = 0;
+    }
+    if (!written || rename(temporary, path) != 0) {
+        unlink(temporary);
+        fprintf(stderr, "Warning: Could not write program cache %s\n", path);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+// Precompiled programs (--cache-dir). After a program is loaded, decoded,
+// analysed and indexed, the result is written to <dir>/<hash>.pfb, where
+// hash is FNV-1a of the source; later runs of the same source map that
+// file instead of doing the work again. A .pfb holds, in the byte order
+// of the machine that wrote it:
+//   "PFUSCHPB", u32 version, u32 byte order mark, u32 grid width and
+//   height, u32 opcode count, u32 zero, u64 source hash, u64 source length,
+//   the cells as loaded, the opcode and fixed flag of every cell (see
+//   decoder.h), the jump index, and a u32 FNV-1a checksum of the rest.
+// A file from another version, machine or source is ignored and replaced.
+#define PROGRAM_CACHE_VERSION 1
+
+// Function declarations
+int load_program_cache(const char *dir, const char *program_path);
+void save_program_cache(const char *dir);
+
+#endif // PROGRAMCACHE_H
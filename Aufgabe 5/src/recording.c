@@ -0,0 +1,281 @@
+#include "recording.h"
+#include "visualizer.h"
+#include "output.h"
+#include "input.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static FILE *trace_file = NULL;
+static const char *trace_path;
+static unsigned char buffer[RECORDING_BUFFER_SIZE];
+static size_t length;
+static long flushed;                // bytes written to the file before buffer
+static int failed = 0;
+
+// Grid when the recording started; keyframes store the cells changed since
+static int first_cells[GRID_HEIGHT][GRID_WIDTH];
+
+static long step;                   // steps recorded, counted from first_step
+static long next_keyframe;
+
+struct keyframe {
+    long step;
+    long offset;
+};
+static struct keyframe *keyframes = NULL;
+static long keyframe_count = 0;
+static long keyframe_capacity = 0;
+
+// State before the step being recorded
+static struct {
+    struct instructionPointer ip;
+    int top;
+    int top_value;
+    int cell;                       // y * GRID_WIDTH + x of the cell the step may write, or -1
+    int cell_value;
+    long output_total;
+} before;
+
+static struct run_context context;
+
+static void flush_buffer(void) {
+    if (length > 0 && fwrite(buffer, 1, length, trace_file) != length) {
+        failed = 1;
+    }
+    flushed += (long)length;
+    length = 0;
+}
+
+static inline void put_byte(unsigned value) {
+    if (length == sizeof(buffer)) {
+        flush_buffer();
+    }
+    buffer[length++] = (unsigned char)value;
+}
+
+static void put_fixed(uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        put_byte((unsigned)(value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void put_varint(uint64_t value) {
+    while (value >= 0x80) {
+        put_byte((unsigned)(value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    put_byte((unsigned)value);
+}
+
+static void put_svarint(int value) {
+    put_varint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static void put_cell(int x, int y) {
+    put_fixed((uint64_t)(x + GRID_WIDTH * y), 2);
+}
+
+static void write_keyframe(const struct state *state) {
+    if (keyframe_count == keyframe_capacity) {
+        long grown = keyframe_capacity ? keyframe_capacity * 2 : 64;
+        struct keyframe *bigger = realloc(keyframes, grown * sizeof(*keyframes));
+        if (!bigger) {
+            failed = 1;
+            return;
+        }
+        keyframes = bigger;
+        keyframe_capacity = grown;
+    }
+    keyframes[keyframe_count].step = step;
+    keyframes[keyframe_count].offset = flushed + (long)length;
+    keyframe_count++;
+
+    put_byte(RECORD_KEYFRAME);
+    put_varint((uint64_t)step);
+    put_cell(state->ip.x, state->ip.y);
+    put_byte((unsigned)state->ip.direction);
+    put_varint((uint64_t)(state->stack.top + 1));
+    for (int i = 0; i <= state->stack.top; i++) {
+        put_svarint(state->stack.data[i]);
+    }
+    int changed = 0;
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            changed += grid[y][x] != first_cells[y][x];
+        }
+    }
+    put_varint((uint64_t)changed);
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            if (grid[y][x] != first_cells[y][x]) {
+                put_cell(x, y);
+                put_svarint(grid[y][x]);
+            }
+        }
+    }
+    char history[OUTPUT_SCROLLBACK];
+    long output_total;
+    int history_length = output_history(history, &output_total);
+    put_varint((uint64_t)output_total);
+    put_varint((uint64_t)history_length);
+    for (int i = 0; i < history_length; i++) {
+        put_byte((unsigned char)history[i]);
+    }
+    next_keyframe = step + RECORDING_KEYFRAME_INTERVAL;
+}
+
+// Program I/O of a recorded run, as without a run context
+static int recording_read(void *user) {
+    (void)user;
+    return input_byte();
+}
+
+static void recording_write(void *user, const char *bytes, int count) {
+    (void)user;
+    output_block(bytes, count);
+}
+
+// Start a trace at path with the current grid as its program; returns 0
+// or -1 after printing why
+int recording_start(const char *path, long first_step) {
+    trace_file = fopen(path, "wb");
+    if (!trace_file) {
+        perror("Error opening trace file");
+        return -1;
+    }
+    trace_path = path;
+    static const struct pfusch_io io = { recording_read, recording_write, NULL };
+    context.io = &io;
+    context.print_errors = 1;   // errors are printed when they happen, as without a trace
+
+    for (int i = 0; i < 8; i++) {
+        put_byte((unsigned char)RECORDING_MAGIC[i]);
+    }
+    put_varint(RECORDING_KEYFRAME_INTERVAL);
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            first_cells[y][x] = grid[y][x];
+            put_svarint(grid[y][x]);
+        }
+    }
+    step = first_step;
+    next_keyframe = step;
+    return 0;
+}
+
+static void before_step(const struct state *state) {
+    if (step >= next_keyframe) {
+        write_keyframe(state);
+    }
+    before.ip = state->ip;
+    before.top = state->stack.top;
+    before.top_value = state->stack.top >= 0 ? state->stack.data[state->stack.top] : 0;
+
+    // f, F, i and I write the cell below or above; a cell executes as its
+    // low byte, as in execute_step
+    char instruction = (char)grid_cells[GRID_INDEX(state->ip.x, state->ip.y)];
+    int target = instruction == 'f' || instruction == 'i' ? state->ip.y + 1 :
+                 instruction == 'F' || instruction == 'I' ? state->ip.y - 1 : -1;
+    before.cell = -1;
+    if (target >= 0 && target < GRID_HEIGHT) {
+        before.cell = target * GRID_WIDTH + state->ip.x;
+        before.cell_value = grid[target][state->ip.x];
+    }
+    before.output_total = output_written();
+}
+
+static void after_step(const struct state *state) {
+    static const int dx[] = { 0, 0, -1, 1 }, dy[] = { -1, 1, 0, 0 };
+    const struct instructionPointer *ip = &state->ip;
+    int tag = ip->direction;
+    int moved = ip->x == before.ip.x + dx[ip->direction] && ip->y == before.ip.y + dy[ip->direction];
+    int stack = 0;
+    if (state->stack.top == before.top + 1) {
+        stack = RECORD_PUSH;
+    } else if (state->stack.top == before.top - 1) {
+        stack = RECORD_POP;
+    } else if (before.top >= 0 && state->stack.top == before.top &&
+               state->stack.data[before.top] != before.top_value) {
+        stack = RECORD_REPLACE;
+    }
+    int written = before.cell >= 0 &&
+                  grid[before.cell / GRID_WIDTH][before.cell % GRID_WIDTH] != before.cell_value;
+    long output_total = output_written();
+
+    tag |= (moved ? 0 : RECORD_JUMP) | stack << RECORD_STACK_SHIFT;
+    tag |= (written ? RECORD_WRITE : 0) | (output_total != before.output_total ? RECORD_OUTPUT : 0);
+    put_byte((unsigned)tag);
+    if (!moved) {
+        put_cell(ip->x, ip->y);
+    }
+    if (stack == RECORD_PUSH || stack == RECORD_REPLACE) {
+        put_svarint(state->stack.data[state->stack.top]);
+    }
+    if (written) {
+        put_fixed((uint64_t)before.cell, 2);
+        put_svarint(grid[before.cell / GRID_WIDTH][before.cell % GRID_WIDTH]);
+    }
+    if (output_total != before.output_total) {
+        put_byte((unsigned char)output_byte(output_total - 1));
+    }
+    step++;
+}
+
+// Run count steps, recording each. When the program stops, the trace is
+// finished and the process ends as it does without a trace.
+void record_steps(struct state *state, long count) {
+    run_context = &context;
+    int stopped = setjmp(context.stop);
+    if (stopped == 0) {
+        for (long i = 0; i < count; i++) {
+            before_step(state);
+            execute_step(state);
+            after_step(state);
+        }
+        run_context = NULL;
+        return;
+    }
+    after_step(state);      // the stopping step may have changed the state
+    run_context = NULL;
+
+    enum pfusch_status status = (enum pfusch_status)(stopped - 1);
+    recording_finish(status);
+    if (status == PFUSCH_ENDED) {
+        printf("\nProgram ended normally.\n");
+    }
+    exit(status == PFUSCH_ENDED ? 0 : 1);
+}
+
+// Write the end record and the keyframe index and close the trace
+void recording_finish(enum pfusch_status status) {
+    if (!trace_file) {
+        return;
+    }
+    long end_offset = flushed + (long)length;
+    put_byte(RECORD_END);
+    put_varint((uint64_t)step);
+    put_byte((unsigned)status);
+    const char *message = status == PFUSCH_ENDED || status == PFUSCH_STEP_LIMIT ? "" : context.message;
+    int message_length = (int)strlen(message);
+    put_byte((unsigned)message_length);
+    for (int i = 0; i < message_length; i++) {
+        put_byte((unsigned char)message[i]);
+    }
+
+    for (long i = 0; i < keyframe_count; i++) {
+        put_fixed((uint64_t)keyframes[i].step, 8);
+        put_fixed((uint64_t)keyframes[i].offset, 8);
+    }
+    put_fixed((uint64_t)end_offset, 8);
+    put_fixed((uint64_t)keyframe_count, 8);
+    for (int i = 0; i < 8; i++) {
+        put_byte((unsigned char)RECORDING_INDEX_MAGIC[i]);
+    }
+    flush_buffer();
+    if (fclose(trace_file) != 0 || failed) {
+        fprintf(stderr, "Error: Could not write trace %s\n", trace_path);
+    }
+    trace_file = NULL;
+}
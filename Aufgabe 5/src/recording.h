@@ -0,0 +1,55 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "interpreter.h"
+
+// Execution trace of a headless run (--trace), shown again by --replay
+// (see replay.c). "varint" is an LEB128 number, "svarint" a zigzag-encoded
+// signed one, other numbers are little-endian.
+//   header: magic "PFTRACE1", varint keyframe interval and the program as
+//     loaded, one svarint per cell row by row
+//   a record per step, led by a tag byte:
+//     bits 0-1 direction after the step; bit 2 set when the IP did not
+//     move one cell in that direction, then u16 IP cell (x + 69 * y);
+//     bits 3-4 stack change (none, push, pop, replace), push and replace
+//     followed by the svarint new top value; bit 5 a cell written,
+//     u16 cell and svarint value; bit 6 an output byte, u8
+//   a keyframe (tag 0x80) before the first step and every interval steps:
+//     varint step, u16 IP cell, u8 direction, varint depth and the stack
+//     from the bottom as svarints, varint changed cells and (u16 cell,
+//     svarint value) for each, varint output bytes written, varint
+//     scrollback length and its bytes
+//   an end record (tag 0x81): varint steps, u8 status, u8 length and the
+//     error message
+//   footer: (u64 step, u64 offset) of each keyframe, u64 end record offset,
+//     u64 keyframe count, magic "PFTRIDX1"
+// The cell and opcode of a step follow from the IP and the replayed grid,
+// so they are not stored.
+
+#define RECORDING_MAGIC "PFTRACE1"
+#define RECORDING_INDEX_MAGIC "PFTRIDX1"
+
+// Tag byte of a step record
+#define RECORD_DIRECTION 0x03
+#define RECORD_JUMP 0x04
+#define RECORD_STACK_SHIFT 3
+#define RECORD_PUSH 1
+#define RECORD_POP 2
+#define RECORD_REPLACE 3
+#define RECORD_WRITE 0x20
+#define RECORD_OUTPUT 0x40
+#define RECORD_KEYFRAME 0x80
+#define RECORD_END 0x81
+
+// Steps between two keyframes
+#define RECORDING_KEYFRAME_INTERVAL 65536
+
+// Records are collected in a buffer of this size before they are written
+#define RECORDING_BUFFER_SIZE (1 << 20)
+
+// Function declarations
+int recording_start(const char *path, long first_step);
+void record_steps(struct state *state, long count);
+void recording_finish(enum pfusch_status status);
+
+#endif // RECORDING_H
@@ -0,0 +1,134 @@
+#include "renderThread.h"
+#include "visualizer.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The interpreter thread publishes snapshots through a lock-free triple
+// buffer: it fills the back buffer and swaps it with the middle one, the
+// render thread swaps the middle buffer with its front buffer whenever a
+// fresh one is waiting. Neither side ever blocks the other.
+#define SNAPSHOT_FRESH 4
+#define SNAPSHOT_INDEX 3
+
+struct snapshot_buffer {
+    struct visual_snapshot snapshot;
+    long log_epoch;             // write log position the grid copy is synced to
+    long log_position;
+};
+
+static struct snapshot_buffer buffers[3];
+static atomic_int middle = 1;
+static int back = 0;            // owned by the interpreter thread
+static int front = 2;           // owned by the render thread
+
+// Grid writes since the log was last reset; a snapshot only copies the
+// cells written since it was last filled. When the log is full it starts a
+// new epoch and every buffer gets a full copy once.
+#define WRITE_LOG_SIZE 4096
+static int write_log[WRITE_LOG_SIZE];
+static int write_log_length = 0;
+static long write_log_epoch = 1;
+
+static struct state *live_state = NULL;
+static long frame_interval_ns;
+static pthread_t render_thread;
+static atomic_int render_running = 0;
+
+static void sleep_ns(long ns) {
+    struct timespec ts = { ns / 1000000000L, ns % 1000000000L };
+    nanosleep(&ts, NULL);
+}
+
+// Record a grid write for the next snapshots (called from set_cell_value)
+void note_grid_write(int x, int y) {
+    if (!live_state) {
+        return;
+    }
+    if (write_log_length == WRITE_LOG_SIZE) {
+        write_log_length = 0;
+        write_log_epoch++;
+    }
+    write_log[write_log_length++] = y * GRID_STRIDE + x;
+}
+
+static void sync_grid(struct snapshot_buffer *buffer) {
+    int *cells = &buffer->snapshot.cells[0][0];
+    if (buffer->log_epoch != write_log_epoch) {
+        for (int y = 0; y < GRID_HEIGHT; y++) {
+            memcpy(buffer->snapshot.cells[y], grid[y], GRID_WIDTH * sizeof(int));
+        }
+    } else {
+        for (int i = buffer->log_position; i < write_log_length; i++) {
+            cells[write_log[i]] = grid[write_log[i] / GRID_STRIDE][write_log[i] % GRID_STRIDE];
+        }
+    }
+    buffer->log_epoch = write_log_epoch;
+    buffer->log_position = write_log_length;
+}
+
+// Copy the live state into the back buffer and hand it to the renderer
+void publish_snapshot(void) {
+    struct snapshot_buffer *buffer = &buffers[back];
+    struct visual_snapshot *snapshot = &buffer->snapshot;
+
+    snapshot->state.ip = live_state->ip;
+    // Only the entries the stack panel can show (one per grid row)
+    int top = live_state->stack.top;
+    int count = top + 1 < GRID_HEIGHT ? top + 1 : GRID_HEIGHT;
+    stack_copy(&snapshot->state.stack, &live_state->stack, count);
+    sync_grid(buffer);
+    snapshot_output(snapshot);
+    snapshot_heat(snapshot);
+
+    back = atomic_exchange(&middle, back | SNAPSHOT_FRESH) & SNAPSHOT_INDEX;
+}
+
+static void *render_loop(void *arg) {
+    (void)arg;
+    while (atomic_load(&render_running)) {
+        if (atomic_load(&middle) & SNAPSHOT_FRESH) {
+            front = atomic_exchange(&middle, front) & SNAPSHOT_INDEX;
+            draw_snapshot(&buffers[front].snapshot);
+        }
+        sleep_ns(frame_interval_ns);
+    }
+    return NULL;
+}
+
+// Start drawing snapshots of state at fps frames per second
+void start_render_thread(struct state *state, int fps) {
+    live_state = state;
+    frame_interval_ns = 1000000000L / (fps > 0 ? fps : DEFAULT_FPS);
+    for (int i = 0; i < 3; i++) {
+        buffers[i].log_epoch = 0;   // forces a full grid copy
+        buffers[i].snapshot.output_total = -1;
+    }
+    // The first frame is drawn before the program runs, so its screen clear
+    // cannot wipe a message printed by a program that ends at once
+    publish_snapshot();
+    front = atomic_exchange(&middle, front) & SNAPSHOT_INDEX;
+    draw_snapshot(&buffers[front].snapshot);
+
+    atomic_store(&render_running, 1);
+    if (pthread_create(&render_thread, NULL, render_loop, NULL) != 0) {
+        fprintf(stderr, "Error: Could not start the render thread\n");
+        exit(1);
+    }
+    // Also runs when the program ends or fails inside the interpreter
+    atexit(stop_render_thread);
+}
+
+// Stop the render thread and draw the final state
+void stop_render_thread(void) {
+    if (!atomic_exchange(&render_running, 0)) {
+        return;
+    }
+    pthread_join(render_thread, NULL);
+    publish_snapshot();
+    front = atomic_exchange(&middle, front) & SNAPSHOT_INDEX;
+    draw_snapshot(&buffers[front].snapshot);
+}
@@ -0,0 +1,15 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include "interpreter.h"
+
+// Frame rate used when --steps-per-second is given without --fps
+#define DEFAULT_FPS 30
+
+// Function declarations
+void start_render_thread(struct state *state, int fps);
+void publish_snapshot(void);
+void note_grid_write(int x, int y);
+void stop_render_thread(void);
+
+#endif // RENDERTHREAD_H
@@ -0,0 +1,411 @@
+#include "replay.h"
+#include "recording.h"
+#include "visualizer.h"
+#include "terminal.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Delay between two frames while playing
+#define FRAME_MS 40
+
+// Playing speed limits, in steps per second
+#define MIN_SPEED 1.0
+#define MAX_SPEED 1e9
+
+enum record_kind {
+    READ_STEP,
+    READ_KEYFRAME,
+    READ_END,
+    READ_FAILED             // broken record or the trace ends early
+};
+
+static FILE *trace_file = NULL;
+static char file_buffer[RECORDING_BUFFER_SIZE];
+static int first_cells[GRID_HEIGHT][GRID_WIDTH];
+
+struct keyframe {
+    long step;
+    long offset;
+};
+static struct keyframe *keyframes = NULL;
+static long keyframe_count = 0;
+
+static long current = -1;           // step of the replayed state, -1 before the first keyframe
+static long last_step = 0;
+static int end_status = -1;         // how the recorded run stopped, -1 if the trace has no end record
+static char end_message[256];
+
+static int get_fixed(uint64_t *value, int bytes) {
+    *value = 0;
+    for (int i = 0; i < bytes; i++) {
+        int c = getc(trace_file);
+        if (c == EOF) {
+            return -1;
+        }
+        *value |= (uint64_t)c << (8 * i);
+    }
+    return 0;
+}
+
+static int get_varint(uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(trace_file);
+        if (c == EOF) {
+            return -1;
+        }
+        *value |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int get_svarint(int *value) {
+    uint64_t field;
+    if (get_varint(&field) != 0 || field > UINT32_MAX) {
+        return -1;
+    }
+    uint32_t zigzag = (uint32_t)field;
+    *value = (int)((zigzag >> 1) ^ -(zigzag & 1));
+    return 0;
+}
+
+static int get_cell(int *x, int *y) {
+    uint64_t cell;
+    if (get_fixed(&cell, 2) != 0 || cell >= GRID_WIDTH * GRID_HEIGHT) {
+        return -1;
+    }
+    *x = (int)cell % GRID_WIDTH;
+    *y = (int)cell / GRID_WIDTH;
+    return 0;
+}
+
+static int read_keyframe(struct state *state) {
+    uint64_t step, depth, changed, output_total, history_length;
+    int direction;
+    if (get_varint(&step) != 0 || get_cell(&state->ip.x, &state->ip.y) != 0 ||
+        (direction = getc(trace_file)) == EOF || direction > RIGHT ||
+        get_varint(&depth) != 0 || depth > INT_MAX) {
+        return READ_FAILED;
+    }
+    state->ip.direction = (enum direction)direction;
+    // The stack grows with the entries read, not with what a broken trace claims
+    for (int i = 0; i < (int)depth; i++) {
+        if (stack_grow(&state->stack, i + 1) != 0 || get_svarint(&state->stack.data[i]) != 0) {
+            return READ_FAILED;
+        }
+    }
+    state->stack.top = (int)depth - 1;
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        memcpy(grid[y], first_cells[y], sizeof(first_cells[y]));
+    }
+    if (get_varint(&changed) != 0 || changed > GRID_WIDTH * GRID_HEIGHT) {
+        return READ_FAILED;
+    }
+    for (uint64_t i = 0; i < changed; i++) {
+        int x, y;
+        if (get_cell(&x, &y) != 0 || get_svarint(&grid[y][x]) != 0) {
+            return READ_FAILED;
+        }
+    }
+    char history[OUTPUT_SCROLLBACK];
+    if (get_varint(&output_total) != 0 || get_varint(&history_length) != 0 ||
+        history_length > OUTPUT_SCROLLBACK || history_length > output_total ||
+        fread(history, 1, history_length, trace_file) != history_length) {
+        return READ_FAILED;
+    }
+    restore_output_history(history, (int)history_length, (long)output_total);
+    current = (long)step;
+    return READ_KEYFRAME;
+}
+
+static int read_end(void) {
+    uint64_t steps;
+    int status, length;
+    if (get_varint(&steps) != 0 || (status = getc(trace_file)) == EOF || (length = getc(trace_file)) == EOF ||
+        fread(end_message, 1, length, trace_file) != (size_t)length) {
+        return READ_FAILED;
+    }
+    end_message[length] = '\0';
+    end_status = status;
+    last_step = (long)steps;
+    return READ_END;
+}
+
+// Apply the next record to state
+static int read_record(struct state *state) {
+    static const int dx[] = { 0, 0, -1, 1 }, dy[] = { -1, 1, 0, 0 };
+    int tag = getc(trace_file);
+    if (tag == EOF) {
+        return READ_FAILED;
+    }
+    if (tag == RECORD_KEYFRAME) {
+        return read_keyframe(state);
+    }
+    if (tag == RECORD_END) {
+        return read_end();
+    }
+    if (tag & 0x80 || current < 0) {
+        return READ_FAILED;
+    }
+
+    struct instructionPointer *ip = &state->ip;
+    ip->direction = (enum direction)(tag & RECORD_DIRECTION);
+    if (tag & RECORD_JUMP) {
+        if (get_cell(&ip->x, &ip->y) != 0) {
+            return READ_FAILED;
+        }
+    } else {
+        ip->x += dx[ip->direction];
+        ip->y += dy[ip->direction];
+        if (ip->x < 0 || ip->x >= GRID_WIDTH || ip->y < 0 || ip->y >= GRID_HEIGHT) {
+            return READ_FAILED;
+        }
+    }
+    switch ((tag >> RECORD_STACK_SHIFT) & 3) {
+        case RECORD_PUSH:
+            if (stack_grow(&state->stack, state->stack.top + 2) != 0 ||
+                get_svarint(&state->stack.data[++state->stack.top]) != 0) {
+                return READ_FAILED;
+            }
+            break;
+        case RECORD_POP:
+            if (state->stack.top < 0) {
+                return READ_FAILED;
+            }
+            state->stack.top--;
+            break;
+        case RECORD_REPLACE:
+            if (state->stack.top < 0 || get_svarint(&state->stack.data[state->stack.top]) != 0) {
+                return READ_FAILED;
+            }
+            break;
+    }
+    if (tag & RECORD_WRITE) {
+        int x, y;
+        if (get_cell(&x, &y) != 0 || get_svarint(&grid[y][x]) != 0) {
+            return READ_FAILED;
+        }
+    }
+    if (tag & RECORD_OUTPUT) {
+        int c = getc(trace_file);
+        if (c == EOF) {
+            return READ_FAILED;
+        }
+        add_to_output((char)c);
+    }
+    current++;
+    return READ_STEP;
+}
+
+static int add_keyframe(long step, long offset) {
+    static long capacity = 0;
+    if (keyframe_count == capacity) {
+        long grown = capacity ? capacity * 2 : 64;
+        struct keyframe *bigger = realloc(keyframes, grown * sizeof(*keyframes));
+        if (!bigger) {
+            return -1;
+        }
+        keyframes = bigger;
+        capacity = grown;
+    }
+    keyframes[keyframe_count].step = step;
+    keyframes[keyframe_count].offset = offset;
+    keyframe_count++;
+    return 0;
+}
+
+// Keyframe index and end record from the footer of a finished trace
+static int read_footer(void) {
+    uint64_t end_offset, count, step, offset;
+    char magic[8];
+    if (fseek(trace_file, -8, SEEK_END) != 0 || fread(magic, 1, 8, trace_file) != 8 ||
+        memcmp(magic, RECORDING_INDEX_MAGIC, 8) != 0 || fseek(trace_file, -24, SEEK_END) != 0 ||
+        get_fixed(&end_offset, 8) != 0 || get_fixed(&count, 8) != 0 ||
+        count == 0 || count > (uint64_t)ftell(trace_file) / 16 ||
+        fseek(trace_file, -24 - 16 * (long)count, SEEK_END) != 0) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        if (get_fixed(&step, 8) != 0 || get_fixed(&offset, 8) != 0 || add_keyframe((long)step, (long)offset) != 0) {
+            return -1;
+        }
+    }
+    if (fseek(trace_file, (long)end_offset, SEEK_SET) != 0 || getc(trace_file) != RECORD_END) {
+        return -1;
+    }
+    return read_end() == READ_END ? 0 : -1;
+}
+
+// Without a footer (the run was killed) read the whole trace once to find
+// its keyframes and last step
+static void scan_trace(long start) {
+    static struct state scratch;
+    stack_init(&scratch.stack, INT_MAX);
+    fseek(trace_file, start, SEEK_SET);
+    for (;;) {
+        long offset = ftell(trace_file);
+        int kind = read_record(&scratch);
+        if (kind == READ_KEYFRAME && add_keyframe(current, offset) != 0) {
+            break;
+        }
+        if (kind == READ_END || kind == READ_FAILED) {
+            break;
+        }
+        last_step = current;
+    }
+}
+
+// Open a trace and index its keyframes; returns 0 or -1
+int replay_open(const char *path) {
+    trace_file = fopen(path, "rb");
+    if (!trace_file) {
+        return -1;
+    }
+    setvbuf(trace_file, file_buffer, _IOFBF, sizeof(file_buffer));
+    char magic[8];
+    uint64_t interval;
+    if (fread(magic, 1, 8, trace_file) != 8 || memcmp(magic, RECORDING_MAGIC, 8) != 0 ||
+        get_varint(&interval) != 0) {
+        return -1;
+    }
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int x = 0; x < GRID_WIDTH; x++) {
+            if (get_svarint(&first_cells[y][x]) != 0) {
+                return -1;
+            }
+        }
+    }
+    long start = ftell(trace_file);
+    if (read_footer() != 0) {
+        keyframe_count = 0;
+        end_status = -1;
+        scan_trace(start);
+    }
+    current = -1;
+    return keyframe_count > 0 ? 0 : -1;
+}
+
+// Replay up to step, from the nearest keyframe unless it lies ahead of the
+// current state; returns the step reached
+long replay_seek(struct state *state, long step) {
+    if (step > last_step) {
+        step = last_step;
+    }
+    long low = 0, high = keyframe_count - 1;
+    while (low < high) {
+        long middle = (low + high + 1) / 2;
+        if (keyframes[middle].step <= step) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    if (current < 0 || step < current || keyframes[low].step > current) {
+        fseek(trace_file, keyframes[low].offset, SEEK_SET);
+        if (read_record(state) != READ_KEYFRAME) {
+            return current;
+        }
+    }
+    while (current < step) {
+        int kind = read_record(state);
+        if (kind == READ_END || kind == READ_FAILED) {
+            last_step = current;    // the trace is cut short here
+            break;
+        }
+    }
+    return current;
+}
+
+long replay_length(void) {
+    return last_step;
+}
+
+// Show a trace in the visualizer: play it at a chosen speed, step through
+// it and jump to any step. Returns the exit code for main.
+int run_replay(const char *path) {
+    if (replay_open(path) != 0) {
+        fprintf(stderr, "Error: %s is not a valid trace\n", path);
+        return 1;
+    }
+    static struct state state;
+    // The trace was checked against the recorded run's own limit
+    if (stack_init(&state.stack, INT_MAX) != 0) {
+        fprintf(stderr, "Error: Out of memory for the stack\n");
+        return 1;
+    }
+    if (open_terminal() != 0) {
+        fprintf(stderr, "Error: The replay needs a terminal\n");
+        return 1;
+    }
+    replay_seek(&state, 0);
+
+    double speed = 10.0;
+    double pending = 0.0;
+    int playing = 0;
+    struct number_entry number = { "", -1 };
+    long target = -1;
+
+    for (;;) {
+        char mode[sizeof(end_message) + 32];
+        if (number.length >= 0) {
+            snprintf(mode, sizeof(mode), "go to step: %.*s_", number.length, number.digits);
+        } else if (current == last_step && end_status == PFUSCH_ENDED) {
+            snprintf(mode, sizeof(mode), "Program ended normally.");
+        } else if (current == last_step && end_status == PFUSCH_STEP_LIMIT) {
+            snprintf(mode, sizeof(mode), "run stopped here");
+        } else if (current == last_step && end_status >= 0) {
+            snprintf(mode, sizeof(mode), "%s", end_message);
+        } else if (current == last_step) {
+            snprintf(mode, sizeof(mode), "trace ends here");
+        } else {
+            snprintf(mode, sizeof(mode), "%s", playing ? "playing" : "paused");
+        }
+        char status[512];
+        snprintf(status, sizeof(status), "Step %ld of %ld | %s | %g steps/s | space play/pause, n/Right step, "
+                 "b/Left back, +/- speed, g<step>Enter go to, q quit", current, last_step, mode, speed);
+        set_status_line(status);
+        print_visual_grid(&state);
+
+        int keys[16];
+        int count = read_keys(keys, sizeof(keys) / sizeof(keys[0]), playing ? FRAME_MS : -1);
+        for (int i = 0; i < count; i++) {
+            int key = keys[i];
+            if (number.length >= 0) {
+                number_entry_key(&number, key, &target);
+                continue;
+            }
+            switch (key) {
+                case ' ': playing = !playing; pending = 0.0; break;
+                case 'n': case KEY_RIGHT: playing = 0; target = current + 1; break;
+                case 'b': case KEY_LEFT: playing = 0; target = current > 0 ? current - 1 : 0; break;
+                case '+': case '=': speed = speed * 2 < MAX_SPEED ? speed * 2 : MAX_SPEED; break;
+                case '-': speed = speed / 2 > MIN_SPEED ? speed / 2 : MIN_SPEED; break;
+                case 'g': playing = 0; number.length = 0; break;
+                case 'q':
+                    restore_terminal();
+                    printf("\n");
+                    fclose(trace_file);
+                    return 0;
+            }
+        }
+
+        if (target >= 0) {
+            replay_seek(&state, target);
+            target = -1;
+        } else if (playing) {
+            pending += speed * FRAME_MS / 1000.0;
+            long steps = (long)pending;
+            pending -= steps;
+            if (steps > 0) {
+                replay_seek(&state, current + steps);
+            }
+            playing = current < last_step;
+        }
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "interpreter.h"
+
+// Replay of a trace written by --trace (see recording.h). The replayed
+// state lives in the visualizer's grid and output scrollback; a seek
+// starts at the nearest keyframe before the step.
+
+// Function declarations
+int replay_open(const char *path);
+long replay_seek(struct state *state, long step);
+long replay_length(void);
+int run_replay(const char *path);
+
+#endif // REPLAY_H
@@ -0,0 +1,476 @@
+#include "server.h"
+#include "frame.h"
+#include "pfusch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Decoded program kept for SERVE_CACHED requests; workers clone it
+struct cached_program {
+    uint64_t id;
+    pfusch *program;
+    char *source;
+    size_t length;
+    int users;                  // workers cloning it right now
+    unsigned long last_used;
+};
+
+// Worker thread with the buffers of the request it serves and a clone of
+// the program it ran last, which the next request for that program reuses
+struct worker {
+    pthread_t thread;
+    pfusch *instance;
+    uint64_t instance_id;
+    int instance_cached;        // instance is a clone of the cached instance_id
+    char *program;
+    size_t program_capacity;
+    char *input;
+    size_t input_length;
+    size_t input_capacity;
+    size_t input_position;
+    char *output;
+    size_t output_length;
+    size_t output_capacity;
+};
+
+static struct cached_program cache[SERVE_CACHE_SIZE];
+static unsigned long cache_clock = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Requests, not connections, go to the workers: the accept loop polls the
+// idle connections and queues each one a request arrives on, a worker
+// serves that one request and hands the connection back through the wake
+// pipe. A connection waiting for its next request holds no worker.
+static int ready[SERVE_MAX_CONNECTIONS];
+static int ready_count = 0;
+static int ready_head = 0;
+static int served[SERVE_MAX_CONNECTIONS];
+static int served_count = 0;
+static int open_connections = 0;
+static int wake_pipe[2];
+static pthread_mutex_t connection_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t connection_signal = PTHREAD_COND_INITIALIZER;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop_serving(int signal_number) {
+    (void)signal_number;
+    stopping = 1;
+}
+
+// FNV-1a of the program source
+static uint64_t program_id(const char *source, size_t length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)source[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Make room for length bytes in a worker buffer
+static void reserve(char **buffer, size_t *capacity, size_t length) {
+    if (length <= *capacity) {
+        return;
+    }
+    size_t grown = *capacity ? *capacity : 4096;
+    while (grown < length) {
+        grown *= 2;
+    }
+    char *bigger = realloc(*buffer, grown);
+    if (!bigger) {
+        fprintf(stderr, "Error: Out of memory while serving a request\n");
+        exit(1);
+    }
+    *buffer = bigger;
+    *capacity = grown;
+}
+
+static int read_request_input(void *user) {
+    struct worker *worker = user;
+    if (worker->input_position >= worker->input_length) {
+        return EOF;
+    }
+    return (unsigned char)worker->input[worker->input_position++];
+}
+
+static void write_request_output(void *user, const char *bytes, int count) {
+    struct worker *worker = user;
+    reserve(&worker->output, &worker->output_capacity, worker->output_length + count);
+    memcpy(worker->output + worker->output_length, bytes, count);
+    worker->output_length += count;
+}
+
+// Cached program with this id (and source, unless NULL), held for cloning
+// until release_program
+static struct cached_program *acquire_program(uint64_t id, const char *source, size_t length) {
+    struct cached_program *found = NULL;
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < SERVE_CACHE_SIZE; i++) {
+        struct cached_program *entry = &cache[i];
+        if (entry->program && entry->id == id &&
+            (!source || (entry->length == length && memcmp(entry->source, source, length) == 0))) {
+            entry->users++;
+            entry->last_used = ++cache_clock;
+            found = entry;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return found;
+}
+
+static void release_program(struct cached_program *entry) {
+    pthread_mutex_lock(&cache_lock);
+    entry->users--;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// Cache a freshly loaded program and hold it as acquire_program does.
+// Returns NULL if it cannot be cached: its id is taken by another source,
+// or every entry is in use. Another worker may have cached the same
+// source meanwhile; then program is destroyed and that entry returned.
+static struct cached_program *cache_program(uint64_t id, pfusch *program, const char *source, size_t length) {
+    char *copy = malloc(length ? length : 1);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, source, length);
+
+    struct cached_program *slot = NULL;
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < SERVE_CACHE_SIZE; i++) {
+        struct cached_program *entry = &cache[i];
+        if (entry->program && entry->id == id) {
+            int same = entry->length == length && memcmp(entry->source, source, length) == 0;
+            if (same) {
+                entry->users++;
+                entry->last_used = ++cache_clock;
+                pfusch_destroy(program);
+            }
+            pthread_mutex_unlock(&cache_lock);
+            free(copy);
+            return same ? entry : NULL;
+        }
+        // An empty entry, else the least recently used one
+        if (entry->users == 0 && (!slot || (slot->program && (!entry->program ||
+                                                              entry->last_used < slot->last_used)))) {
+            slot = entry;
+        }
+    }
+    if (slot) {
+        pfusch_destroy(slot->program);
+        free(slot->source);
+        slot->id = id;
+        slot->program = program;
+        slot->source = copy;
+        slot->length = length;
+        slot->users = 1;
+        slot->last_used = ++cache_clock;
+    } else {
+        free(copy);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return slot;
+}
+
+// Decode a program sent by a client; -1 leaves the reason in the instance
+static int load_source(pfusch *program, const char *source, size_t length) {
+    if (length == 0) {
+        return pfusch_load_string(program, "");
+    }
+    FILE *fp = fmemopen((void *)source, length, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Out of memory while serving a request\n");
+        exit(1);
+    }
+    int loaded = pfusch_load(program, fp);
+    fclose(fp);
+    return loaded;
+}
+
+static void use_instance(struct worker *worker, pfusch *instance, uint64_t id, int cached) {
+    if (!instance) {
+        fprintf(stderr, "Error: Out of memory while serving a request\n");
+        exit(1);
+    }
+    pfusch_destroy(worker->instance);
+    worker->instance = instance;
+    worker->instance_id = id;
+    worker->instance_cached = cached;
+}
+
+// Give the worker a fresh instance of the requested program. Returns -1
+// when it is ready to run, or the status to reply with instead: a load
+// error (the message is in worker->instance) or SERVE_UNKNOWN_PROGRAM.
+static int prepare_instance(struct worker *worker, int kind, uint64_t *id, size_t program_length) {
+    struct pfusch_io io = { read_request_input, write_request_output, worker };
+    const char *source = NULL;
+    if (kind == SERVE_SOURCE) {
+        source = worker->program;
+        *id = program_id(source, program_length);
+    } else if (worker->instance && worker->instance_cached && worker->instance_id == *id) {
+        pfusch_reset(worker->instance);
+        return -1;
+    }
+
+    struct cached_program *entry = acquire_program(*id, source, program_length);
+    if (!entry && kind == SERVE_CACHED) {
+        return SERVE_UNKNOWN_PROGRAM;
+    }
+    if (!entry) {
+        pfusch *program = pfusch_create(&io);
+        if (program && load_source(program, source, program_length) != 0) {
+            use_instance(worker, program, 0, 0);
+            return PFUSCH_LOAD_ERROR;
+        }
+        entry = program ? cache_program(*id, program, source, program_length) : NULL;
+        if (!entry) {
+            // Runs uncached; the next request loads it again
+            use_instance(worker, program, *id, 0);
+            return -1;
+        }
+    }
+    if (worker->instance && worker->instance_cached && worker->instance_id == *id) {
+        pfusch_reset(worker->instance);
+    } else {
+        use_instance(worker, pfusch_clone(entry->program, &io), *id, 1);
+    }
+    release_program(entry);
+    return -1;
+}
+
+// Read one request, run it and reply; -1 when the connection is done
+static int serve_request(struct worker *worker, int fd) {
+    unsigned char header[SERVE_HEADER_SIZE];
+    if (read_full(fd, header, sizeof(header)) != 0 ||
+        memcmp(header, SERVE_REQUEST_MAGIC, 4) != 0) {
+        return -1;
+    }
+    int kind = header[4];
+    uint64_t id = get_fixed(header + 5, 8);
+    size_t program_length = (size_t)get_fixed(header + 13, 4);
+    size_t input_length = (size_t)get_fixed(header + 17, 4);
+    long max_steps = (long)get_fixed(header + 21, 8);
+    if ((kind != SERVE_SOURCE && kind != SERVE_CACHED) || program_length > SERVE_MAX_PROGRAM ||
+        (kind == SERVE_CACHED && program_length != 0) || input_length > SERVE_MAX_INPUT) {
+        return -1;
+    }
+    reserve(&worker->program, &worker->program_capacity, program_length);
+    reserve(&worker->input, &worker->input_capacity, input_length);
+    if (read_full(fd, worker->program, program_length) != 0 ||
+        read_full(fd, worker->input, input_length) != 0) {
+        return -1;
+    }
+    worker->input_length = input_length;
+    worker->input_position = 0;
+    worker->output_length = 0;
+
+    int status = prepare_instance(worker, kind, &id, program_length);
+    const char *error = "";
+    long steps = 0;
+    if (status < 0) {
+        status = pfusch_run(worker->instance, max_steps > 0 ? max_steps : SERVE_MAX_STEPS);
+        steps = pfusch_steps(worker->instance);
+        error = pfusch_error(worker->instance);
+    } else if (status == PFUSCH_LOAD_ERROR) {
+        error = pfusch_error(worker->instance);
+        id = 0;
+    }
+
+    size_t error_length = strlen(error);
+    unsigned char reply[SERVE_HEADER_SIZE];
+    memcpy(reply, SERVE_REPLY_MAGIC, 4);
+    reply[4] = (unsigned char)status;
+    put_fixed(reply + 5, id, 8);
+    put_fixed(reply + 13, (uint64_t)steps, 8);
+    put_fixed(reply + 21, worker->output_length, 4);
+    put_fixed(reply + 25, error_length, 4);
+    if (write_full(fd, reply, sizeof(reply)) != 0 ||
+        write_full(fd, worker->output, worker->output_length) != 0 ||
+        write_full(fd, error, error_length) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void *worker_loop(void *arg) {
+    struct worker *worker = arg;
+    for (;;) {
+        pthread_mutex_lock(&connection_lock);
+        while (ready_count == 0) {
+            pthread_cond_wait(&connection_signal, &connection_lock);
+        }
+        int fd = ready[ready_head];
+        ready_head = (ready_head + 1) % SERVE_MAX_CONNECTIONS;
+        ready_count--;
+        pthread_mutex_unlock(&connection_lock);
+
+        int done = serve_request(worker, fd) != 0;
+        if (done) {
+            close(fd);
+        }
+        pthread_mutex_lock(&connection_lock);
+        if (done) {
+            open_connections--;
+        } else {
+            served[served_count++] = fd;
+        }
+        pthread_mutex_unlock(&connection_lock);
+        if (!done) {
+            // A full pipe already wakes the accept loop
+            char wake = 0;
+            ssize_t written = write(wake_pipe[1], &wake, 1);
+            (void)written;
+        }
+    }
+    return NULL;
+}
+
+// Queue a connection with a request waiting for the next free worker
+static void queue_request(int fd) {
+    pthread_mutex_lock(&connection_lock);
+    ready[(ready_head + ready_count) % SERVE_MAX_CONNECTIONS] = fd;
+    ready_count++;
+    pthread_cond_signal(&connection_signal);
+    pthread_mutex_unlock(&connection_lock);
+}
+
+int run_server(const char *socket_path, int jobs) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    // A socket left behind by a server that did not shut down is replaced
+    struct stat info;
+    if (lstat(socket_path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(socket_path);
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        perror("Error opening socket");
+        return 1;
+    }
+
+    // Clients that hang up are noticed by write; SIGINT and SIGTERM end the
+    // accept loop so the socket file is removed
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_serving;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Set up the runtime now rather than in the first request
+    pfusch_destroy(pfusch_create(NULL));
+
+    if (jobs <= 0) {
+        jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    // Watched: the listener, the wake pipe and the idle connections
+    struct pollfd *watched = malloc((SERVE_MAX_CONNECTIONS + 2) * sizeof(struct pollfd));
+    struct worker *workers = calloc(jobs, sizeof(struct worker));
+    if (!watched || !workers) {
+        fprintf(stderr, "Error: Out of memory while starting workers\n");
+        return 1;
+    }
+    if (pipe(wake_pipe) != 0 || fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK) != 0 ||
+        fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK) != 0) {
+        perror("Error opening wake pipe");
+        return 1;
+    }
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_loop, &workers[i]) != 0) {
+            fprintf(stderr, "Error: Could not start server worker\n");
+            return 1;
+        }
+    }
+    fprintf(stderr, "Serving on %s with %d workers\n", socket_path, jobs);
+
+    watched[0].fd = listener;
+    watched[1].fd = wake_pipe[0];
+    int watched_count = 2;
+    for (int i = 0; i < 2; i++) {
+        watched[i].events = POLLIN;
+    }
+    while (!stopping) {
+        if (poll(watched, watched_count, -1) < 0) {
+            if (errno != EINTR) {
+                perror("Error waiting for requests");
+                break;
+            }
+            continue;
+        }
+        // Connections with a request (or a hangup) waiting leave the poll
+        // set until a worker is done with them
+        int kept = 2;
+        for (int i = 2; i < watched_count; i++) {
+            if (watched[i].revents) {
+                queue_request(watched[i].fd);
+            } else {
+                watched[kept++] = watched[i];
+            }
+        }
+        watched_count = kept;
+
+        if (watched[1].revents) {
+            char drained[64];
+            while (read(wake_pipe[0], drained, sizeof(drained)) > 0) {
+            }
+            pthread_mutex_lock(&connection_lock);
+            for (int i = 0; i < served_count; i++) {
+                watched[watched_count].fd = served[i];
+                watched[watched_count].events = POLLIN;
+                watched_count++;
+            }
+            served_count = 0;
+            pthread_mutex_unlock(&connection_lock);
+        }
+
+        if (watched[0].revents) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd < 0) {
+                if (errno != EINTR && errno != ECONNABORTED) {
+                    perror("Error accepting connection");
+                    break;
+                }
+                continue;
+            }
+            pthread_mutex_lock(&connection_lock);
+            int room = open_connections < SERVE_MAX_CONNECTIONS;
+            open_connections += room;
+            pthread_mutex_unlock(&connection_lock);
+            if (!room) {
+                close(fd);  // overloaded; the client sees the connection close
+                continue;
+            }
+            // A client stalling within a frame frees its worker after a while
+            struct timeval timeout = { SERVE_IO_TIMEOUT, 0 };
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            watched[watched_count].fd = fd;
+            watched[watched_count].events = POLLIN;
+            watched_count++;
+        }
+    }
+    close(listener);
+    unlink(socket_path);
+    // The workers are not joined: requests in flight end with the process
+    return stopping ? 0 : 1;
+}
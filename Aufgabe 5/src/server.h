@@ -0,0 +1,45 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Persistent worker mode (--serve): one warm process runs programs for
+// clients on a Unix domain socket, on a pool of threads. A connection
+// carries any number of requests, each answered before the next is read;
+// every request goes to the next free thread, so idle connections hold none.
+//
+// Little-endian frames:
+//   request: "PFRQ", u8 kind, u64 program id, u32 program length,
+//            u32 input length, i64 max steps (0 for SERVE_MAX_STEPS),
+//            the program bytes, the input bytes
+//   reply:   "PFRP", u8 status, u64 program id, i64 steps,
+//            u32 output length, u32 error length, the output, the error
+// A SERVE_SOURCE request sends the program and gets back its id; later
+// requests may send just the id (SERVE_CACHED, program length 0). The
+// status is an enum pfusch_status, or SERVE_UNKNOWN_PROGRAM if the id is
+// not cached (any more), in which case the client sends the source again.
+// steps is pfusch_steps of the run. Frames that do not parse close the
+// connection.
+#define SERVE_REQUEST_MAGIC "PFRQ"
+#define SERVE_REPLY_MAGIC "PFRP"
+#define SERVE_HEADER_SIZE 29
+#define SERVE_SOURCE 0
+#define SERVE_CACHED 1
+#define SERVE_UNKNOWN_PROGRAM 255
+
+// Step limit when a request gives none, as in --no-visual mode
+#define SERVE_MAX_STEPS 1000000
+// Largest program and input a request may carry
+#define SERVE_MAX_PROGRAM (1 << 20)
+#define SERVE_MAX_INPUT (64 << 20)
+// Open connections; further clients see their connection closed
+#define SERVE_MAX_CONNECTIONS 1024
+// Seconds a worker waits for the rest of a frame, or for the client to
+// take its reply, before it drops the connection
+#define SERVE_IO_TIMEOUT 10
+// Decoded programs kept for SERVE_CACHED requests; the least recently
+// used one not in use makes room
+#define SERVE_CACHE_SIZE 64
+
+// Function declarations
+int run_server(const char *socket_path, int jobs);
+
+#endif // SERVER_H
@@ -0,0 +1,70 @@
+#include "terminal.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+static struct termios saved_termios;
+static int tty = -1;
+
+void restore_terminal(void) {
+    if (tty >= 0) {
+        tcsetattr(tty, TCSANOW, &saved_termios);
+    }
+}
+
+// Read keys one at a time and without echo; returns 0 or -1 without a
+// terminal. The terminal is restored at exit.
+int open_terminal(void) {
+    tty = open("/dev/tty", O_RDONLY | O_NONBLOCK);
+    if (tty < 0 || tcgetattr(tty, &saved_termios) != 0) {
+        return -1;
+    }
+    struct termios raw = saved_termios;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(tty, TCSANOW, &raw);
+    atexit(restore_terminal);
+    return 0;
+}
+
+// Wait up to timeout_ms (-1: forever) for keys; returns the number read
+int read_keys(int *keys, int size, int timeout_ms) {
+    struct pollfd fd = { tty, POLLIN, 0 };
+    unsigned char bytes[16];
+    if (poll(&fd, 1, timeout_ms) <= 0) {
+        return 0;
+    }
+    ssize_t length = read(tty, bytes, sizeof(bytes));
+    int count = 0;
+    for (ssize_t i = 0; i < length && count < size; i++) {
+        if (bytes[i] == '\033' && i + 2 < length && bytes[i + 1] == '[') {
+            keys[count++] = bytes[i + 2] == 'C' ? KEY_RIGHT : bytes[i + 2] == 'D' ? KEY_LEFT : 0;
+            i += 2;
+        } else {
+            keys[count++] = bytes[i];
+        }
+    }
+    return count;
+}
+
+// Feed a key to a step number being typed; returns 1 when Enter finished
+// it, with the number in value (-1 if none was typed). Any key other than
+// digits, Backspace and Enter cancels it.
+int number_entry_key(struct number_entry *entry, int key, long *value) {
+    if (key >= '0' && key <= '9' && entry->length < (int)sizeof(entry->digits) - 1) {
+        entry->digits[entry->length++] = (char)key;
+    } else if ((key == 127 || key == '\b') && entry->length > 0) {
+        entry->length--;
+    } else if (key == '\n' || key == '\r') {
+        entry->digits[entry->length] = '\0';
+        *value = entry->length > 0 ? atol(entry->digits) : -1;
+        entry->length = -1;
+        return 1;
+    } else {
+        entry->length = -1;
+    }
+    return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+// Keys of the interactive modes (--debug, --replay), read from the
+// terminal itself so stdin stays the program's input. The arrow keys are
+// returned as these codes, all other keys as their byte.
+#define KEY_RIGHT 256
+#define KEY_LEFT 257
+
+// Step number typed after g; length is -1 while none is being typed
+struct number_entry {
+    char digits[24];
+    int length;
+};
+
+// Function declarations
+int open_terminal(void);
+void restore_terminal(void);
+int read_keys(int *keys, int size, int timeout_ms);
+int number_entry_key(struct number_entry *entry, int key, long *value);
+
+#endif // TERMINAL_H
@@ -0,0 +1,258 @@
+#include "trace.h"
+#include "hashTable.h"
+#include "profile.h"
+#include "countingLoop.h"
+#include <stdlib.h>
+
+// Longest run of o/O ops written with a single fwrite
+#define MAX_OUTPUT_RUN 256
+
+// Trace cache of the command line tools
+static struct trace_cache default_trace_cache;
+_Thread_local struct trace_cache *trace_cache = &default_trace_cache;
+
+// Check if an opcode may leave the straight line when moving in dir
+static int ends_trace(enum opcode opcode, enum direction dir) {
+    switch (opcode) {
+        case OP_LEFT: return dir != LEFT;
+        case OP_DOWN: return dir != DOWN;
+        case OP_UP: return dir != UP;
+        case OP_RIGHT: return dir != RIGHT;
+        case OP_JUMP_LEFT:
+        case OP_JUMP_DOWN:
+        case OP_JUMP_UP:
+        case OP_JUMP_RIGHT:
+        case OP_TURN_RIGHT:
+        case OP_TURN_LEFT:
+        case OP_END:
+        case OP_INVALID:
+        case OP_EDGE:
+        case OP_TRAP:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// No-ops and direction setters inside a run only move the IP
+static int has_effect(enum opcode opcode) {
+    return opcode != OP_NOP && opcode != OP_LEFT && opcode != OP_DOWN &&
+           opcode != OP_UP && opcode != OP_RIGHT;
+}
+
+static int is_output(enum opcode opcode) {
+    return opcode == OP_OUTPUT_BELOW || opcode == OP_OUTPUT_ABOVE || opcode == OP_OUTPUT_CONSTANT;
+}
+
+// Ops reading a fixed cell take its value as an immediate; a zero divisor
+// and an invalid output byte keep the plain op, which reports them
+static enum opcode specialize(const struct decoded_cell *cell, int *immediate) {
+    enum opcode opcode = (enum opcode)cell->opcode;
+    const struct decoded_cell *operand = cell + operand_row(opcode) * GRID_STRIDE;
+    if (operand == cell || !operand->fixed) {
+        return opcode;
+    }
+    int value = *operand->value;
+    *immediate = value;
+    switch (opcode) {
+        case OP_STORE_BELOW: case OP_STORE_ABOVE: return OP_PUSH_CONSTANT;
+        case OP_ADD_BELOW: case OP_ADD_ABOVE: return OP_ADD_CONSTANT;
+        case OP_REDUCE_BELOW: case OP_REDUCE_ABOVE: return OP_REDUCE_CONSTANT;
+        case OP_MULTIPLY_BELOW: case OP_MULTIPLY_ABOVE: return OP_MULTIPLY_CONSTANT;
+        case OP_DIVIDE_BELOW: case OP_DIVIDE_ABOVE: return value != 0 ? OP_DIVIDE_CONSTANT : opcode;
+        case OP_MODULO_BELOW: case OP_MODULO_ABOVE: return value != 0 ? OP_MODULO_CONSTANT : opcode;
+        case OP_OUTPUT_BELOW: case OP_OUTPUT_ABOVE:
+            return value >= 0 && value <= 127 ? OP_OUTPUT_CONSTANT : opcode;
+        default:
+            return opcode;
+    }
+}
+
+// Change of the stack depth by an op inside a trace
+int trace_op_stack_effect(int opcode) {
+    switch (opcode) {
+        case OP_STORE_BELOW:
+        case OP_STORE_ABOVE:
+        case OP_DUPLICATE:
+        case OP_PUSH_CONSTANT:
+            return 1;
+        case OP_DELETE:
+        case OP_FETCH_BELOW:
+        case OP_FETCH_ABOVE:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+// Stack entries an op reads or removes
+static int stack_need(int opcode) {
+    switch (opcode) {
+        case OP_STORE_BELOW: case OP_STORE_ABOVE: case OP_PUSH_CONSTANT:
+        case OP_OUTPUT_BELOW: case OP_OUTPUT_ABOVE: case OP_OUTPUT_CONSTANT:
+        case OP_INPUT_BELOW: case OP_INPUT_ABOVE:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+static void add_coverage(struct trace *trace, int delta) {
+    struct decoded_cell *cell = trace->entry;
+    for (int i = 0; i < trace->length; i++) {
+        trace_cache->coverage[cell - program_cells] += delta;
+        cell += cell_offset[trace->direction];
+    }
+    trace_cache->coverage[trace->exit - program_cells] += delta;
+}
+
+static void release_dead_traces(void) {
+    while (trace_cache->dead) {
+        struct trace *next = trace_cache->dead->next_dead;
+        free(trace_cache->dead->loop);
+        free(trace_cache->dead);
+        trace_cache->dead = next;
+    }
+}
+
+static void kill_trace(struct trace **slot) {
+    struct trace *trace = *slot;
+    *slot = NULL;
+    add_coverage(trace, -1);
+    if (active_profile) {
+        profile_fold_trace(trace);
+    }
+    if (trace->watched) {
+        trace_cache->loop_epoch++;  // counting loops through it are analysed again
+    }
+    trace->valid = 0;
+    trace->native = NULL;   // the code stays in the JIT cache until it is flushed
+    trace->next_dead = trace_cache->dead;
+    trace_cache->dead = trace;
+}
+
+// Form the trace starting at entry and store it in the cache; NULL when out
+// of memory
+struct trace *build_trace(struct decoded_cell *entry, enum direction dir) {
+    release_dead_traces();
+
+    int length = 0;
+    int op_count = 0;
+    struct decoded_cell *cell = entry;
+    // The border cells always end a trace
+    while (!ends_trace(cell->opcode, dir)) {
+        if (has_effect(cell->opcode)) {
+            op_count++;
+        }
+        length++;
+        cell += cell_offset[dir];
+    }
+
+    struct trace *trace = malloc(sizeof(struct trace) + op_count * sizeof(struct trace_op));
+    if (!trace) {
+        return NULL;
+    }
+    trace->entry = entry;
+    trace->direction = dir;
+    trace->length = length;
+    trace->exit = cell;
+    trace->valid = 1;
+    trace->hits = 0;
+    trace->native = NULL;
+    trace->next_dead = NULL;
+    trace->runs = 0;
+    trace->max_rise = 0;
+    trace->min_depth = 0;
+    trace->watched = 0;
+    trace->loop = NULL;
+    trace->op_count = op_count;
+    if (entry->opcode != OP_TRAP) {
+        int behind = (entry - cell_offset[dir])->opcode;
+        if (behind == OP_TURN_RIGHT || behind == OP_TURN_LEFT) {
+            trace->loop = new_counting_loop();
+        }
+    }
+
+    cell = entry;
+    for (int offset = 0, i = 0, depth = 0; offset < length; offset++) {
+        if (has_effect(cell->opcode)) {
+            trace->ops[i].immediate = 0;
+            trace->ops[i].opcode = (unsigned char)specialize(cell, &trace->ops[i].immediate);
+            trace->ops[i].offset = offset;
+            trace->ops[i].cell = cell;
+            int need = stack_need(trace->ops[i].opcode) - depth;
+            trace->min_depth = need > trace->min_depth ? need : trace->min_depth;
+            depth += trace_op_stack_effect(trace->ops[i].opcode);
+            trace->max_rise = depth > trace->max_rise ? depth : trace->max_rise;
+            i++;
+        }
+        cell += cell_offset[dir];
+    }
+
+    // Consecutive outputs are written as one block
+    for (int i = op_count - 1; i >= 0; i--) {
+        int run = 0;
+        if (is_output(trace->ops[i].opcode)) {
+            run = 1;
+            if (i + 1 < op_count && trace->ops[i + 1].run < MAX_OUTPUT_RUN) {
+                run += trace->ops[i + 1].run;
+            }
+        }
+        trace->ops[i].run = (unsigned short)run;
+    }
+
+    add_coverage(trace, 1);
+    *trace_slot(entry, dir) = trace;
+    return trace;
+}
+
+// Drop the cached trace in a slot if it covers (x, y)
+static void invalidate_slot(struct decoded_cell *entry, enum direction dir, int x, int y) {
+    struct trace **slot = trace_slot(entry, dir);
+    struct trace *trace = *slot;
+    if (!trace) {
+        return;
+    }
+    int covered = 0;
+    switch (dir) {
+        case UP: covered = y <= entry->y && y >= entry->y - trace->length; break;
+        case DOWN: covered = y >= entry->y && y <= entry->y + trace->length; break;
+        case LEFT: covered = x <= entry->x && x >= entry->x - trace->length; break;
+        case RIGHT: covered = x >= entry->x && x <= entry->x + trace->length; break;
+    }
+    if (covered) {
+        kill_trace(slot);
+    }
+}
+
+// Drop every trace running through (x, y); called after each grid write
+void invalidate_traces_at(int x, int y) {
+    if (trace_cache->coverage[GRID_INDEX(x, y)] == 0) {
+        return;
+    }
+    // Horizontal traces through (x, y) start in row y, vertical ones in column x
+    for (int col = 0; col < GRID_WIDTH; col++) {
+        invalidate_slot(&program_image[y][col], LEFT, x, y);
+        invalidate_slot(&program_image[y][col], RIGHT, x, y);
+    }
+    for (int row = 0; row < GRID_HEIGHT; row++) {
+        invalidate_slot(&program_image[row][x], UP, x, y);
+        invalidate_slot(&program_image[row][x], DOWN, x, y);
+    }
+}
+
+// Drop all cached traces. The running trace may be among them, so they
+// are only freed when the next trace is built or by free_traces.
+void kill_traces(void) {
+    for (int i = 0; i < GRID_CELLS * 4; i++) {
+        if (trace_cache->slots[i]) {
+            kill_trace(&trace_cache->slots[i]);
+        }
+    }
+}
+
+// Free all cached traces; only between runs
+void free_traces(void) {
+    kill_traces();
+    release_dead_traces();
+}
@@ -0,0 +1,63 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "decoder.h"
+
+// One instruction of a trace that does more than move the IP
+struct trace_op {
+    unsigned char opcode;           // enum opcode of the cell
+    unsigned short run;             // consecutive o/O ops starting here (outputs only)
+    int offset;                     // steps from the trace entry to this cell
+    int immediate;                  // operand value of the *_CONSTANT ops
+    struct decoded_cell *cell;
+};
+
+// Native code for a trace (see jit.c); start is the index of the first op to run
+typedef int (*native_trace_t)(struct stack *stack, int start);
+
+struct counting_loop;
+
+// Superinstruction for a straight run of cells in one direction, ending
+// before the next cell that may change the direction
+struct trace {
+    struct decoded_cell *entry;
+    enum direction direction;
+    int length;                     // number of steps covered by the trace
+    struct decoded_cell *exit;      // cell after the run (a border cell if it leaves the grid)
+    int valid;                      // cleared when a covered cell is overwritten
+    int hits;                       // entries counted for the JIT
+    native_trace_t native;          // compiled code, NULL if not compiled
+    struct trace *next_dead;
+    long runs;                      // completed runs not yet added to the profile
+    int max_rise;                   // highest stack growth during a run
+    int min_depth;                  // stack entries a run needs at entry
+    int watched;                    // walked by a counting loop analysis
+    struct counting_loop *loop;     // set if the cell behind the entry is an x or X (see countingLoop.h)
+    int op_count;
+    struct trace_op ops[];
+};
+
+// Trace cache of one program
+struct trace_cache {
+    struct trace *slots[GRID_CELLS * 4];        // one slot per cell and direction
+    unsigned short coverage[GRID_CELLS];        // cached traces covering each cell (run and exit)
+    struct trace *dead;                         // invalidated traces; they may still be executing,
+                                                // so they are freed later
+    unsigned long loop_epoch;                   // counted up when a watched trace dies
+};
+
+// Trace cache of the running program
+extern _Thread_local struct trace_cache *trace_cache;
+
+static inline struct trace **trace_slot(struct decoded_cell *cell, enum direction dir) {
+    return &trace_cache->slots[(cell - program_cells) * 4 + dir];
+}
+
+// Function declarations
+struct trace *build_trace(struct decoded_cell *entry, enum direction dir);
+void invalidate_traces_at(int x, int y);
+void kill_traces(void);
+void free_traces(void);
+int trace_op_stack_effect(int opcode);
+
+#endif // TRACE_H
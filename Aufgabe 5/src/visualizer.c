@@ -1,19 +1,201 @@
 #include "visualizer.h"
 #include "hashTable.h"
+#include "profile.h"
 #include <stdio.h>
-#include <ctype.h>
+#include <stdarg.h>
 #include <string.h>
-#include <stdio.h>
-#include <ctype.h>
+#include <unistd.h>
 
-// Global output buffer to capture program output
-static char output_buffer[1000] = {0};
-static int output_pos = 0;
+// Scrollback of the program output: a ring holding the latest bytes
+static char output_buffer[OUTPUT_SCROLLBACK];
+static long output_total = 0;
 
 void add_to_output(char c) {
-    if (output_pos < (int)(sizeof(output_buffer) - 1)) {
-        output_buffer[output_pos++] = c;
-        output_buffer[output_pos] = '\0';
+    output_buffer[output_total % OUTPUT_SCROLLBACK] = c;
+    output_total++;
+}
+
+// Copy the bytes still in the scrollback, oldest first; returns their count
+int output_history(char bytes[OUTPUT_SCROLLBACK], long *total) {
+    long first = output_total > OUTPUT_SCROLLBACK ? output_total - OUTPUT_SCROLLBACK : 0;
+    int count = 0;
+    for (long i = first; i < output_total; i++) {
+        bytes[count++] = output_buffer[i % OUTPUT_SCROLLBACK];
+    }
+    *total = output_total;
+    return count;
+}
+
+// Refill the scrollback with the latest count of total bytes written
+void restore_output_history(const char *bytes, int count, long total) {
+    output_total = total - count;
+    for (int i = 0; i < count; i++) {
+        add_to_output(bytes[i]);
+    }
+}
+
+// Number of output bytes written so far
+long output_written(void) {
+    return output_total;
+}
+
+// Output byte number index, while it is still in the scrollback
+char output_byte(long index) {
+    return output_buffer[index % OUTPUT_SCROLLBACK];
+}
+
+// Scrollback byte that the next output byte replaces
+char output_overwritten(void) {
+    return output_buffer[output_total % OUTPUT_SCROLLBACK];
+}
+
+// Take back the latest output byte, putting back the byte it replaced
+void unwrite_output(char previous) {
+    output_total--;
+    output_buffer[output_total % OUTPUT_SCROLLBACK] = previous;
+}
+
+// Frames are composed into a screen of cells and compared with the previous
+// frame; only the changed cells are sent to the terminal, in one write
+#define FRAME_ROWS 64
+#define FRAME_COLS 160
+
+struct screen_cell {
+    char glyph[4];          // one UTF-8 encoded character
+    unsigned char length;
+    unsigned char reverse;  // shown highlighted
+    unsigned char background;   // 256-color palette index, 0 for the default
+};
+
+static struct screen_cell frame[FRAME_ROWS][FRAME_COLS];
+static struct screen_cell shown[FRAME_ROWS][FRAME_COLS];
+static int frame_row, frame_col, frame_reverse, frame_background;
+static int screen_cleared = 0;
+
+// Worst case: every cell with a cursor move and an attribute change
+static char render_buffer[FRAME_ROWS * FRAME_COLS * 32];
+
+// Heatmap overlay (--heatmap): background colors of the heat levels, from
+// rarely to most often executed
+static int heatmap_enabled = 0;
+static const unsigned char heat_colors[HEAT_LEVELS + 1] = { 0, 17, 18, 19, 54, 90, 126, 160, 196 };
+
+// Line shown below the frame, e.g. the debugger's step and keys
+static char status_line[FRAME_COLS + 1];
+
+void enable_heatmap(void) {
+    heatmap_enabled = 1;
+}
+
+void set_status_line(const char *text) {
+    snprintf(status_line, sizeof(status_line), "%s", text);
+}
+
+static void blank_screen(struct screen_cell screen[FRAME_ROWS][FRAME_COLS]) {
+    for (int row = 0; row < FRAME_ROWS; row++) {
+        for (int col = 0; col < FRAME_COLS; col++) {
+            screen[row][col] = (struct screen_cell){ { ' ' }, 1, 0, 0 };
+        }
+    }
+}
+
+// Append text at the frame cursor; '\n' starts the next row
+static void frame_puts(const char *text) {
+    const unsigned char *p = (const unsigned char *)text;
+    while (*p) {
+        if (*p == '\n') {
+            frame_row++;
+            frame_col = 0;
+            p++;
+            continue;
+        }
+        int length = *p < 0x80 ? 1 : *p < 0xE0 ? 2 : *p < 0xF0 ? 3 : 4;
+        if (frame_row < FRAME_ROWS && frame_col < FRAME_COLS) {
+            struct screen_cell *cell = &frame[frame_row][frame_col];
+            memset(cell->glyph, 0, sizeof(cell->glyph));
+            for (int i = 0; i < length && p[i]; i++) {
+                cell->glyph[i] = (char)p[i];
+            }
+            cell->length = (unsigned char)length;
+            cell->reverse = (unsigned char)frame_reverse;
+            cell->background = (unsigned char)frame_background;
+        }
+        frame_col++;
+        for (int i = 0; i < length && *p; i++) {
+            p++;
+        }
+    }
+}
+
+static void frame_putc(char c) {
+    char text[2] = { c, '\0' };
+    frame_puts(text);
+}
+
+static void frame_printf(const char *format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    frame_puts(text);
+}
+
+// Send the cells that differ from the shown frame with a single write
+static void present_frame(void) {
+    char *out = render_buffer;
+    int cursor_row = -1, cursor_col = -1, reverse = 0, background = 0;
+
+    if (!screen_cleared) {
+        out += sprintf(out, "\033[2J");
+        blank_screen(shown);
+        screen_cleared = 1;
+    }
+    for (int row = 0; row < FRAME_ROWS; row++) {
+        for (int col = 0; col < FRAME_COLS; col++) {
+            struct screen_cell *cell = &frame[row][col];
+            if (memcmp(cell, &shown[row][col], sizeof(*cell)) == 0) {
+                continue;
+            }
+            if (row != cursor_row || col != cursor_col) {
+                out += sprintf(out, "\033[%d;%dH", row + 1, col + 1);
+            }
+            if (cell->background != background) {
+                if (cell->background) {
+                    out += sprintf(out, "\033[0%s;48;5;%dm", cell->reverse ? ";7" : "", cell->background);
+                } else {
+                    out += sprintf(out, cell->reverse ? "\033[0;7m" : "\033[0m");
+                }
+                reverse = cell->reverse;
+                background = cell->background;
+            } else if (cell->reverse != reverse) {
+                out += sprintf(out, cell->reverse ? "\033[7m" : "\033[0m");
+                reverse = cell->reverse;
+                if (background && !reverse) {
+                    out += sprintf(out, "\033[48;5;%dm", background);
+                }
+            }
+            memcpy(out, cell->glyph, cell->length);
+            out += cell->length;
+            shown[row][col] = *cell;
+            cursor_row = row;
+            cursor_col = col + 1;
+        }
+    }
+    if (reverse || background) {
+        out += sprintf(out, "\033[0m");
+    }
+    // Park the cursor below the frame for messages printed after it
+    out += sprintf(out, "\033[%d;1H", frame_row + 1);
+
+    fflush(stdout);     // keep the order with earlier buffered output
+    const char *p = render_buffer;
+    while (p < out) {
+        ssize_t written = write(STDOUT_FILENO, p, out - p);
+        if (written <= 0) {
+            break;
+        }
+        p += written;
     }
 }
 
@@ -34,122 +216,184 @@ char get_display_char(unsigned char ch) {
     }
 }
 
-void print_visual_grid(struct state *state) {
-    clear_screen();
+// Everything a frame shows, taken either from the live interpreter or from
+// a snapshot published by it
+struct frame_source {
+    const struct state *state;
+    const int *cells;               // rows of GRID_STRIDE cells, starting at (0, 0)
+    const char *output;             // scrollback ring
+    long output_total;
+    const unsigned char (*heat)[GRID_WIDTH];    // heat levels, NULL without heatmap
+};
+
+static void print_current_instruction_info(const struct frame_source *source) {
+    const struct state *state = source->state;
+    unsigned char current_instruction = (unsigned char)source->cells[state->ip.y * GRID_STRIDE + state->ip.x];
+    char display_ch = get_display_char(current_instruction);
+    
+    frame_printf("Current instruction at (%d, %d): '%c' (ASCII %d) - ", 
+           state->ip.x, state->ip.y, display_ch, current_instruction);
+    frame_printf("%s\n", get_instruction_description(current_instruction));
+}
+
+// Compose a frame and draw its changes
+static void draw_frame(const struct frame_source *source) {
+    const struct state *state = source->state;
+    blank_screen(frame);
+    frame_row = 0;
+    frame_col = 0;
     
     const char* direction_names[] = {"UP", "DOWN", "LEFT", "RIGHT"};
     
     // Top border
-    printf("┌");
-    for (int i = 0; i < GRID_WIDTH + 4; i++) printf("─");  // grid width + "yy | "
-    printf("┬");
-    for (int i = 0; i < 25; i++) printf("─");
-    printf("┐\n");
+    frame_puts("┌");
+    for (int i = 0; i < GRID_WIDTH + 4; i++) frame_puts("─");  // grid width + "yy | "
+    frame_puts("┬");
+    for (int i = 0; i < 25; i++) frame_puts("─");
+    frame_puts("┐\n");
     
     // Grid rows with right panel
     for (int row = 0; row < GRID_HEIGHT; row++) {
-        printf("│%2d │", row);
+        frame_printf("│%2d │", row);
         
         // Print grid content
         for (int col = 0; col < GRID_WIDTH; col++) {
-            unsigned char ch = (unsigned char)grid[row][col];
+            unsigned char ch = (unsigned char)source->cells[row * GRID_STRIDE + col];
             char display_ch = get_display_char(ch);
+            frame_background = source->heat ? heat_colors[source->heat[row][col]] : 0;
             
             // Highlight current IP position
             if (row == state->ip.y && col == state->ip.x) {
-                printf("\033[7m%c\033[0m", display_ch);
+                frame_reverse = 1;
+                frame_putc(display_ch);
+                frame_reverse = 0;
             } else {
-                printf("%c", display_ch);
+                frame_putc(display_ch);
             }
         }
+        frame_background = 0;
         
-        printf("│");
+        frame_puts("│");
         
         // Right panel content
         if (row == 1) {
-            printf(" IP Position:          ");
+            frame_puts(" IP Position:          ");
         } else if (row == 2) {
-            printf(" (%2d, %2d)              ", state->ip.x, state->ip.y);
+            frame_printf(" (%2d, %2d)              ", state->ip.x, state->ip.y);
         } else if (row == 3) {
-            printf(" Direction: %-10s ", direction_names[state->ip.direction]);
+            frame_printf(" Direction: %-10s ", direction_names[state->ip.direction]);
         } else if (row == 4) {
-            printf("───────────────────────");
+            frame_puts("───────────────────────");
         } else if (row == 5) {
-            printf(" Stack (top to bottom):");
+            frame_puts(" Stack (top to bottom):");
         } else if (row >= 6 && row <= 6 + state->stack.top && state->stack.top >= 0) {
             int stack_index = state->stack.top - (row - 6);
             if (stack_index >= 0) {
-                printf(" [%2d]: %-12d  ", stack_index, state->stack.data[stack_index]);
+                frame_printf(" [%2d]: %-12d  ", stack_index, state->stack.data[stack_index]);
             } else {
-                printf("                       ");
+                frame_puts("                       ");
             }
         } else if (row == 6 && state->stack.top < 0) {
-            printf(" (empty)               ");
+            frame_puts(" (empty)               ");
         } else {
-            printf("                       ");
+            frame_puts("                       ");
         }
         
-        printf("│\n");
+        frame_puts("│\n");
     }
     
     // Middle border
-    printf("├");
-    for (int i = 0; i < GRID_WIDTH + 4; i++) printf("─");
-    printf("┴");
-    for (int i = 0; i < 25; i++) printf("─");
-    printf("┤\n");
+    frame_puts("├");
+    for (int i = 0; i < GRID_WIDTH + 4; i++) frame_puts("─");
+    frame_puts("┴");
+    for (int i = 0; i < 25; i++) frame_puts("─");
+    frame_puts("┤\n");
     
 // Output section - 10 lines high
 for (int output_row = 0; output_row < 10; output_row++) {
     if (output_row == 0) {
-        printf("│ Output:%-*s│\n", GRID_WIDTH + 4 + 25 - 8, "");
+        frame_printf("│ Output:%-*s│\n", GRID_WIDTH + 4 + 25 - 8, "");
     } else if (output_row == 1) {
         // Display raw output buffer with actual newlines and formatting
-        printf("│ ");
+        frame_puts("│ ");
         int chars_printed = 2; // Account for "│ "
         int max_width = GRID_WIDTH + 4 + 25 - 2; // Total width minus borders
         
-        for (int i = 0; i < output_pos && chars_printed < max_width - 1; i++) {
-            if (output_buffer[i] == '\n') {
+        // Oldest byte still held in the scrollback ring
+        long total = source->output_total;
+        long first = total > OUTPUT_SCROLLBACK ? total - OUTPUT_SCROLLBACK : 0;
+        for (long i = first; i < total && chars_printed < max_width - 1; i++) {
+            char c = source->output[i % OUTPUT_SCROLLBACK];
+            if (c == '\n') {
                 // Fill rest of current line and start new output row
                 for (int pad = chars_printed; pad < max_width - 1; pad++) {
-                    printf(" ");
+                    frame_puts(" ");
                 }
-                printf("│\n");
+                frame_puts("│\n");
                 output_row++;
                 if (output_row >= 10) break;
-                printf("│ ");
+                frame_puts("│ ");
                 chars_printed = 2;
-            } else if (is_displayable_char((unsigned char)output_buffer[i])) {
-                printf("%c", output_buffer[i]);
+            } else if (is_displayable_char((unsigned char)c)) {
+                frame_putc(c);
                 chars_printed++;
             } else {
                 // Show unprintable characters as #
-                printf("#");
+                frame_puts("#");
                 chars_printed++;
             }
         }
         // Fill rest of line
         for (int pad = chars_printed; pad < max_width - 1; pad++) {
-            printf(" ");
+            frame_puts(" ");
         }
-        printf("│\n");
+        frame_puts("│\n");
     } else {
-        printf("│%-*s│\n", GRID_WIDTH + 4 + 25, "");
+        frame_printf("│%-*s│\n", GRID_WIDTH + 4 + 25, "");
     }
 }
     
     // Bottom border
-    printf("└");
-    for (int i = 0; i < GRID_WIDTH + 4 + 25; i++) printf("─");
-    printf("┘\n");
+    frame_puts("└");
+    for (int i = 0; i < GRID_WIDTH + 4 + 25; i++) frame_puts("─");
+    frame_puts("┘\n");
+
+    print_current_instruction_info(source);
+    if (status_line[0]) {
+        frame_printf("%s\n", status_line);
+    }
+    present_frame();
 }
 
-void print_current_instruction_info(struct state *state) {
-    unsigned char current_instruction = (unsigned char)grid[state->ip.y][state->ip.x];
-    char display_ch = get_display_char(current_instruction);
-    
-    printf("Current instruction at (%d, %d): '%c' (ASCII %d) - ", 
-           state->ip.x, state->ip.y, display_ch, current_instruction);
-    printf("%s\n", get_instruction_description(current_instruction));
-}
\ No newline at end of file
+// Draw the live interpreter state
+void print_visual_grid(struct state *state) {
+    static unsigned char heat[GRID_HEIGHT][GRID_WIDTH];
+    struct frame_source source = { state, &grid[0][0], output_buffer, output_total, NULL };
+    if (heatmap_enabled) {
+        profile_heat_levels(heat);
+        source.heat = heat;
+    }
+    draw_frame(&source);
+}
+
+// Draw a state published by the interpreter thread
+void draw_snapshot(const struct visual_snapshot *snapshot) {
+    struct frame_source source = { &snapshot->state, &snapshot->cells[0][0], snapshot->output, snapshot->output_total,
+                                   heatmap_enabled ? snapshot->heat : NULL };
+    draw_frame(&source);
+}
+
+// Copy the output scrollback into a snapshot if it changed
+void snapshot_output(struct visual_snapshot *snapshot) {
+    if (snapshot->output_total != output_total) {
+        memcpy(snapshot->output, output_buffer, sizeof(output_buffer));
+        snapshot->output_total = output_total;
+    }
+}
+
+// Copy the current heat levels into a snapshot if the heatmap is shown
+void snapshot_heat(struct visual_snapshot *snapshot) {
+    if (heatmap_enabled) {
+        profile_heat_levels(snapshot->heat);
+    }
+}
@@ -3,10 +3,33 @@
 
 #include "interpreter.h"
 
+// Number of output bytes kept for the output panel
+#define OUTPUT_SCROLLBACK 1000
+
+// Copy of everything the visualizer shows, filled by the interpreter thread
+// when rendering runs on its own thread (see renderThread.c)
+struct visual_snapshot {
+    struct state state;
+    int cells[GRID_HEIGHT][GRID_STRIDE];    // same row stride as grid
+    char output[OUTPUT_SCROLLBACK];
+    long output_total;
+    unsigned char heat[GRID_HEIGHT][GRID_WIDTH];    // heatmap levels (--heatmap)
+};
+
 // Function declarations for visualization
 void clear_screen(void);
 void print_visual_grid(struct state *state);
-void print_current_instruction_info(struct state *state);
 void add_to_output(char c);
+int output_history(char bytes[OUTPUT_SCROLLBACK], long *total);
+void restore_output_history(const char *bytes, int count, long total);
+long output_written(void);
+char output_byte(long index);
+char output_overwritten(void);
+void unwrite_output(char previous);
+void draw_snapshot(const struct visual_snapshot *snapshot);
+void snapshot_output(struct visual_snapshot *snapshot);
+void snapshot_heat(struct visual_snapshot *snapshot);
+void enable_heatmap(void);
+void set_status_line(const char *text);
 
 #endif // VISUALIZER_H
\ No newline at end of file
@@ -0,0 +1,165 @@
+// Runs a program through libpfusch.a and prints what "pfusch --no-visual"
+// prints for it, so the result can be compared with tests/expected.
+//
+// Usage: library <program> <input file>
+//
+// The run is repeated in slices of a few steps, after pfusch_reset and
+// interleaved with a second instance running the same program; every
+// repetition must give the same output and status, else the exit code is 2.
+#include "../src/pfusch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_STEPS 1000000L
+#define SLICE 7
+
+struct buffer {
+    FILE *input;
+    char *bytes;
+    size_t length;
+    size_t capacity;
+};
+
+static int read_byte(void *user) {
+    return fgetc(((struct buffer *)user)->input);
+}
+
+static void write_bytes(void *user, const char *bytes, int count) {
+    struct buffer *buffer = user;
+    if (buffer->length + count > buffer->capacity) {
+        buffer->capacity = (buffer->length + count) * 2;
+        buffer->bytes = realloc(buffer->bytes, buffer->capacity);
+        if (!buffer->bytes) {
+            fprintf(stderr, "library: out of memory\n");
+            exit(2);
+        }
+    }
+    memcpy(buffer->bytes + buffer->length, bytes, count);
+    buffer->length += count;
+}
+
+// Output, status and message of one run
+struct result {
+    struct buffer output;
+    enum pfusch_status status;
+    char message[256];
+};
+
+static pfusch *create(struct result *result, const char *input_path) {
+    memset(result, 0, sizeof(*result));
+    result->output.input = fopen(input_path, "r");
+    if (!result->output.input) {
+        perror(input_path);
+        exit(2);
+    }
+    struct pfusch_io io = { read_byte, write_bytes, &result->output };
+    pfusch *p = pfusch_create(&io);
+    if (!p) {
+        fprintf(stderr, "library: pfusch_create failed\n");
+        exit(2);
+    }
+    return p;
+}
+
+static void finish(pfusch *p, struct result *result, enum pfusch_status status) {
+    result->status = status;
+    snprintf(result->message, sizeof(result->message), "%s", pfusch_error(p));
+}
+
+// Run to the end or MAX_STEPS in slices of slice steps
+static void run(pfusch *p, struct result *result, long slice) {
+    enum pfusch_status status = PFUSCH_STEP_LIMIT;
+    for (long steps = 0; steps < MAX_STEPS && status == PFUSCH_STEP_LIMIT; steps += slice) {
+        status = pfusch_run(p, slice < MAX_STEPS - steps ? slice : MAX_STEPS - steps);
+    }
+    finish(p, result, status);
+}
+
+static int same(const struct result *a, const struct result *b) {
+    return a->status == b->status && a->output.length == b->output.length &&
+           memcmp(a->output.bytes, b->output.bytes, a->output.length) == 0 &&
+           strcmp(a->message, b->message) == 0;
+}
+
+static void check(const char *what, const struct result *expected, const struct result *actual) {
+    if (!same(expected, actual)) {
+        fprintf(stderr, "library: %s differs (%s instead of %s)\n", what,
+                pfusch_status_name(actual->status), pfusch_status_name(expected->status));
+        exit(2);
+    }
+}
+
+static void load(pfusch *p, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp || pfusch_load(p, fp) != 0) {
+        fprintf(stderr, "library: could not load %s\n", path);
+        exit(2);
+    }
+    fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <program> <input file>\n", argv[0]);
+        return 2;
+    }
+
+    struct result whole, sliced, first, second;
+    pfusch *p = create(&whole, argv[2]);
+    load(p, argv[1]);
+    run(p, &whole, MAX_STEPS);
+
+    pfusch *q = create(&sliced, argv[2]);
+    load(q, argv[1]);
+    run(q, &sliced, SLICE);
+    check("a run in slices", &whole, &sliced);
+
+    pfusch_reset(q);
+    rewind(sliced.output.input);
+    sliced.output.length = 0;     // the callbacks of q write here
+    run(q, &sliced, MAX_STEPS);
+    check("a run after pfusch_reset", &whole, &sliced);
+
+    // Two instances taking turns on one thread
+    pfusch *a = create(&first, argv[2]);
+    pfusch *b = create(&second, argv[2]);
+    load(a, argv[1]);
+    load(b, argv[1]);
+    enum pfusch_status status_a = PFUSCH_STEP_LIMIT, status_b = PFUSCH_STEP_LIMIT;
+    for (long steps = 0; steps < MAX_STEPS; steps += SLICE) {
+        long slice = SLICE < MAX_STEPS - steps ? SLICE : MAX_STEPS - steps;
+        status_a = pfusch_run(a, slice);
+        status_b = pfusch_run(b, slice);
+        if (status_a != PFUSCH_STEP_LIMIT && status_b != PFUSCH_STEP_LIMIT) {
+            break;
+        }
+    }
+    finish(a, &first, status_a);
+    finish(b, &second, status_b);
+    check("the first of two instances", &whole, &first);
+    check("the second of two instances", &whole, &second);
+
+    // What pfusch --no-visual prints
+    printf("Starting Pfusch interpreter...\n");
+    fwrite(whole.output.bytes, 1, whole.output.length, stdout);
+    if (whole.status == PFUSCH_ENDED) {
+        printf("\nProgram ended normally.\n");
+    } else if (whole.status == PFUSCH_STEP_LIMIT) {
+        printf("\nExecution stopped after %ld steps to prevent infinite loop.\n", MAX_STEPS);
+    } else {
+        fflush(stdout);
+        fprintf(stderr, "%s\n", whole.message);
+    }
+
+    pfusch_destroy(p);
+    pfusch_destroy(q);
+    pfusch_destroy(a);
+    pfusch_destroy(b);
+    struct result *results[] = { &whole, &sliced, &first, &second };
+    for (int i = 0; i < 4; i++) {
+        fclose(results[i]->output.input);
+        free(results[i]->output.bytes);
+    }
+    return whole.status == PFUSCH_ENDED || whole.status == PFUSCH_STEP_LIMIT ? 0 : 1;
+}
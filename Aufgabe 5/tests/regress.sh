@@ -0,0 +1,652 @@
+#!/bin/sh
+# Regression tests, run by "make test" from the directory of the Makefile.
+#
+# Every program in pfuschFiles/ and tests/programs/ runs with its input
+# (tests/programs/<name>.in, else none; redirected, piped and as --input)
+# on each engine: fast, reference,
+# unbuffered output, the DISPATCH=switch, JIT=1 and SANITIZE=1 builds and
+# libpfusch.a through tests/library.c (when make test built them), and
+# pfuschc. Each must print tests/expected/<name>.out, which holds the
+# stdout of the run, a line "[exit <code>]" and the stderr of the run. The
+# expected files are the reference engine's output. Then output flushing
+# before input, the visual modes, the run limits, --analyze, --profile,
+# --heatmap, --batch, checkpoints, the debugger, traces, --input, the
+# .pfb cache, the program loader and the benchmark programs are checked.
+
+set -u
+
+PFUSCH=./pfusch
+COMPILER=./pfuschc
+BENCH=./pfuschbench
+CLIENT=./pfuschclient
+SCREEN=build/screen
+CC=${CC:-cc}
+EXPECTED=tests/expected
+
+TMP=$(mktemp -d)
+SERVER=
+cleanup() {
+    if [ -n "$SERVER" ]; then
+        kill "$SERVER" 2>/dev/null
+    fi
+    rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+failures=0
+checks=0
+
+fail() {
+    echo "FAIL: $1"
+    failures=$((failures + 1))
+}
+
+# holds <description> <pattern> <file>
+holds() {
+    checks=$((checks + 1))
+    if ! grep -q -- "$2" "$3"; then
+        fail "$1 (no \"$2\" in the output)"
+    fi
+}
+
+# same <description> <expected file> <actual file>
+same() {
+    checks=$((checks + 1))
+    if ! cmp -s "$2" "$3"; then
+        fail "$1"
+        diff -a "$2" "$3" | head -10
+    fi
+}
+
+# run <output file> <input file> <command...>: stdout, the exit code and
+# stderr
+run() {
+    run_out=$1
+    run_input=$2
+    shift 2
+    timeout 60 "$@" < "$run_input" > "$run_out" 2> "$TMP/stderr"
+    echo "[exit $?]" >> "$run_out"
+    cat "$TMP/stderr" >> "$run_out"
+}
+
+input_of() {
+    if [ -f "${1%.pfusch}.in" ]; then
+        echo "${1%.pfusch}.in"
+    else
+        echo /dev/null
+    fi
+}
+
+# Engines
+for program in pfuschFiles/*.pfusch tests/programs/*.pfusch; do
+    name=$(basename "$program" .pfusch)
+    expected=$EXPECTED/$name.out
+    input=$(input_of "$program")
+    if [ ! -f "$expected" ]; then
+        fail "$name: $expected is missing"
+        continue
+    fi
+
+    run "$TMP/out" "$input" $PFUSCH "$program" --no-visual
+    same "$name: fast engine" "$expected" "$TMP/out"
+    run "$TMP/out" "$input" $PFUSCH "$program" --no-visual --engine reference
+    same "$name: reference engine" "$expected" "$TMP/out"
+    run "$TMP/out" "$input" $PFUSCH "$program" --no-visual --unbuffered
+    same "$name: unbuffered output" "$expected" "$TMP/out"
+    run "$TMP/out" "$input" $PFUSCH "$program" --no-visual --flush-interval 1
+    same "$name: flush interval" "$expected" "$TMP/out"
+    run "$TMP/out" "$input" $PFUSCH "$program" --trace "$TMP/trace.ptr"
+    same "$name: --trace" "$expected" "$TMP/out"
+    for build in build/pfusch-switch build/pfusch-jit build/pfusch-asan; do
+        if [ -x "$build" ]; then
+            run "$TMP/out" "$input" "$build" "$program" --no-visual
+            same "$name: $build" "$expected" "$TMP/out"
+        fi
+    done
+    # Input from a pipe is read in blocks, an --input file is mapped
+    cat "$input" | timeout 60 $PFUSCH "$program" --no-visual > "$TMP/out" 2> "$TMP/stderr"
+    echo "[exit $?]" >> "$TMP/out"
+    cat "$TMP/stderr" >> "$TMP/out"
+    same "$name: input from a pipe" "$expected" "$TMP/out"
+    for engine in fast reference; do
+        run "$TMP/out" /dev/null $PFUSCH "$program" --no-visual --engine $engine --input "$input"
+        same "$name: --input, $engine engine" "$expected" "$TMP/out"
+    done
+
+    # --analyze prints tests/expected/<name>.analysis before the run's
+    # stderr and leaves the run as it is
+    if [ -f "$EXPECTED/$name.analysis" ]; then
+        awk -v report="$EXPECTED/$name.analysis" '
+            { print }
+            /\[exit [0-9]*\]$/ && !done { while ((getline line < report) > 0) print line; done = 1 }
+        ' "$expected" > "$TMP/analyzed"
+        for engine in fast reference; do
+            run "$TMP/out" "$input" $PFUSCH "$program" --no-visual --analyze --engine $engine
+            same "$name: --analyze, $engine engine" "$TMP/analyzed" "$TMP/out"
+        done
+    else
+        fail "$name: $EXPECTED/$name.analysis is missing"
+    fi
+
+    # --cache-dir: the first run writes the .pfb, the later ones load it
+    # on either engine, with and without --analyze
+    rm -rf "$TMP/cache"
+    run "$TMP/out" "$input" $PFUSCH "$program" --no-visual --cache-dir "$TMP/cache"
+    same "$name: --cache-dir, first run" "$expected" "$TMP/out"
+    checks=$((checks + 1))
+    if [ "$(ls "$TMP/cache" | grep -c '\.pfb$')" -ne 1 ]; then
+        fail "$name: --cache-dir wrote no .pfb"
+    fi
+    for engine in fast reference; do
+        run "$TMP/out" "$input" $PFUSCH "$program" --no-visual --cache-dir "$TMP/cache" --engine $engine
+        same "$name: --cache-dir, cached, $engine engine" "$expected" "$TMP/out"
+    done
+    if [ -f "$EXPECTED/$name.analysis" ]; then
+        run "$TMP/out" "$input" $PFUSCH "$program" --no-visual --cache-dir "$TMP/cache" --analyze
+        same "$name: --cache-dir, cached, --analyze" "$TMP/analyzed" "$TMP/out"
+    fi
+
+    # Compiled programs and library runs without limits have no loop
+    # detection
+    if grep -q "loops forever" "$expected"; then
+        continue
+    fi
+    if [ -x build/library ]; then
+        run "$TMP/out" /dev/null build/library "$program" "$input"
+        same "$name: libpfusch.a" "$expected" "$TMP/out"
+    fi
+    if $COMPILER "$program" -o "$TMP/$name.c" && $CC -O2 -o "$TMP/$name" "$TMP/$name.c"; then
+        run "$TMP/out" "$input" "$TMP/$name"
+        same "$name: pfuschc" "$expected" "$TMP/out"
+    else
+        fail "$name: pfuschc did not build"
+    fi
+done
+
+# Buffered output is flushed before the program waits for input
+rm -f "$TMP/fifo"
+mkfifo "$TMP/fifo"
+$PFUSCH tests/programs/prompt.pfusch --no-visual < "$TMP/fifo" > "$TMP/prompt" 2> "$TMP/stderr" &
+exec 3> "$TMP/fifo"
+waited=0
+while ! grep -q "?" "$TMP/prompt" && [ $waited -lt 50 ]; do
+    sleep 0.1
+    waited=$((waited + 1))
+done
+checks=$((checks + 1))
+if ! grep -q "?" "$TMP/prompt"; then
+    fail "prompt: output before an input read was not flushed"
+fi
+printf 'x' >&3
+exec 3>&-
+wait
+echo "[exit 0]" >> "$TMP/prompt"
+cat "$TMP/stderr" >> "$TMP/prompt"
+same "prompt: interactive input" "$EXPECTED/prompt.out" "$TMP/prompt"
+
+# Visual mode: the screen left by the last frame (see tests/screen.c)
+for mode in "--engine fast" "--engine reference" "--fps 30"; do
+    $PFUSCH tests/programs/echo.pfusch $mode < tests/programs/echo.in 2> /dev/null \
+        | $SCREEN -a > "$TMP/screen"
+    same "echo: visual mode, $mode" "$EXPECTED/echo.screen" "$TMP/screen"
+done
+
+# The render thread's last frame matches the reference engine's, also when
+# the program fails or modifies itself
+for program in pfuschFiles/*.pfusch tests/programs/*.pfusch; do
+    name=$(basename "$program" .pfusch)
+    input=$(input_of "$program")
+    timeout 60 $PFUSCH "$program" --fps 30 --engine reference < "$input" 2> /dev/null \
+        | $SCREEN -a > "$TMP/expected"
+    for build in $PFUSCH build/pfusch-switch build/pfusch-jit; do
+        if [ -x "$build" ]; then
+            timeout 60 "$build" "$program" --fps 30 < "$input" 2> /dev/null | $SCREEN -a > "$TMP/screen"
+            same "$name: --fps, $build" "$TMP/expected" "$TMP/screen"
+        fi
+    done
+done
+
+# Run limits: without the loop check the step or time limit ends the run
+for engine in fast reference; do
+    run "$TMP/out" /dev/null $PFUSCH tests/programs/loop.pfusch --no-visual --engine $engine \
+        --no-loop-check --max-steps 1000
+    holds "loop: --no-loop-check, $engine engine" "Execution stopped after 1000 steps" "$TMP/out"
+    run "$TMP/out" /dev/null $PFUSCH tests/programs/loop.pfusch --no-visual --engine $engine \
+        --no-loop-check --max-steps 0 --time-limit 0.2
+    holds "loop: --time-limit, $engine engine" "time limit of 0.2 seconds reached" "$TMP/out"
+done
+
+# Counting loops: skipped passes end at the reference engine's step, also
+# when the step limit falls inside the loop or right at its end (the run
+# ends after 363651 steps)
+for limit in 1000 12345 100000 363649 363650 363651 0; do
+    for loop_check in "" --no-loop-check; do
+        run "$TMP/expected" /dev/null $PFUSCH tests/programs/count.pfusch --no-visual --engine reference \
+            --max-steps $limit $loop_check
+        for build in $PFUSCH build/pfusch-switch build/pfusch-jit; do
+            if [ -x "$build" ]; then
+                run "$TMP/out" /dev/null $build tests/programs/count.pfusch --no-visual --max-steps $limit \
+                    $loop_check
+                same "count: --max-steps $limit $loop_check, $build" "$TMP/expected" "$TMP/out"
+            fi
+        done
+    done
+done
+# A checkpoint inside the loop holds the counter reached so far
+rm -f "$TMP/checkpoint"
+$PFUSCH tests/programs/count.pfusch --no-visual --max-steps 150000 --checkpoint-every 50000 \
+    --checkpoint-file "$TMP/checkpoint" < /dev/null > /dev/null 2>&1
+run "$TMP/expected" /dev/null $PFUSCH tests/programs/count.pfusch --no-visual --engine reference \
+    --max-steps 200000
+run "$TMP/out" /dev/null $PFUSCH tests/programs/count.pfusch --no-visual --max-steps 200000 \
+    --resume "$TMP/checkpoint"
+same "count: resume inside the loop" "$TMP/expected" "$TMP/out"
+
+# Stack: the depth at which a push overflows is --stack-size; the stack
+# grows on demand up to it, also inside traces that check it once at entry
+for size in 1 2 999 1000 1001 5000; do
+    for limit in 3000 10000 0; do
+        run "$TMP/expected" /dev/null $PFUSCH tests/programs/deep.pfusch --no-visual --engine reference \
+            --stack-size $size --max-steps $limit
+        for build in $PFUSCH build/pfusch-switch build/pfusch-jit build/pfusch-asan; do
+            if [ -x "$build" ]; then
+                run "$TMP/out" /dev/null $build tests/programs/deep.pfusch --no-visual --stack-size $size \
+                    --max-steps $limit
+                same "deep: --stack-size $size --max-steps $limit, $build" "$TMP/expected" "$TMP/out"
+            fi
+        done
+    done
+done
+run "$TMP/out" /dev/null $PFUSCH tests/programs/deep.pfusch --no-visual --max-steps 10000
+holds "deep: default stack" "Stack overflow" "$TMP/out"
+run "$TMP/out" /dev/null $PFUSCH tests/programs/deep.pfusch --no-visual --stack-size 0
+holds "deep: --stack-size 0 is rejected" "Stack size must be" "$TMP/out"
+# A checkpoint holds the whole stack; resuming it needs as large a limit
+rm -f "$TMP/checkpoint"
+$PFUSCH tests/programs/deep.pfusch --no-visual --stack-size 5000 --max-steps 10000 --checkpoint-every 10000 \
+    --checkpoint-file "$TMP/checkpoint" < /dev/null > /dev/null 2>&1
+run "$TMP/expected" /dev/null $PFUSCH tests/programs/deep.pfusch --no-visual --stack-size 5000 --max-steps 15000
+run "$TMP/out" /dev/null $PFUSCH tests/programs/deep.pfusch --no-visual --stack-size 5000 --max-steps 15000 \
+    --resume "$TMP/checkpoint"
+same "deep: resume a deep stack" "$TMP/expected" "$TMP/out"
+run "$TMP/out" /dev/null $PFUSCH tests/programs/deep.pfusch --no-visual --resume "$TMP/checkpoint"
+holds "deep: resume with a smaller --stack-size" "deeper stack than --stack-size allows" "$TMP/out"
+
+# Loops that write output or read input are no repeated state
+for program in pfuschFiles/*.pfusch tests/programs/echo.pfusch tests/programs/prompt.pfusch; do
+    name=$(basename "$program" .pfusch)
+    run "$TMP/out" "$(input_of "$program")" $PFUSCH "$program" --no-visual --max-steps 100000
+    checks=$((checks + 1))
+    if grep -q "loops forever" "$TMP/out"; then
+        fail "$name: reported as looping forever"
+    fi
+done
+
+# Profiles: every engine counts the same, also when the program fails or
+# modifies itself; only the timing differs
+profile() {
+    grep -v '"seconds"\|"steps_per_second"' "$1"
+}
+for program in pfuschFiles/*.pfusch tests/programs/*.pfusch; do
+    name=$(basename "$program" .pfusch)
+    input=$(input_of "$program")
+    timeout 60 $PFUSCH "$program" --no-visual --engine reference --profile "$TMP/profile" \
+        < "$input" > /dev/null 2>&1
+    profile "$TMP/profile" > "$TMP/expected"
+    for build in $PFUSCH build/pfusch-switch build/pfusch-jit; do
+        if [ -x "$build" ]; then
+            timeout 60 "$build" "$program" --no-visual --profile "$TMP/profile" < "$input" > /dev/null 2>&1
+            profile "$TMP/profile" > "$TMP/out"
+            same "$name: --profile, $build" "$TMP/expected" "$TMP/out"
+        fi
+    done
+done
+$PFUSCH pfuschFiles/example.pfusch --no-visual --profile "$TMP/profile" < /dev/null > /dev/null
+profile "$TMP/profile" > "$TMP/out"
+same "example: --profile counts" "$EXPECTED/example.profile" "$TMP/out"
+# The steps run to find a loop's period are not profiled
+$PFUSCH tests/programs/loop.pfusch --no-visual --profile "$TMP/profile" < /dev/null > /dev/null
+holds "loop: --profile ends at the reported step" '"steps": 512,' "$TMP/profile"
+
+# Heatmap: the cell colours of the last frame match the reference engine's
+for mode in "" "--fps 30"; do
+    $PFUSCH tests/programs/echo.pfusch --heatmap $mode --engine reference < tests/programs/echo.in \
+        2> /dev/null | $SCREEN -a > "$TMP/expected"
+    holds "echo: --heatmap $mode colours" " 0 [0-9]*$" "$TMP/expected"
+    $PFUSCH tests/programs/echo.pfusch --heatmap $mode < tests/programs/echo.in 2> /dev/null \
+        | $SCREEN -a > "$TMP/screen"
+    same "echo: --heatmap $mode" "$TMP/expected" "$TMP/screen"
+done
+
+# Batch: frames in name order on stdout, or one file per input
+mkdir "$TMP/inputs" "$TMP/outputs"
+printf 'abc' > "$TMP/inputs/a"
+printf 'xyz' > "$TMP/inputs/b"
+printf '12' > "$TMP/inputs/c"
+for jobs in 1 3; do
+    $PFUSCH tests/programs/echo.pfusch --batch "$TMP/inputs" --jobs $jobs > "$TMP/batch" 2> "$TMP/stderr"
+    same "batch: --jobs $jobs" "$EXPECTED/batch.out" "$TMP/batch"
+done
+$PFUSCH tests/programs/echo.pfusch --batch "$TMP/inputs" --output-dir "$TMP/outputs" 2> "$TMP/stderr"
+for input in a b c; do
+    # The reference engine's output without the banner and the end message
+    $PFUSCH tests/programs/echo.pfusch --no-visual --engine reference < "$TMP/inputs/$input" \
+        | tail -c +32 | head -c -25 > "$TMP/out"
+    same "batch: --output-dir, input $input" "$TMP/out" "$TMP/outputs/$input.out"
+done
+$PFUSCH tests/programs/underflow.pfusch --batch "$TMP/inputs" --jobs 2 > "$TMP/batch" 2> "$TMP/stderr"
+holds "batch: failing runs" "=== c stack_underflow 0" "$TMP/batch"
+holds "batch: failing runs" "Stack underflow" "$TMP/stderr"
+
+# Batch runs have the limits of a headless run
+$PFUSCH tests/programs/loop.pfusch --batch "$TMP/inputs" > "$TMP/batch" 2> "$TMP/stderr"
+holds "batch: loop check" "=== a loops_forever 0" "$TMP/batch"
+$PFUSCH tests/programs/loop.pfusch --batch "$TMP/inputs" --no-loop-check --max-steps 1000 \
+    > "$TMP/batch" 2> "$TMP/stderr"
+holds "batch: --max-steps" "=== b step_limit 0" "$TMP/batch"
+$PFUSCH tests/programs/loop.pfusch --batch "$TMP/inputs" --jobs 3 --no-loop-check --max-steps 0 \
+    --time-limit 0.2 > "$TMP/batch" 2> "$TMP/stderr"
+holds "batch: --time-limit" "=== c time_limit 0" "$TMP/batch"
+$PFUSCH tests/programs/deep.pfusch --batch "$TMP/inputs" --max-steps 10000 > "$TMP/batch" 2> "$TMP/stderr"
+holds "batch: default stack" "=== a stack_overflow 0" "$TMP/batch"
+$PFUSCH tests/programs/deep.pfusch --batch "$TMP/inputs" --max-steps 10000 --stack-size 5000 \
+    > "$TMP/batch" 2> "$TMP/stderr"
+holds "batch: --stack-size" "=== a step_limit 0" "$TMP/batch"
+
+# More inputs than the workers may run ahead of the report
+mkdir "$TMP/many"
+for i in $(seq 10 59); do
+    printf "$i" > "$TMP/many/$i"
+done
+$PFUSCH tests/programs/echo.pfusch --batch "$TMP/many" --jobs 1 > "$TMP/expected" 2> /dev/null
+$PFUSCH tests/programs/echo.pfusch --batch "$TMP/many" --jobs 4 > "$TMP/batch" 2> /dev/null
+same "batch: 50 inputs, --jobs 4" "$TMP/expected" "$TMP/batch"
+
+# Checkpoints: a run stopped at a step limit and resumed from its last
+# checkpoint prints what the whole run prints, also on the other engine.
+# Loop detection starts over on resuming, so it reports a later step.
+for program in pfuschFiles/*.pfusch tests/programs/*.pfusch; do
+    name=$(basename "$program" .pfusch)
+    input=$(input_of "$program")
+    if grep -q "loops forever" "$EXPECTED/$name.out"; then
+        continue
+    fi
+    for limit in 1 37 100 1000; do
+        for engines in "fast fast" "reference reference" "fast reference" "reference fast"; do
+            set -- $engines
+            rm -f "$TMP/checkpoint"
+            message="
+Execution stopped after $limit steps to prevent infinite loop."
+            $PFUSCH "$program" --no-visual --engine $1 --max-steps $limit --checkpoint-every 17 \
+                --checkpoint-file "$TMP/checkpoint" < "$input" > "$TMP/stopped" 2> /dev/null
+            if ! tail -n 2 "$TMP/stopped" | grep -q "after $limit steps to prevent"; then
+                continue    # ended before the limit
+            fi
+            # The whole run's output: the stopped run without its stop
+            # message, then the resumed one without its banner
+            head -c -$(($(printf '%s' "$message" | wc -c) + 1)) "$TMP/stopped" > "$TMP/out"
+            timeout 60 $PFUSCH "$program" --no-visual --engine $2 --resume "$TMP/checkpoint" \
+                < "$input" > "$TMP/resumed" 2> "$TMP/stderr"
+            echo "[exit $?]" >> "$TMP/resumed"
+            cat "$TMP/stderr" >> "$TMP/resumed"
+            tail -n +2 "$TMP/resumed" >> "$TMP/out"
+            same "$name: resume after $limit steps, $1 then $2" "$EXPECTED/$name.out" "$TMP/out"
+        done
+    done
+done
+
+# A resumed run skips the input read before the checkpoint, also in an
+# --input file
+for limit in 3 8 9 10; do
+    rm -f "$TMP/checkpoint"
+    $PFUSCH tests/programs/echo.pfusch --no-visual --max-steps $limit --checkpoint-every 1 \
+        --checkpoint-file "$TMP/checkpoint" --input tests/programs/echo.in < /dev/null > "$TMP/stopped"
+    message="
+Execution stopped after $limit steps to prevent infinite loop."
+    head -c -$(($(printf '%s' "$message" | wc -c) + 1)) "$TMP/stopped" > "$TMP/out"
+    run "$TMP/resumed" /dev/null $PFUSCH tests/programs/echo.pfusch --no-visual --resume "$TMP/checkpoint" \
+        --input tests/programs/echo.in
+    tail -n +2 "$TMP/resumed" >> "$TMP/out"
+    same "echo: resume after $limit steps with --input" "$EXPECTED/echo.out" "$TMP/out"
+done
+
+# SIGINT and SIGTERM end a run with a last checkpoint
+for signal in INT TERM; do
+    rm -f "$TMP/checkpoint"
+    $PFUSCH tests/programs/loop.pfusch --no-visual --no-loop-check --max-steps 0 --checkpoint-every 1000 \
+        --checkpoint-file "$TMP/checkpoint" < /dev/null > "$TMP/out" 2> /dev/null &
+    sleep 0.3
+    kill -$signal $!
+    wait $!
+    holds "loop: SIG$signal" "steps: $([ $signal = INT ] && echo interrupted || echo terminated)" "$TMP/out"
+    steps=$(sed -n 's/.*stopped after \([0-9]*\) steps.*/\1/p' "$TMP/out")
+    run "$TMP/out" /dev/null $PFUSCH tests/programs/loop.pfusch --no-visual --no-loop-check \
+        --max-steps $((steps + 10)) --resume "$TMP/checkpoint"
+    holds "loop: resume after SIG$signal" "stopped after $((steps + 10)) steps" "$TMP/out"
+done
+run "$TMP/out" /dev/null $PFUSCH tests/programs/loop.pfusch --no-visual --resume "$TMP/missing"
+holds "resume: missing checkpoint" "\[exit 1\]" "$TMP/out"
+
+# Debugger and replay viewer: the frame at a step, reached forward,
+# backward or with b, is the reference engine's last frame at that step
+# limit. script gives them a terminal; the keys are sent one group at a
+# time, then q.
+frame() {
+    $SCREEN | sed '/^Current instruction/q'
+}
+# press <output file> <command> <keys...>
+press() {
+    press_out=$1
+    press_command=$2
+    shift 2
+    for keys in "$@" q; do
+        sleep 0.3
+        printf "$keys"
+    done | timeout 20 script -qec "$press_command" /dev/null > "$press_out" 2>&1
+}
+# at_step <description> <program> <command> <step> <options>
+at_step() {
+    $PFUSCH "$2" --fps 30 --engine reference --max-steps $4 ${5:-} < "$(input_of "$2")" 2> /dev/null \
+        | frame > "$TMP/expected"
+    press "$TMP/keys" "$3" "g$4\r"
+    frame < "$TMP/keys" > "$TMP/screen"
+    same "$1, go to step $4" "$TMP/expected" "$TMP/screen"
+    press "$TMP/keys" "$3" "g$(($4 + 100))\r" "g$4\r"
+    frame < "$TMP/keys" > "$TMP/screen"
+    same "$1, back to step $4" "$TMP/expected" "$TMP/screen"
+    press "$TMP/keys" "$3" "g$(($4 + 1))\r" 'b'
+    frame < "$TMP/keys" > "$TMP/screen"
+    same "$1, one step back to $4" "$TMP/expected" "$TMP/screen"
+}
+if command -v script > /dev/null; then
+    for program in pfuschFiles/example.pfusch tests/programs/selfmod.pfusch tests/programs/echo.pfusch; do
+        name=$(basename "$program" .pfusch)
+        input=$(input_of "$program")
+        at_step "$name: --debug" "$program" "$PFUSCH $program --debug < $input" 7
+        holds "$name: --debug, quit" "Debugger quit at step 7" "$TMP/keys"
+        $PFUSCH "$program" --trace "$TMP/trace.ptr" < "$input" > /dev/null 2>&1
+        at_step "$name: --replay" "$program" "$PFUSCH --replay $TMP/trace.ptr" 7
+    done
+    press "$TMP/keys" "$PFUSCH tests/programs/underflow.pfusch --debug < /dev/null" 'g5\r'
+    holds "underflow: --debug" "Stack underflow" "$TMP/keys"
+
+    # Seeking from the keyframes of a long trace
+    $PFUSCH tests/programs/loop.pfusch --no-loop-check --max-steps 200000 --trace "$TMP/trace.ptr" \
+        < /dev/null > /dev/null
+    at_step "loop: --replay" tests/programs/loop.pfusch "$PFUSCH --replay $TMP/trace.ptr" 150001 \
+        --no-loop-check
+    # A trace ends at the step a loop is reported, without the steps run
+    # to find its period
+    $PFUSCH tests/programs/loop.pfusch --trace "$TMP/trace.ptr" < /dev/null > /dev/null
+    press "$TMP/keys" "$PFUSCH --replay $TMP/trace.ptr" 'g1000\r'
+    $SCREEN < "$TMP/keys" > "$TMP/screen"
+    holds "loop: --trace ends at the reported step" "Step 512 of 512" "$TMP/screen"
+fi
+
+# --input: a FIFO is read like stdin; a missing file stops before the run
+rm -f "$TMP/fifo"
+mkfifo "$TMP/fifo"
+cat tests/programs/echo.in > "$TMP/fifo" &
+run "$TMP/out" /dev/null $PFUSCH tests/programs/echo.pfusch --no-visual --input "$TMP/fifo"
+wait
+same "echo: --input from a FIFO" "$EXPECTED/echo.out" "$TMP/out"
+run "$TMP/out" /dev/null $PFUSCH tests/programs/echo.pfusch --no-visual --input "$TMP/missing"
+holds "echo: missing --input file" "Error opening input file" "$TMP/out"
+holds "echo: missing --input file" "\[exit 1\]" "$TMP/out"
+
+# Worker mode: every program through pfuschclient, with what pfusch
+# --no-visual would print rebuilt from the reply, against the reference
+# engine. The reply's step count is exact: the reference engine has not
+# stopped after that many steps, and has after one more.
+$PFUSCH --serve "$TMP/socket" --jobs 2 2> /dev/null &
+SERVER=$!
+waited=0
+while [ ! -S "$TMP/socket" ] && [ $waited -lt 50 ]; do
+    sleep 0.1
+    waited=$((waited + 1))
+done
+for program in pfuschFiles/*.pfusch tests/programs/*.pfusch; do
+    name=$(basename "$program" .pfusch)
+    input=$(input_of "$program")
+    timeout 20 $CLIENT "$TMP/socket" "$program" --input "$input" --max-steps 100000 \
+        > "$TMP/served" 2> "$TMP/stderr"
+    code=$?
+    status=$(sed -n '1s/ after .*//p' "$TMP/stderr")
+    steps=$(sed -n '1s/.* after \([0-9]*\) steps.*/\1/p' "$TMP/stderr")
+    {
+        echo "Starting Pfusch interpreter..."
+        cat "$TMP/served"
+        case $status in
+            ended) printf '\nProgram ended normally.\n[exit 0]\n' ;;
+            step_limit) printf '\nExecution stopped after 100000 steps to prevent infinite loop.\n[exit 0]\n' ;;
+            *) echo "[exit 1]" ;;
+        esac
+        tail -n +2 "$TMP/stderr"
+    } > "$TMP/out"
+    run "$TMP/expected" "$input" $PFUSCH "$program" --no-visual --engine reference --no-loop-check --max-steps 100000
+    same "$name: --serve" "$TMP/expected" "$TMP/out"
+    checks=$((checks + 1))
+    if [ "$code" -ne "$([ "$status" = ended ] && echo 0 || echo 1)" ]; then
+        fail "$name: pfuschclient exit code $code for $status"
+    fi
+    if [ "$status" != step_limit ] && [ -n "$steps" ]; then
+        if [ "$steps" -gt 0 ]; then
+            run "$TMP/out" "$input" $PFUSCH "$program" --no-visual --engine reference --max-steps "$steps"
+            holds "$name: --serve step count" "stopped after $steps steps" "$TMP/out"
+        fi
+        run "$TMP/out" "$input" $PFUSCH "$program" --no-visual --engine reference --no-loop-check \
+            --max-steps $((steps + 1))
+        same "$name: --serve step count" "$TMP/expected" "$TMP/out"
+    fi
+done
+# A cached program runs by its id with other input; an unknown id is
+# reported
+timeout 20 $CLIENT "$TMP/socket" tests/programs/echo.pfusch --input tests/programs/echo.in \
+    > /dev/null 2> "$TMP/stderr"
+id=$(sed -n 's/.*program \([0-9a-f]*\)$/\1/p' "$TMP/stderr")
+printf 'xyz' > "$TMP/xyz"
+timeout 20 $CLIENT "$TMP/socket" --id "$id" --input "$TMP/xyz" > "$TMP/out" 2> "$TMP/stderr"
+printf 'zyx' > "$TMP/expected"
+same "serve: cached request" "$TMP/expected" "$TMP/out"
+run "$TMP/out" /dev/null $CLIENT "$TMP/socket" --id 0123456789abcdef
+holds "serve: unknown id" "is not cached" "$TMP/out"
+timeout 20 $CLIENT "$TMP/socket" pfuschFiles/example.pfusch --repeat 50 < /dev/null > "$TMP/out" 2> "$TMP/stderr"
+holds "serve: repeated requests" "ended after 235 steps" "$TMP/stderr"
+kill "$SERVER"
+wait "$SERVER" 2> /dev/null
+SERVER=
+
+# Loader: mapped files load as the same program as streams (a FIFO),
+# including long, missing and 8-bit rows and text outside the grid. Streams
+# are not read past the grid, so only mapped files warn about the rows after
+# it.
+mkdir "$TMP/load"
+printf 'lsoj\n   e\n   h' > "$TMP/load/no_newline.pfusch"
+printf 'lsoj\r\n   e\r\n' > "$TMP/load/crlf.pfusch"
+printf 'ls\000oj\n   e\n' > "$TMP/load/nul.pfusch"
+printf 'lsoj\n  \351e\n' > "$TMP/load/eight_bit.pfusch"
+: > "$TMP/load/empty.pfusch"
+awk 'BEGIN { printf "l"; for (i = 0; i < 80; i++) printf "s"; print "" }' > "$TMP/load/long_row.pfusch"
+awk 'BEGIN { printf "l"; for (i = 0; i < 67; i++) printf "s"; print "j"; printf "%68se\n", "" }' > "$TMP/load/full_row.pfusch"
+awk 'BEGIN { print "lsoj"; for (i = 0; i < 50; i++) print "   e" }' > "$TMP/load/tall.pfusch"
+awk 'BEGIN { print "le"; for (i = 0; i < 44; i++) print "  "; print "   x" }' > "$TMP/load/far_text.pfusch"
+for program in "$TMP"/load/*.pfusch pfuschFiles/*.pfusch tests/programs/*.pfusch; do
+    name=$(basename "$program" .pfusch)
+    rm -f "$TMP/fifo"
+    mkfifo "$TMP/fifo"
+    cat "$program" > "$TMP/fifo" &
+    run "$TMP/expected" "$(input_of "$program")" $PFUSCH "$TMP/fifo" --no-visual
+    wait
+    run "$TMP/out" "$(input_of "$program")" $PFUSCH "$program" --no-visual
+    if grep -q "first at row 4[3-9]" "$TMP/out"; then
+        grep -v "^Warning: Program text outside" "$TMP/out" > "$TMP/mapped"
+        mv "$TMP/mapped" "$TMP/out"
+    fi
+    same "$name: mapped and streamed loads" "$TMP/expected" "$TMP/out"
+done
+holds "load: long rows" "outside the 42x69 grid is ignored (first at row 1, column 70)" \
+    "$(run "$TMP/out" /dev/null $PFUSCH "$TMP/load/long_row.pfusch" --no-visual; echo "$TMP/out")"
+holds "load: a full row" "Program ended normally" \
+    "$(run "$TMP/out" /dev/null $PFUSCH "$TMP/load/full_row.pfusch" --no-visual; echo "$TMP/out")"
+holds "load: rows after the grid" "(first at row 43, column 4)" \
+    "$(run "$TMP/out" /dev/null $PFUSCH "$TMP/load/tall.pfusch" --no-visual; echo "$TMP/out")"
+holds "load: text after blank rows" "(first at row 46, column 4)" \
+    "$(run "$TMP/out" /dev/null $PFUSCH "$TMP/load/far_text.pfusch" --no-visual; echo "$TMP/out")"
+holds "load: 8-bit characters" "line 2, column 3: ASCII 233" \
+    "$(run "$TMP/out" /dev/null $PFUSCH "$TMP/load/eight_bit.pfusch" --no-visual; echo "$TMP/out")"
+# A large file only has its first rows read
+awk 'BEGIN { print "lsoj"; print "   e"; for (i = 0; i < 100000; i++) print "                                                  " }' \
+    > "$TMP/load/large.pfusch"
+run "$TMP/out" /dev/null timeout 5 $PFUSCH "$TMP/load/large.pfusch" --no-visual
+holds "load: a large file" "Program ended normally" "$TMP/out"
+
+# Program cache: a damaged or stale .pfb is ignored and replaced; a
+# changed source gets a file of its own
+rm -rf "$TMP/cache"
+cp tests/programs/selfmod.pfusch "$TMP/cached.pfusch"
+run "$TMP/out" /dev/null $PFUSCH "$TMP/cached.pfusch" --no-visual --cache-dir "$TMP/cache"
+pfb=$(ls "$TMP"/cache/*.pfb)
+cp "$pfb" "$TMP/pfb"
+printf 'X' | dd of="$pfb" bs=1 seek=2000 conv=notrunc 2> /dev/null
+run "$TMP/out" /dev/null $PFUSCH "$TMP/cached.pfusch" --no-visual --cache-dir "$TMP/cache"
+same "cache: a damaged .pfb" "$EXPECTED/selfmod.out" "$TMP/out"
+same "cache: a damaged .pfb is replaced" "$TMP/pfb" "$pfb"
+head -c 100 "$TMP/pfb" > "$pfb"
+run "$TMP/out" /dev/null $PFUSCH "$TMP/cached.pfusch" --no-visual --cache-dir "$TMP/cache"
+same "cache: a short .pfb" "$EXPECTED/selfmod.out" "$TMP/out"
+same "cache: a short .pfb is replaced" "$TMP/pfb" "$pfb"
+cp tests/programs/rewrite.pfusch "$TMP/cached.pfusch"
+run "$TMP/out" /dev/null $PFUSCH "$TMP/cached.pfusch" --no-visual --cache-dir "$TMP/cache"
+same "cache: a changed source" "$EXPECTED/rewrite.out" "$TMP/out"
+checks=$((checks + 1))
+if [ "$(ls "$TMP/cache" | grep -c '\.pfb$')" -ne 2 ]; then
+    fail "cache: a changed source did not get a .pfb of its own"
+fi
+run "$TMP/out" /dev/null $PFUSCH "$TMP/cached.pfusch" --no-visual --cache-dir "$TMP/missing/cache"
+holds "cache: an unwritable directory" "Could not write program cache" "$TMP/out"
+holds "cache: an unwritable directory" "Invalid instruction at (2, 3)" "$TMP/out"
+
+# Benchmarks: a short run against a baseline saved by the same binary, then
+# the generated programs on each engine
+mkdir "$TMP/bench"
+checks=$((checks + 1))
+if ! $BENCH --pfusch $PFUSCH --dir "$TMP/bench" --steps 10000 --repetitions 1 \
+        --save "$TMP/baseline" > /dev/null ||
+    ! $BENCH --pfusch $PFUSCH --dir "$TMP/bench" --steps 10000 --repetitions 1 \
+        --baseline "$TMP/baseline" --threshold 100000 > /dev/null; then
+    fail "bench: make bench did not run"
+fi
+for program in "$TMP"/bench/*.pfusch; do
+    name=$(basename "$program" .pfusch)
+    run "$TMP/expected" /dev/null $PFUSCH "$program" --no-visual --engine reference --no-loop-check \
+        --max-steps 100000
+    for build in $PFUSCH build/pfusch-switch build/pfusch-jit; do
+        if [ -x "$build" ]; then
+            run "$TMP/out" /dev/null "$build" "$program" --no-visual --no-loop-check --max-steps 100000
+            same "bench $name: $build" "$TMP/expected" "$TMP/out"
+        fi
+    done
+done
+
+echo "$checks checks, $failures failed"
+[ $failures -eq 0 ]
@@ -0,0 +1,152 @@
+// Terminal emulator for the visual mode tests: reads what pfusch wrote to
+// the terminal from stdin and prints the screen left at the end.
+//
+// Usage: screen [-a]
+//   -a  also list the highlighted cells as "row col reverse background"
+//
+// Understood: ESC[2J, ESC[H, ESC[<row>;<col>H, ESC[...m with 0, 7 and
+// 48;5;<n>, '\r', '\n' and UTF-8 characters; other sequences are skipped.
+#include <stdio.h>
+#include <string.h>
+
+#define ROWS 80
+#define COLS 200
+
+struct cell {
+    char glyph[5];
+    int reverse;
+    int background;     // -1 when none
+};
+
+static struct cell screen[ROWS][COLS];
+static int row, col, reverse, background = -1;
+
+static void clear(void) {
+    for (int r = 0; r < ROWS; r++) {
+        for (int c = 0; c < COLS; c++) {
+            screen[r][c] = (struct cell){ " ", 0, -1 };
+        }
+    }
+}
+
+// Apply the parameters of an ESC[...m sequence
+static void set_attributes(const int *params, int count) {
+    if (count == 0) {
+        reverse = 0;
+        background = -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (params[i] == 0) {
+            reverse = 0;
+            background = -1;
+        } else if (params[i] == 7) {
+            reverse = 1;
+        } else if (params[i] == 48 && i + 2 < count && params[i + 1] == 5) {
+            background = params[i + 2];
+            i += 2;
+        }
+    }
+}
+
+static void escape(void) {
+    int params[16] = { 0 };
+    int count = 0, c = getchar();
+    if (c != '[') {
+        return;
+    }
+    while ((c = getchar()) != EOF) {
+        if (c >= '0' && c <= '9') {
+            if (count == 0) {
+                count = 1;
+            }
+            params[count - 1] = params[count - 1] * 10 + c - '0';
+        } else if (c == ';') {
+            if (count == 0) {
+                count = 1;
+            }
+            if (count < 16) {
+                count++;
+            }
+        } else if (c == '?') {
+            continue;
+        } else {
+            break;
+        }
+    }
+    if (c == 'J' && params[0] == 2) {
+        clear();
+    } else if (c == 'H') {
+        row = count > 0 && params[0] > 0 ? params[0] - 1 : 0;
+        col = count > 1 && params[1] > 0 ? params[1] - 1 : 0;
+    } else if (c == 'm') {
+        set_attributes(params, count);
+    }
+}
+
+static void put(int first) {
+    char glyph[5] = { (char)first };
+    int length = first < 0x80 ? 1 : first < 0xE0 ? 2 : first < 0xF0 ? 3 : 4;
+    for (int i = 1; i < length; i++) {
+        int c = getchar();
+        if (c == EOF) {
+            break;
+        }
+        glyph[i] = (char)c;
+    }
+    if (row < ROWS && col < COLS) {
+        struct cell *cell = &screen[row][col];
+        memcpy(cell->glyph, glyph, sizeof(glyph));
+        cell->reverse = reverse;
+        cell->background = background;
+    }
+    col++;
+}
+
+int main(int argc, char *argv[]) {
+    int attributes = argc > 1 && strcmp(argv[1], "-a") == 0;
+    int c;
+
+    clear();
+    while ((c = getchar()) != EOF) {
+        if (c == '\033') {
+            escape();
+        } else if (c == '\n') {
+            row++;
+            col = 0;
+        } else if (c == '\r') {
+            col = 0;
+        } else if (c >= 0x20) {
+            put(c);
+        }
+    }
+
+    // Rows without trailing blanks, up to the last non-blank one
+    int last = -1;
+    for (int r = 0; r < ROWS; r++) {
+        for (int x = 0; x < COLS; x++) {
+            if (strcmp(screen[r][x].glyph, " ") != 0) {
+                last = r;
+            }
+        }
+    }
+    for (int r = 0; r <= last; r++) {
+        int end = COLS;
+        while (end > 0 && strcmp(screen[r][end - 1].glyph, " ") == 0) {
+            end--;
+        }
+        for (int x = 0; x < end; x++) {
+            fputs(screen[r][x].glyph, stdout);
+        }
+        putchar('\n');
+    }
+    if (attributes) {
+        for (int r = 0; r < ROWS; r++) {
+            for (int x = 0; x < COLS; x++) {
+                if (screen[r][x].reverse || screen[r][x].background >= 0) {
+                    printf("%d %d %d %d\n", r, x, screen[r][x].reverse, screen[r][x].background);
+                }
+            }
+        }
+    }
+    return 0;
+}